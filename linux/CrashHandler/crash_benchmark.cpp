@@ -0,0 +1,591 @@
+// Micro-benchmarks for the stages of a crash report.
+//
+// Each stage is timed on its own: stack capture with every unwinder, module lookup of the
+// captured frames, in-process symbolization and text and JSON formatting, for stacks 8 to
+// 1024 frames deep. "warm" runs repeat an operation back to back; "cold" runs evict the CPU caches and
+// drop the DWARF row cache before every operation, the state a crash usually finds them in.
+// Capture is also run from 1 to N threads at once, and what merely having the handlers
+// installed costs operator new, throw/catch and dlopen is measured before and after
+// InstallCrashHandlers(), operator new again with the heap profiler sampling and throw/catch
+// with throw sites recorded or counted. Binary reports of 1 to 256 threads are written plain
+// and compressed, without and with stack memory (64 KB windows, 1 MB budget), into memory
+// and into a file, to show what compression costs in time and saves in bytes.
+//
+// Results are printed as JSON, one entry per stage with the nanoseconds per operation of its
+// fastest repetition: interference only ever adds time, so that is the steadiest number.
+// Stages that produce a report also give its size in bytes.
+// With --baseline the run fails when a stage is slower than in the baseline by more than the
+// tolerance (50% by default); benchmark_baseline.json holds the numbers of a reference run,
+// regenerate it with `crash_benchmark > benchmark_baseline.json` when a change is intended.
+//
+// Usage: crash_benchmark [--baseline FILE] [--tolerance PERCENT] [--threads N] [--quick]
+
+#include "crash_handler.h"
+#include "crash_report_writer.h"
+#include "dwarf_unwinder.h"
+#include "flight_recorder.h"
+#include "hang_detector.h"
+#include "module_map.h"
+#include "report_text.h"
+#include "stack_formatter.h"
+#include "stack_memory.h"
+#include "symbol_cache.h"
+#include "unwinder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr int kDepths[] = { 8, 64, 256, 1024 };
+constexpr int kMaxBenchmarkFrames = 1100;  // Deepest stack plus the frames below main
+constexpr int kRepetitions = 5;            // The fastest of these is reported
+constexpr uint64_t kBatchNs = 10 * 1000 * 1000;
+constexpr int kColdIterations = 15;
+constexpr size_t kEvictionBytes = 64 * 1024 * 1024;  // Larger than any last-level cache
+constexpr int kThreadDepth = 64;
+constexpr size_t kHeapSampleBytes = 512 * 1024;
+constexpr int kFlightRecorderDumpEvents = 16;
+constexpr size_t kHeapChurnMaxBlockBytes = 64 * 1024;
+constexpr int kHeapChurnWindow = 4096;
+constexpr int kHeapChurnAllocations = 4000000;
+constexpr int kReportThreadCounts[] = { 1, 16, 256 };
+constexpr int kReportStackDepths[] = { 8, 24, 64 };  // Report threads cycle through these
+constexpr size_t kReportMemorySize = 4 * 1024 * 1024;
+constexpr size_t kStackWindowBytes = 64 * 1024;
+constexpr size_t kStackMemoryBudgetBytes = 1024 * 1024;
+constexpr UnwinderKind kUnwinders[] = {
+    UnwinderKind::FramePointer, UnwinderKind::Dwarf, UnwinderKind::Auto, UnwinderKind::Backtrace,
+};
+
+struct Result {
+    std::string name;
+    double ns;
+    int frames;
+    uint64_t bytes;  // Output size of the stage, 0 if it has none
+};
+
+struct Settings {
+    bool quick = false;
+    int maxThreads = 0;
+};
+
+std::vector<Result> results;
+std::vector<uint8_t> evictionBuffer;
+volatile uintptr_t sink;  // Keeps the measured work observable
+
+uint64_t NowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+void EvictCaches() {
+    if (evictionBuffer.empty()) {
+        evictionBuffer.resize(kEvictionBytes);
+    }
+    for (size_t i = 0; i < evictionBuffer.size(); i += 64) {
+        evictionBuffer[i]++;
+    }
+    InvalidateDwarfUnwindCache();
+}
+
+// Nanoseconds per call of op in the fastest repetition. Warm: batches sized to take kBatchNs.
+// Cold: every call timed alone after the caches were evicted.
+double Measure(const std::function<void()>& op, bool cold, const Settings& settings) {
+    std::vector<double> samples;
+    if (cold) {
+        for (int i = 0; i < kColdIterations; i++) {
+            EvictCaches();
+            uint64_t start = NowNs();
+            op();
+            samples.push_back(static_cast<double>(NowNs() - start));
+        }
+        return *std::min_element(samples.begin(), samples.end());
+    }
+
+    uint64_t batchNs = settings.quick ? kBatchNs / 10 : kBatchNs;
+    int iterations = 1;
+    for (;;) {
+        uint64_t start = NowNs();
+        for (int i = 0; i < iterations; i++) {
+            op();
+        }
+        uint64_t elapsed = NowNs() - start;
+        if (elapsed >= batchNs / 4 || iterations >= (1 << 24)) {
+            iterations = static_cast<int>(std::max<uint64_t>(1, iterations * batchNs / std::max<uint64_t>(elapsed, 1)));
+            break;
+        }
+        iterations *= 2;
+    }
+    for (int repetition = 0; repetition < kRepetitions; repetition++) {
+        uint64_t start = NowNs();
+        for (int i = 0; i < iterations; i++) {
+            op();
+        }
+        samples.push_back(static_cast<double>(NowNs() - start) / iterations);
+    }
+    return *std::min_element(samples.begin(), samples.end());
+}
+
+void AddResult(const std::string& name, double ns, int frames = 0, uint64_t bytes = 0) {
+    results.push_back({ name, ns, frames, bytes });
+    if (bytes > 0) {
+        fprintf(stderr, "%-48s %12.1f ns %10llu bytes\n", name.c_str(), ns, static_cast<unsigned long long>(bytes));
+    }
+    else {
+        fprintf(stderr, "%-48s %12.1f ns\n", name.c_str(), ns);
+    }
+}
+
+// Runs body `depth` frames below the caller
+__attribute__((noinline)) void RunAtDepth(int depth, const std::function<void()>& body) {
+    if (depth <= 1) {
+        body();
+        return;
+    }
+    RunAtDepth(depth - 1, body);
+    __asm__ volatile("");  // The recursive call must not become a jump
+}
+
+// Walks the whole stack; CaptureStack() stops at kMaxStackFrames, reports do not need more
+__attribute__((noinline)) int CaptureWith(UnwinderKind kind, uintptr_t* frames, int maxFrames) {
+    if (kind == UnwinderKind::Backtrace) {
+        static_assert(sizeof(void*) == sizeof(uintptr_t), "frames are captured in place");
+        return backtrace(reinterpret_cast<void**>(frames), maxFrames);
+    }
+    UnwindState state;
+    if (!UnwindStateHere(state)) {
+        return 0;
+    }
+    ModuleMapView modules;
+    LocalUnwindMemory memory;
+    return UnwindStack(*GetUnwinder(kind), state, memory, modules, frames, maxFrames);
+}
+
+void DiscardOutput(void*, const char*, size_t) {}
+
+void BenchmarkCapture(const Settings& settings) {
+    for (int depth : kDepths) {
+        for (UnwinderKind kind : kUnwinders) {
+            for (bool cold : { false, true }) {
+                int frames = 0;
+                RunAtDepth(depth, [&] {
+                    uintptr_t captured[kMaxBenchmarkFrames];
+                    double ns = Measure([&] { frames = CaptureWith(kind, captured, kMaxBenchmarkFrames); }, cold, settings);
+                    AddResult(std::string("capture/") + UnwinderName(kind) + "/depth=" + std::to_string(depth) +
+                        (cold ? "/cold" : "/warm"), ns, frames);
+                });
+            }
+        }
+    }
+}
+
+// Module lookup, symbolization and formatting of a captured stack
+void BenchmarkReportStages(const Settings& settings) {
+    for (int depth : kDepths) {
+        uintptr_t frames[kMaxBenchmarkFrames];
+        int count = 0;
+        RunAtDepth(depth, [&] { count = CaptureWith(UnwinderKind::Dwarf, frames, kMaxBenchmarkFrames); });
+        std::string suffix = "/depth=" + std::to_string(depth);
+
+        auto lookup = [&] {
+            ModuleMapView modules;
+            for (int i = 0; i < count; i++) {
+                sink = reinterpret_cast<uintptr_t>(modules.Find(frames[i]));
+            }
+        };
+        auto symbolize = [&] {
+            for (int i = 0; i < count; i++) {
+                ResolvedSymbol symbol;
+                if (ResolveSymbol(i > 0 ? frames[i] - 1 : frames[i], symbol)) {
+                    sink = symbol.address;
+                }
+            }
+        };
+        auto format = [&] {
+            char buffer[4096];
+            SafeWriter writer(buffer, sizeof(buffer), DiscardOutput, nullptr);
+            ModuleMapView modules;
+            ReportModules used;
+            WriteFrames(writer, frames, count, modules, used);
+            WriteModuleList(writer, used);
+            writer.Flush();
+        };
+        auto formatJson = [&] {
+            char buffer[4096];
+            SafeWriter writer(buffer, sizeof(buffer), DiscardOutput, nullptr);
+            ModuleMapView modules;
+            ReportModules used;
+            StackFormatter formatter(writer, StackLayout::Json, modules, used);
+            formatter.BeginStack();
+            formatter.AddFrames(frames, count);
+            formatter.EndStack();
+            formatter.Finish();
+            writer.Flush();
+        };
+        for (bool cold : { false, true }) {
+            const char* temperature = cold ? "/cold" : "/warm";
+            AddResult("module-lookup" + suffix + temperature, Measure(lookup, cold, settings), count);
+            AddResult("symbolize" + suffix + temperature, Measure(symbolize, cold, settings), count);
+            AddResult("format" + suffix + temperature, Measure(format, cold, settings), count);
+            AddResult("format-json" + suffix + temperature, Measure(formatJson, cold, settings), count);
+        }
+    }
+}
+
+// Whole binary reports, the way the fatal handler writes them, for growing thread counts.
+// The threads' stacks are real captures of a few depths, so the frames compress like a
+// crashed process's would.
+void BenchmarkBinaryReports(const Settings& settings) {
+    std::vector<std::vector<uintptr_t>> stacks;
+    for (int depth : kReportStackDepths) {
+        uintptr_t frames[kMaxBenchmarkFrames];
+        int count = 0;
+        RunAtDepth(depth, [&] { count = CaptureWith(UnwinderKind::Dwarf, frames, kMaxBenchmarkFrames); });
+        stacks.emplace_back(frames, frames + count);
+    }
+    RegisterRecord registers;
+    FillRegisterRecord(nullptr, 1, registers);
+    ExceptionRecord exception = {};
+    exception.handlerKind = static_cast<uint32_t>(HandlerKind::FatalSignal);
+    exception.signalNumber = SIGSEGV;
+    exception.threadId = 1;
+
+    std::vector<uint8_t> memory(kReportMemorySize);
+    char path[] = "/tmp/crash_benchmark.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    CompressionState* compression = AllocateCompressionState();
+    bool stackMemory = PrepareStackMemory(kStackWindowBytes, kStackMemoryBudgetBytes);
+    ModuleMapView modules;
+    for (int threadCount : kReportThreadCounts) {
+        std::vector<ThreadCapture> threads(static_cast<size_t>(threadCount));
+        for (int i = 0; i < threadCount; i++) {
+            const std::vector<uintptr_t>& stack = stacks[static_cast<size_t>(i) % stacks.size()];
+            // Every thread's stack memory is copied from this thread's stack
+            threads[i] = { i + 1, i == 0 ? kThreadCrashed : 0u, stack.data(), static_cast<int>(stack.size()),
+                i == 0 ? &registers : nullptr, reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) };
+        }
+        std::string prefix = "binary-report/threads=" + std::to_string(threadCount);
+        for (bool withStack : { false, true }) {
+            if (withStack && !stackMemory) {
+                continue;
+            }
+            for (bool compressed : { false, true }) {
+                if (compressed && !compression) {
+                    continue;
+                }
+                CompressionState* state = compressed ? compression : nullptr;
+                std::string mode = std::string(withStack ? "/stack" : "") + (compressed ? "/compressed" : "/plain");
+                uint64_t bytes = 0;
+                // Planning reads /proc/self/maps, which the handler does for every report too
+                auto write = [&](ReportSink& sink) {
+                    StackMemoryPlan plan;
+                    bool planned = withStack && PlanStackWindows(getpid(), threads.data(), threadCount, plan);
+                    WriteCrashReport(sink, exception, threads.data(), threadCount, modules.Modules(),
+                        static_cast<size_t>(modules.Count()), nullptr, state, planned ? &plan : nullptr);
+                };
+                auto toMemory = [&] {
+                    MemoryReportSink sink(memory.data(), memory.size());
+                    write(sink);
+                    bytes = reinterpret_cast<const ReportHeader*>(memory.data())->totalSize;
+                };
+                auto toFile = [&] {
+                    lseek(fd, 0, SEEK_SET);
+                    FdReportSink sink(fd);
+                    write(sink);
+                };
+                double ns = Measure(toMemory, false, settings);
+                AddResult(prefix + "/memory" + mode, ns, 0, bytes);
+                if (fd >= 0) {
+                    AddResult(prefix + "/file" + mode, Measure(toFile, false, settings), 0, bytes);
+                }
+            }
+        }
+    }
+    ReleaseCompressionState(compression);
+    if (stackMemory) {
+        ReleaseStackMemory();
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// Per-thread cost of warm captures while 1..N threads capture at once
+void BenchmarkConcurrentCapture(const Settings& settings) {
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < settings.maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(settings.maxThreads);
+    for (int threads : threadCounts) {
+        std::atomic<int> ready{ 0 };
+        std::vector<double> perThread(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                RunAtDepth(kThreadDepth, [&] {
+                    uintptr_t captured[kMaxBenchmarkFrames];
+                    ready++;
+                    while (ready.load() < threads) {
+                    }
+                    perThread[t] = Measure([&] { CaptureWith(UnwinderKind::Auto, captured, kMaxBenchmarkFrames); },
+                        false, settings);
+                });
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        double total = 0;
+        for (double ns : perThread) {
+            total += ns;
+        }
+        AddResult("capture/auto/depth=" + std::to_string(kThreadDepth) + "/threads=" + std::to_string(threads),
+            total / threads);
+    }
+}
+
+// Steady-state cost of the installed handlers on the paths they hook or interpose
+void BenchmarkInstalledOverhead(const Settings& settings, const char* phase) {
+    std::string suffix = std::string("/") + phase;
+    AddResult("installed/new-delete" + suffix, Measure([] {
+        void* block = ::operator new(64);
+        sink = reinterpret_cast<uintptr_t>(block);
+        ::operator delete(block);
+    }, false, settings));
+    AddResult("installed/throw-catch" + suffix, Measure([] {
+        try {
+            throw std::runtime_error("benchmark");
+        }
+        catch (const std::exception& e) {
+            sink = reinterpret_cast<uintptr_t>(e.what());
+        }
+    }, false, settings));
+    // libm is already loaded, so this is the loader's bookkeeping plus our module map refresh
+    AddResult("installed/dlopen-dlclose" + suffix, Measure([] {
+        void* handle = dlopen("libm.so.6", RTLD_NOW);
+        if (handle) {
+            dlclose(handle);
+        }
+    }, false, settings));
+}
+
+// operator new and delete with the heap profiler sampling, for small blocks (mostly the
+// countdown) and blocks of the mean sample size (a stack capture every other call or so)
+void BenchmarkHeapProfiler(const Settings& settings) {
+    AddResult("installed/new-delete/heap-profiled", Measure([] {
+        void* block = ::operator new(64);
+        sink = reinterpret_cast<uintptr_t>(block);
+        ::operator delete(block);
+    }, false, settings));
+    AddResult("installed/new-delete-large/heap-profiled", Measure([] {
+        void* block = ::operator new(kHeapSampleBytes);
+        sink = reinterpret_cast<uintptr_t>(block);
+        ::operator delete(block);
+    }, false, settings));
+}
+
+// operator new and delete of small blocks after a long run of blocks of varied sizes
+// allocated and freed through a window of live blocks, so sampled blocks at many addresses
+// come and go and every free looks up the live sample table. Freed samples must not make
+// those lookups slower over time.
+void BenchmarkHeapChurn(const Settings& settings) {
+    std::vector<void*> window(kHeapChurnWindow, nullptr);
+    uint64_t random = 0x9e3779b97f4a7c15ull;
+    int churn = settings.quick ? kHeapChurnAllocations / 10 : kHeapChurnAllocations;
+    for (int i = 0; i < churn; i++) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        void*& slot = window[static_cast<size_t>(i) % window.size()];
+        ::operator delete(slot);
+        slot = ::operator new(16 + random % kHeapChurnMaxBlockBytes);
+    }
+    AddResult("installed/new-delete/heap-churned", Measure([] {
+        void* block = ::operator new(64);
+        sink = reinterpret_cast<uintptr_t>(block);
+        ::operator delete(block);
+    }, false, settings));
+    for (void* block : window) {
+        ::operator delete(block);
+    }
+}
+
+// throw/catch with every throw site recorded, or counted by the throw profiler
+void BenchmarkThrowSites(const Settings& settings, const char* phase) {
+    AddResult(std::string("installed/throw-catch/") + phase, Measure([] {
+        try {
+            throw std::runtime_error("benchmark");
+        }
+        catch (const std::exception& e) {
+            sink = reinterpret_cast<uintptr_t>(e.what());
+        }
+    }, false, settings));
+}
+
+// Appending to the calling thread's flight recorder ring, with values and with text, and
+// collecting the last events the way the fatal handlers do
+void BenchmarkFlightRecorder(const Settings& settings) {
+    int64_t counter = 0;
+    AddResult("flight-recorder/record", Measure([&] {
+        RecordFlightEvent(1, counter++, 2, 3);
+    }, false, settings));
+    AddResult("flight-recorder/record-text", Measure([] {
+        RecordFlightText(2, "benchmark event");
+    }, false, settings));
+    FlightEventRecord events[kFlightRecorderDumpEvents];
+    AddResult("flight-recorder/collect/events=16", Measure([&] {
+        sink = static_cast<uintptr_t>(CollectFlightEvents(events, kFlightRecorderDumpEvents,
+            kFlightRecorderDumpEvents, 0));
+    }, false, settings));
+}
+
+// A watched thread's heartbeat, the hang detector's cost on the hot path
+void BenchmarkHeartbeat(const Settings& settings) {
+    if (!WatchCurrentThread("benchmark", 60 * 1000)) {
+        return;
+    }
+    AddResult("hang-detector/heartbeat", Measure([] { Heartbeat(); }, false, settings));
+    UnwatchCurrentThread();
+}
+
+// Stage names and times of a file written by this tool
+bool ReadBaseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const std::string nameKey = "\"name\": \"";
+    const std::string nsKey = "\"ns\": ";
+    for (size_t position = text.find(nameKey); position != std::string::npos; position = text.find(nameKey, position)) {
+        position += nameKey.size();
+        size_t nameEnd = text.find('"', position);
+        size_t ns = text.find(nsKey, nameEnd);
+        if (nameEnd == std::string::npos || ns == std::string::npos) {
+            return false;
+        }
+        baseline[text.substr(position, nameEnd - position)] = strtod(text.c_str() + ns + nsKey.size(), nullptr);
+    }
+    return !baseline.empty();
+}
+
+void PrintResults() {
+    printf("{\n  \"unit\": \"ns\",\n  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        printf("    { \"name\": \"%s\", \"ns\": %.1f, \"frames\": %d", results[i].name.c_str(), results[i].ns,
+            results[i].frames);
+        if (results[i].bytes > 0) {
+            printf(", \"bytes\": %llu", static_cast<unsigned long long>(results[i].bytes));
+        }
+        printf(" }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    std::string baselinePath;
+    double tolerance = 50;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        }
+        else if (argument == "--tolerance" && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        }
+        else if (argument == "--threads" && i + 1 < argc) {
+            settings.maxThreads = atoi(argv[++i]);
+        }
+        else if (argument == "--quick") {
+            settings.quick = true;
+        }
+        else {
+            fprintf(stderr, "Usage: crash_benchmark [--baseline FILE] [--tolerance PERCENT] [--threads N] [--quick]\n");
+            return 2;
+        }
+    }
+    if (settings.maxThreads <= 0) {
+        settings.maxThreads = static_cast<int>(std::min(std::max(std::thread::hardware_concurrency(), 1u), 16u));
+    }
+    std::map<std::string, double> baseline;
+    if (!baselinePath.empty() && !ReadBaseline(baselinePath, baseline)) {
+        fprintf(stderr, "crash_benchmark: cannot read baseline %s\n", baselinePath.c_str());
+        return 2;
+    }
+
+    // Before anything builds the module map, so dlopen is not refreshing it yet
+    BenchmarkInstalledOverhead(settings, "before");
+    if (!InstallCrashHandlers()) {
+        fprintf(stderr, "crash_benchmark: cannot install the crash handlers\n");
+        return 2;
+    }
+    BenchmarkInstalledOverhead(settings, "after");
+    BenchmarkCapture(settings);
+    BenchmarkReportStages(settings);
+    BenchmarkBinaryReports(settings);
+    BenchmarkConcurrentCapture(settings);
+    UninstallCrashHandlers();
+    CrashHandlerOptions profiled;
+    profiled.heapSampleBytes = kHeapSampleBytes;
+    profiled.recordThrowSites = true;
+    if (InstallCrashHandlers(profiled)) {
+        BenchmarkHeapProfiler(settings);
+        BenchmarkHeapChurn(settings);
+        BenchmarkThrowSites(settings, "throw-sites");
+        UninstallCrashHandlers();
+    }
+    CrashHandlerOptions throwProfiled;
+    throwProfiled.profileThrowSites = true;
+    if (InstallCrashHandlers(throwProfiled)) {
+        BenchmarkThrowSites(settings, "throw-profiled");
+        UninstallCrashHandlers();
+    }
+    CrashHandlerOptions flightRecorded;
+    flightRecorded.flightRecorderEvents = 256;
+    if (InstallCrashHandlers(flightRecorded)) {
+        BenchmarkFlightRecorder(settings);
+        UninstallCrashHandlers();
+    }
+    BenchmarkHeartbeat(settings);
+    PrintResults();
+
+    bool regressed = false;
+    for (const Result& result : results) {
+        auto found = baseline.find(result.name);
+        if (found == baseline.end() || found->second <= 0) {
+            continue;
+        }
+        double change = (result.ns / found->second - 1) * 100;
+        if (change > tolerance) {
+            fprintf(stderr, "crash_benchmark: %s regressed: %.1f ns, baseline %.1f ns (+%.0f%%)\n",
+                result.name.c_str(), result.ns, found->second, change);
+            regressed = true;
+        }
+    }
+    return regressed ? 1 : 0;
+}
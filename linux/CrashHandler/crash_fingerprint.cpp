@@ -0,0 +1,176 @@
+#include "crash_fingerprint.h"
+
+#include "elf_symbols.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+
+namespace {
+
+constexpr int kMaxStrippedRanges = 64;
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ull;
+constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+constexpr uint8_t kUnknownModule = 0xff;
+
+// Libraries whose functions may sit above the faulting code only to relay the crash
+const char* const kRuntimeLibraries[] = { "libc.so", "libstdc++.so", "libgcc_s.so", "libc++.so", "libc++abi.so" };
+
+// Mangled names of those functions
+const char* const kRuntimeFunctions[] = {
+    "abort", "raise", "gsignal", "pthread_kill", "__pthread_kill_implementation", "__pthread_kill_internal",
+    "__assert_fail", "__assert_fail_base", "__assert_perror_fail", "__libc_message", "__fortify_fail",
+    "__chk_fail", "__stack_chk_fail", "malloc_printerr",
+    "_ZSt9terminatev", "_ZN10__cxxabiv111__terminateEPFvvE", "_ZN9__gnu_cxx27__verbose_terminate_handlerEv",
+    "__cxa_throw", "__cxa_rethrow", "__cxa_pure_virtual", "__cxa_deleted_virtual", "__cxa_call_terminate",
+    "__cxa_bad_cast", "__cxa_bad_typeid", "_Unwind_RaiseException", "_Unwind_Resume_or_Rethrow",
+};
+
+struct AddressRange {
+    uintptr_t start;
+    uintptr_t end;
+};
+
+// Set up by PrepareStackFingerprint() before any handler is installed, read-only afterwards
+AddressRange strippedRanges[kMaxStrippedRanges];
+int strippedRangeCount = 0;
+
+void AddStrippedRange(uintptr_t start, uintptr_t end) {
+    if (strippedRangeCount < kMaxStrippedRanges && start < end) {
+        strippedRanges[strippedRangeCount++] = { start, end };
+    }
+}
+
+bool IsRuntimeLibrary(const char* path) {
+    const char* slash = strrchr(path, '/');
+    const char* name = slash ? slash + 1 : path;
+    for (const char* library : kRuntimeLibraries) {
+        if (strncmp(name, library, strlen(library)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// std::__throw_bad_alloc() and friends: _ZSt<length>__throw_...
+bool IsThrowHelper(const std::string& name) {
+    if (name.compare(0, 4, "_ZSt") != 0) {
+        return false;
+    }
+    size_t digits = name.find_first_not_of("0123456789", 4);
+    return digits > 4 && digits != std::string::npos && name.compare(digits, 8, "__throw_") == 0;
+}
+
+bool IsRuntimeFunction(const std::string& name) {
+    for (const char* function : kRuntimeFunctions) {
+        if (name == function) {
+            return true;
+        }
+    }
+    return IsThrowHelper(name);
+}
+
+// End of a symbol; those without a size extend up to the next symbol
+uint64_t SymbolEnd(const std::vector<ElfSymbol>& symbols, size_t index) {
+    if (symbols[index].size != 0) {
+        return symbols[index].address + symbols[index].size;
+    }
+    return index + 1 < symbols.size() ? symbols[index + 1].address : symbols[index].address + 1;
+}
+
+bool IsStripped(uintptr_t address) {
+    for (int i = 0; i < strippedRangeCount; i++) {
+        if (address >= strippedRanges[i].start && address < strippedRanges[i].end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * kFnvPrime;
+    }
+    return hash;
+}
+
+}  // namespace
+
+void PrepareStackFingerprint(const uintptr_t* handlerFunctions, int count) {
+    strippedRangeCount = 0;
+    ModuleMapView moduleMap;
+    std::map<std::string, ElfSymbolTable> tables;
+    auto table = [&tables](const ModuleInfo& module) -> const ElfSymbolTable& {
+        auto inserted = tables.emplace(module.path, ElfSymbolTable());
+        if (inserted.second) {
+            inserted.first->second.Load(module.path);
+        }
+        return inserted.first->second;
+    };
+
+    for (int i = 0; i < moduleMap.Count(); i++) {
+        const ModuleInfo& module = moduleMap.At(i);
+        if (!IsRuntimeLibrary(module.path)) {
+            continue;
+        }
+        const std::vector<ElfSymbol>& symbols = table(module).Symbols();
+        for (size_t j = 0; j < symbols.size(); j++) {
+            if (IsRuntimeFunction(symbols[j].name)) {
+                AddStrippedRange(module.loadBias + symbols[j].address, module.loadBias + SymbolEnd(symbols, j));
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        const ModuleInfo* module = moduleMap.Find(handlerFunctions[i]);
+        if (!module) {
+            continue;
+        }
+        const std::vector<ElfSymbol>& symbols = table(*module).Symbols();
+        uint64_t address = handlerFunctions[i] - module->loadBias;
+        auto next = std::upper_bound(symbols.begin(), symbols.end(), address,
+            [](uint64_t value, const ElfSymbol& symbol) { return value < symbol.address; });
+        if (next != symbols.begin()) {
+            size_t index = static_cast<size_t>(next - symbols.begin()) - 1;
+            if (address < SymbolEnd(symbols, index)) {
+                AddStrippedRange(module->loadBias + symbols[index].address, module->loadBias + SymbolEnd(symbols, index));
+            }
+        }
+    }
+}
+
+void FingerprintStack(const uintptr_t* frames, int count, const ModuleLookup& modules, FingerprintRecord& record) {
+    int first = 0;
+    while (first < count && IsStripped(frames[first])) {
+        first++;
+    }
+    if (first == count) {
+        first = 0;  // Nothing but handler and runtime frames: hash those rather than nothing
+    }
+
+    uint64_t hash = kFnvOffsetBasis;
+    int hashed = 0;
+    for (int i = first; i < count && hashed < kFingerprintFrames; i++, hashed++) {
+        // Frames past the first are return addresses; the call may end its module
+        uintptr_t lookup = i > 0 && frames[i] > 0 ? frames[i] - 1 : frames[i];
+        const ModuleInfo* module = modules.Find(lookup);
+        if (!module) {
+            hash = HashBytes(hash, &kUnknownModule, sizeof(kUnknownModule));
+            continue;
+        }
+        if (module->buildIdSize > 0) {
+            hash = HashBytes(hash, module->buildId, module->buildIdSize);
+        }
+        else {
+            const char* slash = strrchr(module->path, '/');
+            const char* name = slash ? slash + 1 : module->path;
+            hash = HashBytes(hash, name, strlen(name));
+        }
+        uint64_t offset = frames[i] - module->loadBias;
+        hash = HashBytes(hash, &offset, sizeof(offset));
+    }
+    record.fingerprint = hash;
+    record.frameCount = static_cast<uint32_t>(hashed);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "crash_report_format.h"
+#include "module_map.h"
+
+#include <cstdint>
+
+// Stable crash fingerprints.
+//
+// Hashing raw frame addresses gives a different value in every process because of ASLR.
+// The fingerprint instead hashes, for the top kFingerprintFrames frames, the build-id (or
+// file name) of the frame's module and the frame's offset inside it, so the same bug in the
+// same build always yields the same value. Leading frames inside the crash handler and in
+// runtime code that only relays the crash (abort, raise, std::terminate, __cxa_throw, ...)
+// are skipped first, so a crash is keyed by the code that caused it.
+
+constexpr int kFingerprintFrames = 8;
+
+// Finds the address ranges of the runtime functions above, and of the functions containing
+// handlerFunctions (the handlers that capture stacks from inside themselves), by reading the
+// symbol tables of the modules involved. Not async-signal-safe; call at install time.
+void PrepareStackFingerprint(const uintptr_t* handlerFunctions, int count);
+
+// Fills fingerprint and frameCount of record; previousCount is left alone. Async-signal-safe.
+void FingerprintStack(const uintptr_t* frames, int count, const ModuleLookup& modules, FingerprintRecord& record);
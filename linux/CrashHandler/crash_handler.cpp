@@ -0,0 +1,668 @@
+#include "crash_handler.h"
+
+#include "crash_fingerprint.h"
+#include "crash_index.h"
+#include "crash_monitor.h"
+#include "crash_report_writer.h"
+#include "flight_recorder.h"
+#include "hang_detector.h"
+#include "heap_profiler.h"
+#include "memory_reserve.h"
+#include "module_map.h"
+#include "report_compression.h"
+#include "report_text.h"
+#include "safe_writer.h"
+#include "stack_capture.h"
+#include "stack_memory.h"
+#include "thread_dump.h"
+#include "throw_profiler.h"
+#include "throw_site.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cxxabi.h>
+#include <exception>
+#include <fcntl.h>
+#include <limits.h>
+#include <new>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <typeinfo>
+
+namespace {
+
+constexpr size_t kReportBufferSize = 64 * 1024;
+constexpr size_t kNewHandlerBufferSize = 2048;
+constexpr int kReportedHeapSites = 5;
+constexpr size_t kAltStackSize = 64 * 1024;  // Same budget SetThreadStackGuarantee gets on Windows
+constexpr uint64_t kOtherReportTimeoutMicros = 5 * 1000 * 1000;
+constexpr int kMaxReportedFlightEvents = 1024;
+
+constexpr int kFatalSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGTRAP, SIGSYS };
+constexpr int kFatalSignalCount = sizeof(kFatalSignals) / sizeof(kFatalSignals[0]);
+
+// Handler state, all set up by InstallCrashHandlers()
+CrashHandlerOptions handlerOptions;
+bool handlersInstalled = false;
+std::terminate_handler previousTerminateHandler = nullptr;
+std::new_handler previousNewHandler = nullptr;
+struct sigaction previousSignalActions[kFatalSignalCount];
+
+// Report file mapped at install time; nullptr when binary reports are disabled
+void* reportRegion = nullptr;
+size_t reportRegionSize = 0;
+char pendingReportPath[PATH_MAX];  // Empty when no earlier report was found
+CompressionState* reportCompression = nullptr;  // Set when binary reports are compressed
+
+// Only one thread writes a fatal report; the others wait for it instead of interleaving
+std::atomic<pid_t> reportingThread{ 0 };
+std::atomic<bool> reportComplete{ false };
+char reportBuffer[kReportBufferSize];
+
+// New handler reports use this buffer when it is free and a small stack buffer otherwise
+char newHandlerBuffer[kReportBufferSize];
+std::atomic<bool> newHandlerBufferBusy{ false };
+ThreadCapture reportThreads[kMaxDumpThreads + 2];  // The reporting thread first, then its throw site
+FlightEventRecord flightEvents[kMaxReportedFlightEvents];
+
+thread_local void* threadAltStack = nullptr;
+
+uint64_t MonotonicMicros() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + static_cast<uint64_t>(now.tv_nsec) / 1000;
+}
+
+pid_t CurrentThreadId() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+// Flushes the report header, unless the report is written in one piece, and records how
+// long it took to get the first byte out (or, in one piece, to format the headline)
+uint64_t FlushFirstBytes(SafeWriter& writer, uint64_t startMicros) {
+    if (!handlerOptions.singleWriteReports) {
+        writer.Flush();
+    }
+    return MonotonicMicros() - startMicros;
+}
+
+// Ends the report with its time to first byte and writes out the rest: all of it in one
+// write(2) if it is still whole in the buffer. Then records the time to first byte in the
+// exception, for the callback and a binary report written after this, and hands the fields
+// to the report callback.
+void FinishReport(SafeWriter& writer, uint64_t startMicros, uint64_t firstByteMicros, ExceptionRecord& exception,
+    CrashReportFields& fields) {
+    if (!writer.Flushed()) {
+        firstByteMicros = MonotonicMicros() - startMicros;  // The write below carries the first byte
+    }
+    exception.timeToFirstByteMicros = static_cast<uint32_t>(firstByteMicros);
+    WriteTimeToFirstByte(writer, firstByteMicros);
+    bool whole = !writer.Flushed();
+    const char* text = writer.Data();
+    size_t textLength = writer.Size();
+    writer.Flush();
+    if (handlerOptions.reportCallback) {
+        fields.text = whole ? text : nullptr;
+        fields.textLength = whole ? textLength : 0;
+        handlerOptions.reportCallback(fields, handlerOptions.reportCallbackContext);
+    }
+}
+
+// Writes the binary copy of a fatal report into the pre-mapped report file
+void WriteBinaryReport(const ExceptionRecord& exception, const ThreadCapture* threads, int threadCount,
+    const FingerprintRecord& fingerprint, const FlightEventRecord* events, int eventCount) {
+    if (!reportRegion) {
+        return;
+    }
+    MemoryReportSink sink(reportRegion, reportRegionSize);
+    ModuleMapView moduleMap;
+    StackMemoryPlan stackMemory;
+    bool withStackMemory = PlanStackWindows(getpid(), threads, threadCount, stackMemory);
+    WriteCrashReport(sink, exception, threads, threadCount, moduleMap.Modules(),
+        static_cast<size_t>(moduleMap.Count()), &fingerprint, reportCompression,
+        withStackMemory ? &stackMemory : nullptr, events, eventCount);
+}
+
+// Fingerprints the crashing stack, counts it in the crash index and writes the fingerprint
+// line. Returns true if the crash is a repeat whose full report should be skipped.
+bool WriteFingerprintAndCheckRepeat(SafeWriter& writer, const uintptr_t* frames, int frameCount,
+    FingerprintRecord& fingerprint) {
+    {
+        ModuleMapView moduleMap;
+        FingerprintStack(frames, frameCount, moduleMap, fingerprint);
+    }
+    bool repeat = RecordCrash(fingerprint) && fingerprint.previousCount > 0;
+    WriteFingerprint(writer, fingerprint);
+    if (repeat) {
+        writer.Append("Crash already reported: full report skipped\n");
+    }
+    return repeat;
+}
+
+// What WriteFatalStacks() put in reportThreads and flightEvents
+struct FatalStacks {
+    int threadCount;
+    int eventCount;
+};
+
+// Writes the reporting thread's stack, where it threw the exception std::terminate ran for
+// if that was recorded, and, if enabled, the stacks of all other threads and the flight
+// recorder's last events. Returns after the other threads answered or the dump timed out;
+// WriteFatalBinaryReport() then uses and releases the captures.
+FatalStacks WriteFatalStacks(SafeWriter& writer, const ExceptionRecord& exception, const uintptr_t* frames,
+    int frameCount, const RegisterRecord* registers, const ThrowSite* throwSite = nullptr) {
+    ThreadCapture& crashed = reportThreads[0];
+    crashed.threadId = exception.threadId;
+    crashed.flags = kThreadCrashed;
+    crashed.frames = frames;
+    crashed.frameCount = frameCount;
+    crashed.registers = registers;
+    // Without a signal context, the stack from here up still holds the frames that led here
+    crashed.stackPointer = registers ? RegisterStackPointer(*registers)
+                                     : reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    int threadCount = 1;
+    if (throwSite) {
+        reportThreads[threadCount++] = { exception.threadId, kThreadThrowSite, throwSite->frames,
+            throwSite->frameCount, nullptr, 0 };
+    }
+    if (handlerOptions.captureAllThreads) {
+        threadCount += DumpOtherThreads(reportThreads + threadCount, kMaxDumpThreads,
+            handlerOptions.allThreadsTimeoutMillis);
+    }
+
+    {
+        ModuleMapView moduleMap;
+        ReportModules used;
+        WriteFrames(writer, frames, frameCount, moduleMap, used);
+        for (int i = 1; i < threadCount; i++) {
+            const ThreadCapture& thread = reportThreads[i];
+            WriteThreadHeader(writer, thread.threadId, thread.flags);
+            WriteFrames(writer, thread.frames, thread.frameCount, moduleMap, used);
+        }
+        WriteModuleList(writer, used);
+    }
+    int eventCount = CollectFlightEvents(flightEvents, kMaxReportedFlightEvents,
+        handlerOptions.flightRecorderDumpEvents, exception.threadId);
+    WriteFlightEvents(writer, flightEvents, eventCount);
+    return { threadCount, eventCount };
+}
+
+// Writes the binary copy of what WriteFatalStacks() captured, after FinishReport() recorded
+// the time to first byte, and releases the thread captures
+void WriteFatalBinaryReport(const ExceptionRecord& exception, const FatalStacks& stacks,
+    const FingerprintRecord& fingerprint) {
+    WriteBinaryReport(exception, reportThreads, stacks.threadCount, fingerprint, flightEvents, stacks.eventCount);
+    if (handlerOptions.captureAllThreads) {
+        ReleaseThreadCaptures(ThreadDumpUser::Fatal);
+    }
+}
+
+// Moves a report left by an earlier run out of the way, named after the process that wrote it
+void CollectPendingReport(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    ReportHeader header = {};
+    ssize_t length = pread(fd, &header, sizeof(header), 0);
+    close(fd);
+    if (length != static_cast<ssize_t>(sizeof(header)) || header.magic != kReportMagic ||
+        header.state == static_cast<uint32_t>(ReportState::Empty)) {
+        return;
+    }
+    char collectedPath[PATH_MAX];
+    int written = snprintf(collectedPath, sizeof(collectedPath), "%s.%d", path, header.processId);
+    if (written > 0 && static_cast<size_t>(written) < sizeof(collectedPath) && rename(path, collectedPath) == 0) {
+        CopyReportString(pendingReportPath, sizeof(pendingReportPath), collectedPath);
+    }
+}
+
+// Creates the report file with all of its blocks allocated, so that writing to the
+// mapping from a handler cannot fail with SIGBUS on a full disk, and maps it shared
+bool MapReportRegion(const char* path, size_t capacity) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (posix_fallocate(fd, 0, static_cast<off_t>(capacity)) != 0) {
+        close(fd);
+        unlink(path);
+        return false;
+    }
+    void* region = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        unlink(path);
+        return false;
+    }
+    reportRegion = region;
+    reportRegionSize = capacity;
+    return true;
+}
+
+// Records the type and message of the exception in flight, if any. Inspects it with a
+// rethrow instead of std::rethrow_exception, which allocates.
+void FillCurrentException(ExceptionRecord& exception) {
+    std::type_info* type = abi::__cxa_current_exception_type();
+    if (!type) {
+        return;
+    }
+    exception.flags |= kExceptionHasCurrentException;
+    CopyReportString(exception.exceptionType, sizeof(exception.exceptionType), type->name());
+    try {
+        throw;
+    }
+    catch (const std::exception& e) {
+        exception.flags |= kExceptionIsStdException;
+        CopyReportString(exception.exceptionMessage, sizeof(exception.exceptionMessage), e.what());
+    }
+    catch (...) {
+        // Not a std::exception: the type name is all there is
+    }
+}
+
+// Claims the right to write the fatal report. If another thread is already reporting,
+// waits (bounded) for it to finish and returns false.
+bool ClaimFatalReport(pid_t threadId) {
+    pid_t expected = 0;
+    if (reportingThread.compare_exchange_strong(expected, threadId)) {
+        return true;
+    }
+    if (expected == threadId) {
+        return false;
+    }
+    uint64_t deadline = MonotonicMicros() + kOtherReportTimeoutMicros;
+    while (!reportComplete.load() && MonotonicMicros() < deadline) {
+        timespec pause = { 0, 1000000 };
+        nanosleep(&pause, nullptr);
+    }
+    return false;
+}
+
+int FatalSignalIndex(int signalNumber) {
+    for (int i = 0; i < kFatalSignalCount; i++) {
+        if (kFatalSignals[i] == signalNumber) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Passes the signal on to the previously installed handler, or to the default action
+void ChainSignal(int signalNumber, siginfo_t* info, void* context) {
+    int index = FatalSignalIndex(signalNumber);
+    if (handlerOptions.chainPreviousHandlers && index >= 0) {
+        const struct sigaction& previous = previousSignalActions[index];
+        if (previous.sa_flags & SA_SIGINFO) {
+            if (previous.sa_sigaction) {
+                previous.sa_sigaction(signalNumber, info, context);
+                return;
+            }
+        }
+        else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+            previous.sa_handler(signalNumber);
+            return;
+        }
+    }
+
+    // Restore the default action and re-raise. The signal stays blocked until this handler
+    // returns, so the process then dies with the original signal (and dumps core if enabled)
+    struct sigaction defaultAction = {};
+    defaultAction.sa_handler = SIG_DFL;
+    sigemptyset(&defaultAction.sa_mask);
+    sigaction(signalNumber, &defaultAction, nullptr);
+    raise(signalNumber);
+}
+
+// Fatal signal handler, the Linux equivalent of CustomUnhandledExceptionFilter
+void CustomSignalHandler(int signalNumber, siginfo_t* info, void* context) {
+    uint64_t startMicros = MonotonicMicros();
+    int savedErrno = errno;
+    pid_t threadId = CurrentThreadId();
+
+    if (!ClaimFatalReport(threadId)) {
+        if (reportingThread.load() == threadId && !reportComplete.load()) {
+            // We faulted while writing our own report: bail out with what we have
+            static const char kRecursive[] = "Crash handler: fault while reporting, giving up\n";
+            SafeWriteAll(handlerOptions.outputFd, kRecursive, sizeof(kRecursive) - 1);
+        }
+        ChainSignal(signalNumber, info, context);
+        errno = savedErrno;
+        return;
+    }
+
+    ExceptionRecord exception = {};
+    exception.handlerKind = static_cast<uint32_t>(HandlerKind::FatalSignal);
+    exception.signalNumber = signalNumber;
+    exception.threadId = threadId;
+    if (info) {
+        exception.signalCode = info->si_code;
+        if (signalNumber == SIGSEGV || signalNumber == SIGBUS || signalNumber == SIGILL || signalNumber == SIGFPE) {
+            exception.flags |= kExceptionHasFaultAddress;
+            exception.faultAddress = reinterpret_cast<uintptr_t>(info->si_addr);
+        }
+    }
+    if (NotifyCrashMonitor(exception, context)) {
+        reportComplete.store(true);
+        ChainSignal(signalNumber, info, context);
+        errno = savedErrno;
+        return;
+    }
+
+    SafeWriter writer(reportBuffer, sizeof(reportBuffer), handlerOptions.outputFd);
+    WriteReportHeadline(writer, exception);
+    uint64_t firstByteMicros = FlushFirstBytes(writer, startMicros);
+    WriteReportDetails(writer, exception);
+
+    uintptr_t frames[kMaxStackFrames];
+    int frameCount = CaptureStackFromContext(context, frames, kMaxStackFrames);
+    FingerprintRecord fingerprint = {};
+    bool repeat = WriteFingerprintAndCheckRepeat(writer, frames, frameCount, fingerprint);
+    RegisterRecord registers;
+    FatalStacks stacks = {};
+    if (!repeat) {
+        FillRegisterRecord(context, threadId, registers);
+        if (registers.count > 0) {
+            WriteRegisters(writer, registers);
+        }
+        stacks = WriteFatalStacks(writer, exception, frames, frameCount, registers.count > 0 ? &registers : nullptr);
+    }
+    CrashReportFields fields = { &exception, frames, frameCount, fingerprint.fingerprint, repeat, nullptr, 0 };
+    FinishReport(writer, startMicros, firstByteMicros, exception, fields);
+    if (!repeat) {
+        WriteFatalBinaryReport(exception, stacks, fingerprint);
+    }
+
+    reportComplete.store(true);
+    ChainSignal(signalNumber, info, context);
+    errno = savedErrno;
+}
+
+// Custom terminate handler
+void CustomTerminateHandler() {
+    uint64_t startMicros = MonotonicMicros();
+    pid_t threadId = CurrentThreadId();
+    bool ownsReport = ClaimFatalReport(threadId);
+    bool handled = false;
+    ExceptionRecord exception = {};
+
+    if (ownsReport) {
+        exception.handlerKind = static_cast<uint32_t>(HandlerKind::Terminate);
+        exception.threadId = threadId;
+        if (CrashMonitorRunning()) {
+            FillCurrentException(exception);
+            handled = NotifyCrashMonitor(exception, nullptr);
+        }
+    }
+
+    if (ownsReport && !handled) {
+        SafeWriter writer(reportBuffer, sizeof(reportBuffer), handlerOptions.outputFd);
+        WriteReportHeadline(writer, exception);
+        uint64_t firstByteMicros = FlushFirstBytes(writer, startMicros);
+        FillCurrentException(exception);
+        WriteReportDetails(writer, exception);
+
+        uintptr_t frames[kMaxStackFrames];
+        int frameCount = CaptureStack(frames, kMaxStackFrames, 0);
+        FingerprintRecord fingerprint = {};
+        bool repeat = WriteFingerprintAndCheckRepeat(writer, frames, frameCount, fingerprint);
+        FatalStacks stacks = {};
+        if (!repeat) {
+            const ThrowSite* throwSite = LastThrowSite(abi::__cxa_current_exception_type());
+            stacks = WriteFatalStacks(writer, exception, frames, frameCount, nullptr, throwSite);
+        }
+        CrashReportFields fields = { &exception, frames, frameCount, fingerprint.fingerprint, repeat, nullptr, 0 };
+        FinishReport(writer, startMicros, firstByteMicros, exception, fields);
+        if (!repeat) {
+            WriteFatalBinaryReport(exception, stacks, fingerprint);
+        }
+    }
+    if (ownsReport) {
+        reportComplete.store(true);
+    }
+
+    // Call previous handler if it exists, otherwise abort (the SIGABRT is not reported twice)
+    if (handlerOptions.chainPreviousHandlers && previousTerminateHandler) {
+        previousTerminateHandler();
+    }
+    abort();
+}
+
+// Custom new handler for out-of-memory situations. Not fatal, so it can run on several
+// threads at once: the first formats into the new handler buffer, any others at the same
+// time into small stack buffers. Hands the emergency reserve
+// back first, so the report has memory to work with, then asks the registered caches to
+// free memory and lets operator new retry if they did.
+void CustomNewHandler() {
+    uint64_t startMicros = MonotonicMicros();
+    size_t reserveReleased = ReleaseEmergencyReserve();
+    char stackBuffer[kNewHandlerBufferSize];
+    bool ownsBuffer = !newHandlerBufferBusy.exchange(true);
+    SafeWriter writer(ownsBuffer ? newHandlerBuffer : stackBuffer,
+        ownsBuffer ? sizeof(newHandlerBuffer) : sizeof(stackBuffer), handlerOptions.outputFd);
+    ExceptionRecord exception = {};
+    exception.handlerKind = static_cast<uint32_t>(HandlerKind::NewHandler);
+    WriteReportHeadline(writer, exception);
+    uint64_t firstByteMicros = FlushFirstBytes(writer, startMicros);
+
+    exception.threadId = CurrentThreadId();
+    WriteReportDetails(writer, exception);
+    MemoryUsage usage;
+    ReadMemoryUsage(usage);
+    WriteMemoryUsage(writer, FailedAllocationSize(), usage);
+    if (reserveReleased > 0) {
+        writer.Append("Emergency reserve released: ").AppendDec(reserveReleased).Append(" bytes\n");
+    }
+    uintptr_t frames[kMaxStackFrames];
+    int frameCount = CaptureStack(frames, kMaxStackFrames, 0);
+    HeapSiteSummary sites[kReportedHeapSites];
+    int siteCount = TopHeapSites(sites, kReportedHeapSites);
+    {
+        ModuleMapView moduleMap;
+        const SymbolLookup* symbols = handlerOptions.symbolizeNonFatalReports ? &ProcessSymbolCache() : nullptr;
+        ReportModules used;
+        WriteFrames(writer, frames, frameCount, moduleMap, used, symbols);
+        // Who holds the memory, not just who asked last
+        for (int i = 0; i < siteCount; i++) {
+            WriteHeapSiteHeader(writer, i, sites[i]);
+            WriteFrames(writer, sites[i].frames, sites[i].frameCount, moduleMap, used, symbols);
+        }
+        WriteModuleList(writer, used);
+    }
+    size_t cachesReleased = ReleaseRegisteredCaches();
+    if (cachesReleased > 0) {
+        writer.Append("Registered caches released: ").AppendDec(cachesReleased).Append(" bytes, retrying\n");
+    }
+    CrashReportFields fields = { &exception, frames, frameCount, 0, false, nullptr, 0 };
+    FinishReport(writer, startMicros, firstByteMicros, exception, fields);
+    if (ownsBuffer) {
+        newHandlerBufferBusy.store(false);
+    }
+    if (cachesReleased > 0) {
+        return;  // operator new tries again and calls us once more if that fails too
+    }
+
+    // Call previous handler if it exists, otherwise throw std::bad_alloc
+    if (handlerOptions.chainPreviousHandlers && previousNewHandler) {
+        previousNewHandler();
+    }
+    else {
+        throw std::bad_alloc{};
+    }
+}
+
+// Sets up everything the handlers use, in dependency order. On failure the caller undoes
+// what was started with ReleaseComponents().
+bool StartComponents(const CrashHandlerOptions& options) {
+    SetStackUnwinder(options.unwinder);
+    if (!PrepareEmergencyReserve(options.emergencyReserveBytes)) {
+        return false;
+    }
+    PrepareStackCapture();
+    RefreshModuleMap();
+    CrashHandlerRegisterThread();
+    if (options.binaryReportPath && !reportRegion) {
+        pendingReportPath[0] = '\0';
+        CollectPendingReport(options.binaryReportPath);
+        if (!MapReportRegion(options.binaryReportPath, options.binaryReportCapacity)) {
+            return false;
+        }
+    }
+    if (reportRegion && options.compressBinaryReports && !reportCompression) {
+        reportCompression = AllocateCompressionState();
+        if (!reportCompression) {
+            return false;
+        }
+    }
+    if (reportRegion && !PrepareStackMemory(options.stackWindowBytes, options.stackMemoryBudgetBytes)) {
+        return false;
+    }
+    // Frames the terminate paths capture from inside themselves
+    const uintptr_t handlerFunctions[] = {
+        reinterpret_cast<uintptr_t>(&CustomTerminateHandler),
+        reinterpret_cast<uintptr_t>(&NotifyCrashMonitor),
+    };
+    PrepareStackFingerprint(handlerFunctions, sizeof(handlerFunctions) / sizeof(handlerFunctions[0]));
+    if (!StartHeapProfiler(options.heapSampleBytes)) {
+        return false;
+    }
+    if (options.crashIndexPath && !OpenCrashIndex(options.crashIndexPath)) {
+        return false;
+    }
+    bool watchdog = options.hangCheckMillis > 0 || options.dumpRequestSignal != 0;
+    if ((options.captureAllThreads || watchdog) && !PrepareThreadDump(options.threadDumpSignal)) {
+        return false;
+    }
+    if (options.recordThrowSites && !StartThrowSiteRecording()) {
+        return false;
+    }
+    if (!StartFlightRecorder(options.flightRecorderEvents)) {
+        return false;
+    }
+    if (options.profileThrowSites && (!StartThrowProfiler(options.throwStackSampleInterval) ||
+        !StartThrowSiteDump(options.outputFd, options.throwSiteDumpMillis, options.throwSiteDumpCount,
+            options.symbolizeNonFatalReports))) {
+        return false;
+    }
+    if (watchdog && !StartHangDetector(options.outputFd, options.hangCheckMillis, options.dumpRequestSignal,
+        options.hangDumpIntervalMillis, options.allThreadsTimeoutMillis, options.symbolizeNonFatalReports)) {
+        return false;
+    }
+    // Forked before our signal handlers are set, so the helper never inherits them
+    if (options.outOfProcessMonitor &&
+        !StartCrashMonitor(options.outputFd, reportRegion, reportRegionSize, reportCompression)) {
+        return false;
+    }
+    return true;
+}
+
+// Stops and releases what StartComponents() sets up. Each step does nothing for a part that
+// was not started, so this also undoes a partial start.
+void ReleaseComponents() {
+    StopCrashMonitor();
+    StopHangDetector();  // Before the thread dump it uses goes away
+    ReleaseThreadDump();
+    CloseCrashIndex();
+    ReleaseEmergencyReserve();
+    StopHeapProfiler();
+    StopThrowSiteRecording();
+    StopThrowSiteDump();
+    StopThrowProfiler();
+    StopFlightRecorder();
+    if (reportRegion) {
+        munmap(reportRegion, reportRegionSize);
+        reportRegion = nullptr;
+    }
+    ReleaseCompressionState(reportCompression);
+    reportCompression = nullptr;
+    ReleaseStackMemory();
+}
+
+}  // namespace
+
+bool CrashHandlerRegisterThread() {
+    if (threadAltStack) {
+        return true;
+    }
+    void* stack = mmap(nullptr, kAltStackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        return false;
+    }
+    stack_t altStack = {};
+    altStack.ss_sp = stack;
+    altStack.ss_size = kAltStackSize;
+    if (sigaltstack(&altStack, nullptr) != 0) {
+        munmap(stack, kAltStackSize);
+        return false;
+    }
+    threadAltStack = stack;
+    return true;
+}
+
+void CrashHandlerUnregisterThread() {
+    if (!threadAltStack) {
+        return;
+    }
+    stack_t disable = {};
+    disable.ss_flags = SS_DISABLE;
+    sigaltstack(&disable, nullptr);
+    munmap(threadAltStack, kAltStackSize);
+    threadAltStack = nullptr;
+}
+
+bool InstallCrashHandlers(const CrashHandlerOptions& options) {
+    if (handlersInstalled) {
+        return false;
+    }
+    handlerOptions = options;
+    handlerOptions.binaryReportPath = nullptr;  // Not owned, and not needed once the file is mapped
+    handlerOptions.crashIndexPath = nullptr;
+    reportingThread.store(0);
+    reportComplete.store(false);
+
+    if (!StartComponents(options)) {
+        ReleaseComponents();
+        return false;
+    }
+
+    for (int i = 0; i < kFatalSignalCount; i++) {
+        struct sigaction action = {};
+        action.sa_sigaction = CustomSignalHandler;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(kFatalSignals[i], &action, &previousSignalActions[i]) != 0) {
+            for (int j = 0; j < i; j++) {
+                sigaction(kFatalSignals[j], &previousSignalActions[j], nullptr);
+            }
+            ReleaseComponents();
+            return false;
+        }
+    }
+
+    previousTerminateHandler = std::set_terminate(CustomTerminateHandler);
+    previousNewHandler = std::set_new_handler(CustomNewHandler);
+    handlersInstalled = true;
+    return true;
+}
+
+void UninstallCrashHandlers() {
+    if (!handlersInstalled) {
+        return;
+    }
+    for (int i = 0; i < kFatalSignalCount; i++) {
+        sigaction(kFatalSignals[i], &previousSignalActions[i], nullptr);
+    }
+    std::set_terminate(previousTerminateHandler);
+    std::set_new_handler(previousNewHandler);
+    ReleaseComponents();
+    handlersInstalled = false;
+}
+
+const char* CrashHandlerPendingReport() {
+    return pendingReportPath[0] != '\0' ? pendingReportPath : nullptr;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "crash_report_format.h"
+#include "memory_reserve.h"
+#include "stack_capture.h"
+
+#include <cstddef>
+#include <unistd.h>
+
+// Linux counterpart of the handler set registered in crash_handler_windows.cpp:
+// a terminate handler, a new handler and sigaction-based fatal signal handlers
+// (the equivalent of the unhandled exception filter).
+//
+// Everything a handler needs is allocated by InstallCrashHandlers(). While a report is
+// produced the handlers only touch preallocated buffers and emit text with raw write(2),
+// so a crashing thread never waits on heap or iostream locks held by other threads.
+
+// The fields of one report, as handed to CrashHandlerOptions::reportCallback
+struct CrashReportFields {
+    const ExceptionRecord* exception;  // Handler kind, signal and code, fault address, exception type and message, thread
+    const uintptr_t* frames;           // Stack of the reporting thread
+    int frameCount;
+    uint64_t fingerprint;  // 0 for new handler reports
+    bool repeat;           // Already in the crash index, so the text is the short form
+    const char* text;      // The report as written, or nullptr if it did not fit the report buffer
+    size_t textLength;
+};
+
+// Runs in the handler after the report was written; for fatal reports that is a signal
+// handler or std::terminate, so it must be async-signal-safe and must not return to the caller
+// by longjmp or throw.
+using CrashReportCallback = void (*)(const CrashReportFields& report, void* context);
+
+struct CrashHandlerOptions {
+    int outputFd = STDERR_FILENO;    // Where reports are written
+    bool chainPreviousHandlers = true;  // Hand control to the handlers that were installed before us
+    bool symbolizeNonFatalReports = true;  // Resolve symbols in-process for reports that do not end the process
+    // Fatal reports are also written here in the binary format of crash_report_format.h
+    // (read back with crash_report_reader.h or crash_symbolizer). nullptr to disable.
+    // The file is created, sized and mapped by InstallCrashHandlers(); a crashing thread
+    // writes straight into the mapping, and the kernel keeps what was written even if the
+    // process is killed halfway through.
+    const char* binaryReportPath = nullptr;
+    size_t binaryReportCapacity = 256 * 1024;  // Reports that do not fit are cut at the last whole section
+    // Compress the sections of binary reports while they are written (see report_compression.h).
+    // All-thread reports shrink several times over for a pass over their bytes; the reader
+    // and crash_symbolizer decompress transparently.
+    bool compressBinaryReports = false;
+    // Copy up to this much of every captured thread's stack, from just below its stack pointer
+    // upwards, into binary reports (see stack_memory.h), so frames can be unwound and locals
+    // inspected offline. 0 disables. The copies of one report share stackMemoryBudgetBytes,
+    // the crashing thread taking a larger share; keep it well below binaryReportCapacity.
+    size_t stackWindowBytes = 0;
+    size_t stackMemoryBudgetBytes = 128 * 1024;
+    // Produce fatal reports from a helper process forked at install time (see crash_monitor.h).
+    // The crashing thread only notifies it; if the helper does not answer, it reports itself.
+    bool outOfProcessMonitor = false;
+    // Add the stacks of all other threads to fatal in-process reports (see thread_dump.h).
+    // Each thread unwinds itself on threadDumpSignal (0 picks SIGRTMIN + 4); threads that do
+    // not answer within allThreadsTimeoutMillis are listed without frames.
+    bool captureAllThreads = false;
+    int allThreadsTimeoutMillis = 250;
+    int threadDumpSignal = 0;
+    // Counts fatal crashes by stack fingerprint in this file (see crash_index.h), which may be
+    // shared by several processes and kept across runs. A crash already in the index gets a
+    // short report with its fingerprint and count instead of a full one. nullptr to disable.
+    const char* crashIndexPath = nullptr;
+    // How handlers walk stacks (see unwinder.h). Auto uses frame pointers in modules built
+    // with them and the .eh_frame unwind tables everywhere else.
+    UnwinderKind unwinder = UnwinderKind::Auto;
+    // Heap held back for the new handler and released on the first failed allocation (see
+    // memory_reserve.h, which also has the cache release hook). 0 to disable.
+    size_t emergencyReserveBytes = 1024 * 1024;
+    // Samples operator new on average once per this many bytes and lists the allocation
+    // sites holding the most live memory in new handler reports (see heap_profiler.h).
+    // A few hundred KB keeps the overhead low; 0 disables.
+    size_t heapSampleBytes = 0;
+    // Record where each exception is thrown (see throw_site.h), so terminate reports show the
+    // stack of the throw as well as the one std::terminate ran on, which may have been unwound
+    // by then. Costs a short frame pointer walk per throw. In-process reports only.
+    bool recordThrowSites = false;
+    // Count throws per throw site and exception type (see throw_profiler.h), to find paths that
+    // throw and catch at a high rate. One in throwStackSampleInterval throws also samples its
+    // stack (0: none). With throwSiteDumpMillis the throwSiteDumpCount busiest sites of each
+    // interval are written to outputFd; SnapshotThrowSites() ranks them on demand.
+    bool profileThrowSites = false;
+    uint32_t throwStackSampleInterval = 1024;
+    int throwSiteDumpMillis = 0;
+    int throwSiteDumpCount = 5;
+    // Keep the last flightRecorderEvents events of each thread recorded with RecordFlightEvent()
+    // (see flight_recorder.h) and list the last flightRecorderDumpEvents of every thread in
+    // fatal reports, the crashing thread's first. 0 records nothing. In-process reports only.
+    size_t flightRecorderEvents = 0;
+    int flightRecorderDumpEvents = 16;
+    // Start a watchdog thread (see hang_detector.h) that checks every hangCheckMillis whether
+    // the threads watched with WatchCurrentThread() still send heartbeats, and writes the
+    // stacks of stalled ones to outputFd while the process keeps running. dumpRequestSignal
+    // (SIGUSR2, say) dumps every thread on demand. Dumps are at least hangDumpIntervalMillis
+    // apart; stalls and requests in between are counted. Threads get allThreadsTimeoutMillis
+    // to answer. 0 disables each.
+    int hangCheckMillis = 0;
+    int dumpRequestSignal = 0;
+    int hangDumpIntervalMillis = 10000;
+    // Assemble each report in its preallocated buffer and emit it with a single write(2), so
+    // reports of concurrent handlers and other output never interleave with it. Reports that
+    // outgrow the buffer (64 KB for fatal reports) are written in pieces. false flushes the
+    // headline as soon as it is formatted, for the earliest possible first byte.
+    bool singleWriteReports = true;
+    // Called with the fields of every report produced in-process (not those the crash monitor
+    // writes), so a log pipeline gets one structured record per crash. nullptr to disable.
+    CrashReportCallback reportCallback = nullptr;
+    void* reportCallbackContext = nullptr;
+};
+
+// Registers all handlers and sets up an alternate signal stack for the calling thread.
+// Returns false if the handlers are already installed or a signal handler could not be set.
+bool InstallCrashHandlers(const CrashHandlerOptions& options = CrashHandlerOptions());
+
+// Restores the handlers that were active before InstallCrashHandlers().
+void UninstallCrashHandlers();
+
+// A report left in binaryReportPath by an earlier run (finished or not) is moved aside
+// before the file is reused. Returns where it was moved, or nullptr if there was none.
+const char* CrashHandlerPendingReport();
+
+// Gives the calling thread its own alternate signal stack, so a stack overflow can still
+// be reported. Call once at the start of every thread created after installation.
+bool CrashHandlerRegisterThread();
+
+// Releases the calling thread's alternate signal stack.
+void CrashHandlerUnregisterThread();
@@ -0,0 +1,364 @@
+#include "crash_handler.h"
+#include "flight_recorder.h"
+#include "hang_detector.h"
+#include "module_map.h"
+#include "report_text.h"
+#include "throw_profiler.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <csignal>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+// Forward declarations
+void TriggerPureCallHandler();
+void TriggerTerminateHandler();
+void TriggerDirectTerminate();
+void TriggerSegmentationFault();
+void TriggerNewHandler();
+void TriggerThirdPartyCrash();
+void TriggerHangDetector();
+void TriggerThrowStorm();
+
+// Flight recorder event ids of the demo
+enum DemoEvent : uint32_t {
+    kEventChoice = 1,   // The menu choice
+    kEventWorkerTick,   // An idle worker woke up: worker index, tick count
+    kEventTrigger,      // Text: what is about to be triggered
+};
+
+// Idle threads that show up in reports when all threads are captured
+void StartIdleWorkers(int count) {
+    for (int i = 0; i < count; i++) {
+        std::thread([i] {
+            CrashHandlerRegisterThread();
+            for (int64_t tick = 0;; tick++) {
+                RecordFlightEvent(kEventWorkerTick, i, tick);
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        }).detach();
+    }
+}
+
+// Report callback that prints each report as one JSON record on stdout, the way a log
+// pipeline would take it. Runs inside the handlers, so it sticks to SafeWriter.
+void PrintReportRecord(const CrashReportFields& report, void*) {
+    char buffer[4096];
+    SafeWriter writer(buffer, sizeof(buffer), STDOUT_FILENO);
+    writer.Append("Report record: ");
+    ModuleMapView modules;
+    WriteReportJson(writer, *report.exception, report.fingerprint, report.frames, report.frameCount, modules);
+    writer.Flush();
+}
+
+// Keeps the blocks allocated by TriggerNewHandler observable so the optimizer cannot drop them
+int* volatile lastAllocatedBlock = nullptr;
+
+// Stands in for a cache the program could rebuild; the new handler frees it before giving up
+constexpr size_t kDemoCacheSize = 256 * 1024 * 1024;
+char* demoCache = nullptr;
+
+size_t ReleaseDemoCache(void*) {
+    if (!demoCache) {
+        return 0;
+    }
+    delete[] demoCache;
+    demoCache = nullptr;
+    return kDemoCacheSize;
+}
+
+// Classes to demonstrate pure virtual function call. On Linux the runtime reports the
+// pure call through __cxa_pure_virtual, which ends in std::terminate.
+class AbstractBase {
+public:
+    AbstractBase() {
+        std::cout << "AbstractBase constructor" << std::endl;
+        CallPureVirtual();
+    }
+    virtual ~AbstractBase() = default;
+    virtual void PureVirtualFunction() = 0;
+
+    void CallPureVirtual() {
+        PureVirtualFunction();
+    }
+};
+
+class ProblematicClass : public AbstractBase {
+public:
+    void PureVirtualFunction() override {
+        std::cout << "ProblematicClass::PureVirtualFunction called" << std::endl;
+    }
+};
+
+// Function to trigger pure call handler
+void TriggerPureCallHandler() {
+    std::cout << "Triggering pure call handler..." << std::endl;
+    ProblematicClass* obj = new ProblematicClass();
+    delete obj;
+}
+
+// Function to trigger terminate handler via exception
+void TriggerTerminateHandler() {
+    std::cout << "Triggering terminate handler..." << std::endl;
+    throw std::runtime_error("Unhandled exception to trigger terminate handler");
+}
+
+// Function to trigger terminate handler directly
+void TriggerDirectTerminate() {
+    std::cout << "Triggering terminate handler directly via std::terminate()..." << std::endl;
+    std::terminate();
+}
+
+// Function to trigger the fatal signal handler. Linux has no invalid parameter handler,
+// so this takes its menu slot with the null write SomeThirdParty's CrashFunction does.
+void TriggerSegmentationFault() {
+    std::cout << "Triggering fatal signal handler (null pointer write)..." << std::endl;
+    RecordFlightText(kEventTrigger, "null pointer write");
+    volatile int* ptr = nullptr;
+    *ptr = 42;
+}
+
+// Function to trigger new handler (out-of-memory)
+void TriggerNewHandler() {
+    std::cout << "Triggering new handler (out-of-memory)..." << std::endl;
+
+    // Overcommit would let the loop below run for a long time; cap the address space instead
+    rlimit previousLimit;
+    getrlimit(RLIMIT_AS, &previousLimit);
+    rlimit limit = previousLimit;
+    limit.rlim_cur = 4ull * 1024 * 1024 * 1024;  // 4 GB
+    setrlimit(RLIMIT_AS, &limit);
+
+    demoCache = new char[kDemoCacheSize];
+    RegisterCacheReleaser(ReleaseDemoCache, nullptr);
+    try {
+        while (true) {
+            lastAllocatedBlock = new int[100000000];  // Attempt to allocate ~400 MB each time
+        }
+    }
+    catch (const std::bad_alloc& e) {
+        std::cout << "Caught std::bad_alloc: " << e.what() << std::endl;
+    }
+    catch (...) {
+        std::cout << "Unexpected exception caught while triggering new handler" << std::endl;
+    }
+    UnregisterCacheReleaser(ReleaseDemoCache, nullptr);
+    setrlimit(RLIMIT_AS, &previousLimit);
+    std::cout << "New handler trigger attempt completed" << std::endl;
+}
+
+// Function to crash inside a library loaded at run time, like the Windows demo's
+// LoadLibraryA("SomeThirdParty.dll") + CrashFunction(). The library is looked up next to
+// the executable (build it from ../SomeThirdParty).
+void TriggerThirdPartyCrash() {
+    std::cout << "Loading libSomeThirdParty.so..." << std::endl;
+    char executable[4096];
+    ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    std::string path = "libSomeThirdParty.so";
+    if (length > 0) {
+        std::string directory(executable, static_cast<size_t>(length));
+        path = directory.substr(0, directory.rfind('/') + 1) + path;
+    }
+    void* thirdPartyLibrary = dlopen(path.c_str(), RTLD_NOW);
+    if (!thirdPartyLibrary) {
+        std::cerr << "Failed to load " << path << ": " << dlerror() << std::endl;
+        return;
+    }
+
+    using ThirdPartyFunc = void (*)();
+    ThirdPartyFunc crashFunc = reinterpret_cast<ThirdPartyFunc>(dlsym(thirdPartyLibrary, "CrashFunction"));
+    if (crashFunc) {
+        std::cout << "Triggering third-party crash function..." << std::endl;
+        crashFunc();  // This should cause an intentional crash
+    }
+    else {
+        std::cerr << "Failed to get CrashFunction address: " << dlerror() << std::endl;
+    }
+}
+
+// Function to stall a watched thread on a lock main holds, so the hang detector dumps it,
+// then ask for a dump of every thread twice: the first request comes too soon after the
+// stall dump and is skipped by the rate limit, the second is served
+void TriggerHangDetector() {
+    std::cout << "Triggering hang detector (worker blocked on a lock)..." << std::endl;
+    static std::mutex lock;
+    lock.lock();
+    std::thread([] {
+        WatchCurrentThread("demo-worker", 200);
+        Heartbeat();
+        std::lock_guard<std::mutex> guard(lock);  // Never acquired
+    }).detach();
+    // Requests come the way kill -USR2 sends them, to the process; this thread blocks the
+    // signal, so it is dumped here and not while it runs the request handler
+    sigset_t request;
+    sigemptyset(&request);
+    sigaddset(&request, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &request, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    kill(getpid(), SIGUSR2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+    kill(getpid(), SIGUSR2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    UninstallCrashHandlers();  // Waits for a dump in progress
+    std::cout << "Hang detector trigger completed" << std::endl;
+}
+
+// Function to throw and catch from three sites at 9:3:1 for a while, so the throw-site
+// dump ranks them in that order, then rank the whole storm with an on-demand snapshot,
+// which counts from its own baseline and leaves the dump's intervals alone
+void TriggerThrowStorm() {
+    std::cout << "Triggering exception storm (three throw sites at 9:3:1)..." << std::endl;
+    ThrowSiteSummary sites[3];
+    SnapshotThrowSites(sites, 0);  // The on-demand interval starts now
+    uint64_t caught = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(700);
+    while (std::chrono::steady_clock::now() < end) {
+        for (int i = 0; i < 13; i++) {
+            try {
+                if (i < 9) {
+                    throw std::out_of_range("storm");
+                }
+                if (i < 12) {
+                    throw std::invalid_argument("storm");
+                }
+                throw std::length_error("storm");
+            }
+            catch (const std::logic_error&) {
+                caught++;
+            }
+        }
+    }
+    int count = SnapshotThrowSites(sites, 3);
+    for (int i = 0; i < count; i++) {
+        std::cout << "Throw site " << i << " over the storm: " << sites[i].recentThrows << " throws of "
+                  << sites[i].type->name() << std::endl;
+    }
+    UninstallCrashHandlers();  // Stops the dump thread
+    std::cout << "Exception storm completed, " << caught << " exceptions caught" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // Check if command line argument was provided
+    int choice = 0;
+    if (argc > 1) {
+        choice = std::atoi(argv[1]);
+    }
+
+    // Register all exception handlers
+    std::cout << "Registering exception handlers..." << std::endl;
+    CrashHandlerOptions options;
+    options.heapSampleBytes = 512 * 1024;  // Lets new handler reports name the allocation sites
+    options.recordThrowSites = true;       // Lets terminate reports show where the exception was thrown
+    options.flightRecorderEvents = 256;    // Lets fatal reports list what each thread did last
+    options.hangCheckMillis = 100;         // Dumps watched threads that stop sending heartbeats
+    options.dumpRequestSignal = SIGUSR2;   // kill -USR2 dumps every thread
+    options.hangDumpIntervalMillis = 1000;
+    options.profileThrowSites = true;      // Counts throws per site
+    options.throwStackSampleInterval = 64;
+    if (choice == 8) {
+        // Only for the storm picked on the command line, so no dump can land in a crash report
+        options.throwSiteDumpMillis = 250;
+        options.throwSiteDumpCount = 3;
+    }
+    if (argc > 2 && std::string(argv[2]) != "-") {
+        options.binaryReportPath = argv[2];  // Optional binary copy of fatal reports
+    }
+    if (argc > 3) {
+        options.outOfProcessMonitor = std::string(argv[3]) == "monitor";
+        options.captureAllThreads = std::string(argv[3]) == "threads";
+    }
+    if (argc > 4 && std::string(argv[4]) != "-") {
+        options.crashIndexPath = argv[4];  // Repeated crashes get a one-line report
+    }
+    if (argc > 5) {
+        const std::string unwinder = argv[5];
+        for (UnwinderKind kind : { UnwinderKind::FramePointer, UnwinderKind::Dwarf, UnwinderKind::Backtrace }) {
+            if (unwinder == UnwinderName(kind)) {
+                options.unwinder = kind;
+            }
+        }
+    }
+    if (argc > 6 && std::string(argv[6]) == "json") {
+        options.reportCallback = PrintReportRecord;
+    }
+    if (argc > 7) {
+        // Binary report extras, comma-separated
+        const std::string extras = argv[7];
+        options.compressBinaryReports = extras.find("compress") != std::string::npos;
+        if (extras.find("stack") != std::string::npos) {
+            options.stackWindowBytes = 64 * 1024;
+        }
+    }
+    if (!InstallCrashHandlers(options)) {
+        std::cout << "Failed to register exception handlers" << std::endl;
+        return 1;
+    }
+    std::cout << "All exception handlers have been registered successfully!" << std::endl;
+    if (const char* pendingReport = CrashHandlerPendingReport()) {
+        std::cout << "Report from a previous run collected: " << pendingReport << std::endl;
+    }
+    if (options.captureAllThreads) {
+        StartIdleWorkers(3);
+    }
+    std::cout << "==========================================" << std::endl;
+
+    // If no valid command line argument, show menu
+    if (choice < 1 || choice > 8) {
+        std::cout << "Select the type of exception to trigger:" << std::endl;
+        std::cout << "1: Pure call handler" << std::endl;
+        std::cout << "2: Terminate handler (via exception)" << std::endl;
+        std::cout << "3: Terminate handler (direct)" << std::endl;
+        std::cout << "4: Fatal signal handler (segmentation fault)" << std::endl;
+        std::cout << "5: New handler (out-of-memory)" << std::endl;
+        std::cout << "6: Fatal signal handler (crash in a dlopen'ed library)" << std::endl;
+        std::cout << "7: Hang detector (stalled thread, no crash)" << std::endl;
+        std::cout << "8: Exception storm (throw-site ranking, no crash)" << std::endl;
+        std::cout << "Enter your choice (1, 2, 3, 4, 5, 6, 7, or 8): ";
+        std::cin >> choice;
+    }
+
+    std::cout << "==========================================" << std::endl;
+    RecordFlightEvent(kEventChoice, choice);
+
+    switch (choice) {
+    case 1:
+        TriggerPureCallHandler();
+        break;
+    case 2:
+        TriggerTerminateHandler();
+        break;
+    case 3:
+        TriggerDirectTerminate();
+        break;
+    case 4:
+        TriggerSegmentationFault();
+        break;
+    case 5:
+        TriggerNewHandler();
+        break;
+    case 6:
+        TriggerThirdPartyCrash();
+        break;
+    case 7:
+        TriggerHangDetector();
+        break;
+    case 8:
+        TriggerThrowStorm();
+        break;
+    default:
+        std::cout << "Invalid choice. Exiting..." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Program completed normally" << std::endl;
+    return 0;
+}
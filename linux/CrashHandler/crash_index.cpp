@@ -0,0 +1,122 @@
+#include "crash_index.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kCrashIndexSize = sizeof(CrashIndexHeader) + sizeof(CrashIndexEntry) * kCrashIndexCapacity;
+
+CrashIndexHeader* indexHeader = nullptr;
+CrashIndexEntry* indexEntries = nullptr;
+
+uint64_t RealtimeNanos() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+}
+
+bool ValidHeader(const CrashIndexHeader& header) {
+    return header.magic == kCrashIndexMagic && header.version == kCrashIndexVersion &&
+        header.headerSize == sizeof(CrashIndexHeader) && header.capacity == kCrashIndexCapacity;
+}
+
+// A file created by a process that died between posix_fallocate() and the header stores
+bool EmptyHeader(const CrashIndexHeader& header) {
+    return header.magic == 0 && header.version == 0 && header.headerSize == 0 && header.capacity == 0;
+}
+
+// Zero is the free-entry marker, so it cannot be a key
+uint64_t IndexKey(uint64_t fingerprint) {
+    return fingerprint != 0 ? fingerprint : 1;
+}
+
+}  // namespace
+
+bool OpenCrashIndex(const char* path) {
+    if (indexHeader) {
+        return true;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // Serializes creation with other processes opening the same index
+    flock(fd, LOCK_EX);
+    struct stat status;
+    bool ok = fstat(fd, &status) == 0;
+    bool created = ok && status.st_size == 0;
+    if (created) {
+        ok = posix_fallocate(fd, 0, static_cast<off_t>(kCrashIndexSize)) == 0;
+    }
+    else if (ok) {
+        ok = status.st_size == static_cast<off_t>(kCrashIndexSize);
+    }
+    void* mapping = MAP_FAILED;
+    if (ok) {
+        mapping = mmap(nullptr, kCrashIndexSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapping != MAP_FAILED) {
+        CrashIndexHeader* header = static_cast<CrashIndexHeader*>(mapping);
+        // No entry can have been written before the header, so an empty one is finished here
+        if (created || EmptyHeader(*header)) {
+            header->magic = kCrashIndexMagic;
+            header->version = kCrashIndexVersion;
+            header->headerSize = sizeof(CrashIndexHeader);
+            header->capacity = kCrashIndexCapacity;
+        }
+        if (ValidHeader(*header)) {
+            indexHeader = header;
+            indexEntries = reinterpret_cast<CrashIndexEntry*>(header + 1);
+        }
+        else {
+            munmap(mapping, kCrashIndexSize);
+        }
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    return indexHeader != nullptr;
+}
+
+void CloseCrashIndex() {
+    if (!indexHeader) {
+        return;
+    }
+    munmap(indexHeader, kCrashIndexSize);
+    indexHeader = nullptr;
+    indexEntries = nullptr;
+}
+
+bool RecordCrash(FingerprintRecord& record) {
+    record.previousCount = 0;
+    if (!indexEntries) {
+        return false;
+    }
+    uint64_t key = IndexKey(record.fingerprint);
+    uint64_t now = RealtimeNanos();
+    // Linear probing; entries are claimed with a CAS and never freed, so a key never moves
+    for (uint32_t probe = 0; probe < kCrashIndexCapacity; probe++) {
+        CrashIndexEntry& entry = indexEntries[(key + probe) % kCrashIndexCapacity];
+        uint64_t current = __atomic_load_n(&entry.fingerprint, __ATOMIC_ACQUIRE);
+        if (current == 0) {
+            uint64_t expected = 0;
+            if (__atomic_compare_exchange_n(&entry.fingerprint, &expected, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                entry.firstSeenNs = now;
+                current = key;
+            }
+            else {
+                current = expected;
+            }
+        }
+        if (current == key) {
+            record.previousCount = __atomic_fetch_add(&entry.count, 1, __ATOMIC_ACQ_REL);
+            __atomic_store_n(&entry.lastSeenNs, now, __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+    return false;
+}
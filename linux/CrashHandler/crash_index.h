@@ -0,0 +1,45 @@
+#pragma once
+
+#include "crash_report_format.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk crash dedup index: how many times each crash fingerprint has been seen, across
+// runs and across processes sharing the file.
+//
+// The file is a small fixed-size open-addressing hash table keyed by fingerprint. It is
+// created or opened and mapped shared by OpenCrashIndex() at install time; a handler then
+// claims or bumps an entry with atomic operations on the mapping, with no I/O of its own.
+// A process stuck in a crash loop thus writes one full report per distinct crash and only
+// increments a counter for every repeat.
+
+constexpr uint32_t kCrashIndexMagic = 0x58444943;  // "CIDX"
+constexpr uint16_t kCrashIndexVersion = 1;
+constexpr uint32_t kCrashIndexCapacity = 1024;
+
+struct CrashIndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t capacity;  // Number of entries that follow the header
+    uint32_t reserved;
+};
+
+struct CrashIndexEntry {
+    uint64_t fingerprint;  // 0 while the entry is free
+    uint64_t count;
+    uint64_t firstSeenNs;  // CLOCK_REALTIME
+    uint64_t lastSeenNs;
+};
+
+// Opens the index at path, creating it if needed (also when an earlier creation was cut off
+// before the header was written). Not async-signal-safe.
+bool OpenCrashIndex(const char* path);
+
+void CloseCrashIndex();
+
+// Counts one crash with record.fingerprint and sets record.previousCount to the number seen
+// before it. Returns false (previousCount 0) if no index is open or it is full.
+// Async-signal-safe.
+bool RecordCrash(FingerprintRecord& record);
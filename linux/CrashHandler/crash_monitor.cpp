@@ -0,0 +1,453 @@
+#include "crash_monitor.h"
+
+#include "crash_fingerprint.h"
+#include "crash_index.h"
+#include "crash_report_writer.h"
+#include "dwarf_unwinder.h"
+#include "elf_symbols.h"
+#include "module_map.h"
+#include "report_text.h"
+#include "safe_writer.h"
+#include "stack_capture.h"
+#include "stack_memory.h"
+#include "symbol_cache.h"
+#include "unwinder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <elf.h>
+#include <fstream>
+#include <link.h>
+#include <map>
+#include <poll.h>
+#include <signal.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr int kReplyTimeoutMillis = 10 * 1000;
+constexpr size_t kMonitorBufferSize = 16 * 1024;
+constexpr char kCrashMessage = 'C';
+constexpr char kDoneMessage = 'D';
+
+// Lives in memory shared with the helper; written by the crashing thread only
+struct MonitorRequest {
+    ExceptionRecord exception;
+    uint64_t notifyMicros;  // CLOCK_MONOTONIC is system-wide, so the helper can measure from it
+    ucontext_t context;
+    // Set by the crashing process once it gave up waiting; the helper then writes nothing more
+    std::atomic<bool> abandoned;
+};
+
+MonitorRequest* sharedRequest = nullptr;
+int monitorSocket = -1;
+pid_t monitorPid = 0;
+pid_t monitoredPid = 0;  // A forked child inherits the socket but must not use the helper
+
+uint64_t MonotonicMicros() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + static_cast<uint64_t>(now.tv_nsec) / 1000;
+}
+
+bool Abandoned() {
+    return sharedRequest->abandoned.load(std::memory_order_acquire);
+}
+
+// Modules of another process from /proc/<pid>/maps. The files are read from disk for their
+// build-id and load layout; their symbol tables are kept for symbolization.
+std::vector<ModuleInfo> ReadRemoteModules(pid_t pid, std::map<std::string, ElfSymbolTable>& tables) {
+    struct Mapping {
+        uint64_t start = UINT64_MAX;
+        uint64_t end = 0;
+        uint64_t fileStart = 0;  // Runtime address of file offset 0
+        bool hasFileStart = false;
+    };
+    std::map<std::string, Mapping> files;
+
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+    for (std::string line; std::getline(maps, line);) {
+        uint64_t start = 0;
+        uint64_t end = 0;
+        uint64_t offset = 0;
+        int pathOffset = 0;
+        if (sscanf(line.c_str(), "%" SCNx64 "-%" SCNx64 " %*s %" SCNx64 " %*s %*s %n",
+            &start, &end, &offset, &pathOffset) != 3 || pathOffset == 0) {
+            continue;
+        }
+        std::string path = line.substr(pathOffset);
+        if (path.empty() || path[0] != '/') {
+            continue;  // Anonymous memory, [stack], [vdso], ...
+        }
+        const std::string deleted = " (deleted)";
+        if (path.size() > deleted.size() && path.compare(path.size() - deleted.size(), deleted.size(), deleted) == 0) {
+            path.resize(path.size() - deleted.size());
+        }
+        Mapping& mapping = files[path];
+        mapping.start = std::min(mapping.start, start);
+        mapping.end = std::max(mapping.end, end);
+        if (offset == 0 && !mapping.hasFileStart) {
+            mapping.fileStart = start;
+            mapping.hasFileStart = true;
+        }
+    }
+
+    std::vector<ModuleInfo> modules;
+    for (const auto& file : files) {
+        ElfSymbolTable& table = tables[file.first];
+        if (!file.second.hasFileStart || !table.Load(file.first)) {
+            continue;  // Not an ELF object, e.g. a mapped data file
+        }
+        ModuleInfo module;
+        memset(&module, 0, sizeof(module));
+        module.loadBias = static_cast<uintptr_t>(file.second.fileStart - table.FileStartAddress());
+        module.start = static_cast<uintptr_t>(file.second.start);
+        module.end = static_cast<uintptr_t>(file.second.end);
+        if (table.BuildId().size() <= kMaxBuildIdSize) {
+            module.buildIdSize = static_cast<uint32_t>(table.BuildId().size());
+            memcpy(module.buildId, table.BuildId().data(), module.buildIdSize);
+        }
+        CopyReportString(module.path, sizeof(module.path), file.first.c_str());
+        modules.push_back(module);
+    }
+    return modules;
+}
+
+bool SameModule(const ModuleInfo& a, const ModuleInfo& b) {
+    if (a.start != b.start || a.buildIdSize != b.buildIdSize) {
+        return false;
+    }
+    return a.buildIdSize != 0 ? memcmp(a.buildId, b.buildId, a.buildIdSize) == 0 : strcmp(a.path, b.path) == 0;
+}
+
+// Copies the readable mappings of a module of the monitored process to the same addresses
+// in the helper and finds its .eh_frame_hdr there. False if the range is taken here or the
+// module has no unwind table.
+bool MirrorRemoteModule(pid_t pid, ModuleInfo& module) {
+    size_t size = module.end - module.start;
+    void* wanted = reinterpret_cast<void*>(module.start);
+    void* memory = mmap(wanted, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    if (memory != wanted) {  // Kernels before 4.17 take the address as a hint only
+        munmap(memory, size);
+        return false;
+    }
+
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+    for (std::string line; std::getline(maps, line);) {
+        uint64_t start = 0;
+        uint64_t end = 0;
+        char permissions[5];
+        if (sscanf(line.c_str(), "%" SCNx64 "-%" SCNx64 " %4s", &start, &end, permissions) != 3 ||
+            start < module.start || end > module.end || permissions[0] != 'r') {
+            continue;
+        }
+        iovec local = { reinterpret_cast<void*>(start), static_cast<size_t>(end - start) };
+        iovec remote = local;
+        process_vm_readv(pid, &local, 1, &remote, 1, 0);  // Pages that fail stay zero
+    }
+
+    module.ehFrameHdr = 0;
+    const ElfW(Ehdr)* header = static_cast<const ElfW(Ehdr)*>(memory);
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) == 0 &&
+        header->e_phoff + static_cast<size_t>(header->e_phnum) * sizeof(ElfW(Phdr)) <= size) {
+        const ElfW(Phdr)* headers = reinterpret_cast<const ElfW(Phdr)*>(static_cast<const char*>(memory) + header->e_phoff);
+        for (int i = 0; i < header->e_phnum; i++) {
+            uintptr_t address = module.loadBias + headers[i].p_vaddr;
+            if (headers[i].p_type == PT_GNU_EH_FRAME && address >= module.start && address < module.end) {
+                module.ehFrameHdr = address;
+            }
+        }
+    }
+    if (module.ehFrameHdr == 0) {
+        munmap(memory, size);
+        return false;
+    }
+    module.framePointers = ModuleUsesFramePointers(module);
+    return true;
+}
+
+// Where the walkers find the unwind tables of the monitored process's modules. Modules loaded
+// before the fork are at the same addresses in the helper, so its own module map describes
+// them. Modules loaded since are copied to the same addresses here, where that range is free,
+// so the DWARF walker reads their .eh_frame in place; the rest get the frame pointer walk.
+std::vector<ModuleInfo> UnwindModules(pid_t pid, const StaticModuleMap& remoteModules) {
+    std::vector<ModuleInfo> modules;
+    ModuleMapView ownModules;
+    bool changed = false;
+    for (const ModuleInfo& remote : remoteModules.Modules()) {
+        const ModuleInfo* own = ownModules.Find(remote.start);
+        if (own && SameModule(*own, remote)) {
+            modules.push_back(*own);
+            continue;
+        }
+        changed = true;
+        ModuleInfo copied = remote;
+        if (!own && MirrorRemoteModule(pid, copied)) {
+            modules.push_back(copied);
+        }
+    }
+    if (changed) {
+        InvalidateDwarfUnwindCache();  // Rows cached before the fork may be of a module unloaded since
+    }
+    return modules;
+}
+
+// Walks the stack of a thread in another process with the handler's unwinder (auto when it
+// is backtrace(), which only walks the calling thread)
+int UnwindRemote(pid_t pid, const RegisterRecord& registers, const ModuleLookup& modules, uintptr_t* frames,
+    int maxFrames) {
+    UnwindState state;
+    if (!UnwindStateFromRegisters(registers, state)) {
+        return 0;
+    }
+    RemoteUnwindMemory memory(pid);
+    const Unwinder* unwinder = GetUnwinder(StackUnwinder());
+    return UnwindStack(unwinder ? *unwinder : *GetUnwinder(UnwinderKind::Auto), state, memory, modules, frames,
+        maxFrames);
+}
+
+// Symbols of the monitored process, read from its module files by the helper
+class RemoteSymbols final : public SymbolLookup {
+public:
+    RemoteSymbols(const StaticModuleMap& modules, const std::map<std::string, ElfSymbolTable>& tables)
+        : modules_(modules), tables_(tables) {}
+
+    bool Resolve(uintptr_t address, ResolvedSymbol& symbol) const override {
+        const ModuleInfo* module = modules_.Find(address);
+        if (!module) {
+            return false;
+        }
+        auto table = tables_.find(module->path);
+        if (table == tables_.end()) {
+            return false;
+        }
+        const ElfSymbol* found = table->second.Find(address - module->loadBias);
+        if (!found) {
+            return false;
+        }
+        names_.push_back(DemangleSymbol(found->name));
+        symbol.name = names_.back().c_str();
+        symbol.address = module->loadBias + static_cast<uintptr_t>(found->address);
+        return true;
+    }
+
+private:
+    const StaticModuleMap& modules_;
+    const std::map<std::string, ElfSymbolTable>& tables_;
+    mutable std::deque<std::string> names_;  // Keeps returned names alive
+};
+
+// Runs in the helper: produces the report for the crash described in the shared block
+void ReportCrash(pid_t pid, int outputFd, void* reportRegion, size_t reportRegionSize,
+    CompressionState* compression) {
+    ExceptionRecord exception = sharedRequest->exception;
+    char buffer[kMonitorBufferSize];
+    SafeWriter writer(buffer, sizeof(buffer), outputFd);
+    if (Abandoned()) {
+        return;
+    }
+    WriteReportHeadline(writer, exception);
+    writer.Flush();
+    exception.timeToFirstByteMicros = static_cast<uint32_t>(MonotonicMicros() - sharedRequest->notifyMicros);
+
+    WriteReportDetails(writer, exception);
+    RegisterRecord registers;
+    FillRegisterRecord(&sharedRequest->context, exception.threadId, registers);
+    bool fromSignal = exception.handlerKind == static_cast<uint32_t>(HandlerKind::FatalSignal);
+    std::map<std::string, ElfSymbolTable> tables;
+    StaticModuleMap modules(ReadRemoteModules(pid, tables));
+    StaticModuleMap unwindModules(UnwindModules(pid, modules));
+    uintptr_t frames[kMaxStackFrames];
+    int frameCount = UnwindRemote(pid, registers, unwindModules, frames, kMaxStackFrames);
+
+    // The handler and runtime ranges and the index mapping were set up before the fork
+    FingerprintRecord fingerprint = {};
+    FingerprintStack(frames, frameCount, modules, fingerprint);
+    bool repeat = RecordCrash(fingerprint) && fingerprint.previousCount > 0;
+    WriteFingerprint(writer, fingerprint);
+    if (Abandoned()) {
+        return;
+    }
+    if (repeat) {
+        writer.Append("Crash already reported: full report skipped\n");
+        WriteTimeToFirstByte(writer, exception.timeToFirstByteMicros);
+        writer.Flush();
+        return;
+    }
+
+    if (fromSignal && registers.count > 0) {
+        WriteRegisters(writer, registers);
+    }
+    RemoteSymbols symbols(modules, tables);
+    WriteStackTrace(writer, frames, frameCount, modules, &symbols);
+    WriteTimeToFirstByte(writer, exception.timeToFirstByteMicros);
+    if (Abandoned()) {
+        return;
+    }
+    writer.Flush();
+
+    if (reportRegion && !Abandoned()) {
+        MemoryReportSink sink(reportRegion, reportRegionSize);
+        ThreadCapture thread = { exception.threadId, kThreadCrashed, frames, frameCount,
+            fromSignal ? &registers : nullptr, RegisterStackPointer(registers) };
+        StackMemoryPlan stackMemory;
+        bool withStackMemory = PlanStackWindows(pid, &thread, 1, stackMemory);
+        WriteCrashReport(sink, exception, &thread, 1, modules.Modules().data(), modules.Modules().size(),
+            &fingerprint, compression, withStackMemory ? &stackMemory : nullptr);
+    }
+}
+
+[[noreturn]] void MonitorMain(int socket, int outputFd, void* reportRegion, size_t reportRegionSize,
+    CompressionState* compression) {
+    prctl(PR_SET_NAME, "crash-monitor", 0, 0, 0);
+    for (;;) {
+        char message = 0;
+        ssize_t received = recv(socket, &message, 1, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            _exit(0);  // The process exited or stopped the monitor
+        }
+        if (message == kCrashMessage) {
+            ReportCrash(monitoredPid, outputFd, reportRegion, reportRegionSize, compression);
+            char reply = kDoneMessage;
+            send(socket, &reply, 1, MSG_NOSIGNAL);
+        }
+    }
+}
+
+// Gives up on a helper that did not answer: it must not write anything once the caller
+// reports in-process, so it is told to stop, then killed and reaped.
+// Async-signal-safe.
+void AbandonCrashMonitor() {
+    sharedRequest->abandoned.store(true, std::memory_order_release);
+    kill(monitorPid, SIGKILL);
+    while (waitpid(monitorPid, nullptr, 0) < 0 && errno == EINTR) {
+    }
+    close(monitorSocket);
+    monitorSocket = -1;
+    monitorPid = 0;
+}
+
+}  // namespace
+
+bool StartCrashMonitor(int outputFd, void* reportRegion, size_t reportRegionSize, CompressionState* compression) {
+    if (monitorPid != 0) {
+        return true;
+    }
+    void* shared = mmap(nullptr, sizeof(MonitorRequest), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        return false;
+    }
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        munmap(shared, sizeof(MonitorRequest));
+        return false;
+    }
+    sharedRequest = static_cast<MonitorRequest*>(shared);
+    monitoredPid = getpid();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sockets[0]);
+        close(sockets[1]);
+        munmap(shared, sizeof(MonitorRequest));
+        sharedRequest = nullptr;
+        return false;
+    }
+    if (pid == 0) {
+        close(sockets[0]);
+        // A crash in the helper itself must not be handled as one of the monitored process
+        for (int signalNumber : { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGTRAP, SIGSYS }) {
+            signal(signalNumber, SIG_DFL);
+        }
+        MonitorMain(sockets[1], outputFd, reportRegion, reportRegionSize, compression);
+    }
+
+    close(sockets[1]);
+    // With Yama ptrace_scope 1 only ancestors may read a process's memory; allow the helper
+    prctl(PR_SET_PTRACER, pid, 0, 0, 0);
+    monitorSocket = sockets[0];
+    monitorPid = pid;
+    return true;
+}
+
+void StopCrashMonitor() {
+    if (monitorPid == 0) {
+        return;  // Never started, or abandoned by a crash that fell back in-process
+    }
+    close(monitorSocket);
+    monitorSocket = -1;
+    waitpid(monitorPid, nullptr, 0);
+    monitorPid = 0;
+    munmap(sharedRequest, sizeof(MonitorRequest));
+    sharedRequest = nullptr;
+}
+
+bool CrashMonitorRunning() {
+    return monitorSocket >= 0 && getpid() == monitoredPid;
+}
+
+bool NotifyCrashMonitor(const ExceptionRecord& exception, const void* signalContext) {
+    if (!CrashMonitorRunning()) {
+        return false;
+    }
+    sharedRequest->exception = exception;
+    sharedRequest->notifyMicros = MonotonicMicros();
+    sharedRequest->abandoned.store(false, std::memory_order_relaxed);
+    if (signalContext) {
+        memcpy(&sharedRequest->context, signalContext, sizeof(ucontext_t));
+    }
+    else {
+        getcontext(&sharedRequest->context);
+    }
+
+    char message = kCrashMessage;
+    if (send(monitorSocket, &message, 1, MSG_NOSIGNAL) != 1) {
+        AbandonCrashMonitor();
+        return false;
+    }
+    // Stay alive until the helper has read our memory. On a timeout, or if the helper died
+    // (POLLHUP, then a zero-byte recv), it is reaped before the caller falls back, so the
+    // two reports can never interleave.
+    uint64_t deadline = MonotonicMicros() + static_cast<uint64_t>(kReplyTimeoutMillis) * 1000;
+    for (;;) {
+        uint64_t now = MonotonicMicros();
+        if (now >= deadline) {
+            break;
+        }
+        pollfd socket = { monitorSocket, POLLIN, 0 };
+        int ready = poll(&socket, 1, static_cast<int>((deadline - now) / 1000) + 1);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            break;
+        }
+        char reply = 0;
+        if (recv(monitorSocket, &reply, 1, 0) == 1 && reply == kDoneMessage) {
+            return true;
+        }
+        break;
+    }
+    AbandonCrashMonitor();
+    return false;
+}
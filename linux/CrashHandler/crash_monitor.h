@@ -0,0 +1,37 @@
+#pragma once
+
+#include "crash_report_format.h"
+#include "report_compression.h"
+
+#include <cstddef>
+
+// Optional out-of-process crash monitor.
+//
+// StartCrashMonitor() forks a helper process at install time. The two are connected by a
+// socketpair and share one anonymous MAP_SHARED block. On a fatal crash the handler copies
+// the exception details and the thread's register context into the shared block, sends one
+// byte and waits. The helper reads the crashed thread's stack with process_vm_readv, unwinds
+// it with the handler's unwinder (modules loaded after the fork have their unwind tables
+// copied into the helper first), rebuilds the module list from /proc/<pid>/maps,
+// symbolizes with its own (undamaged) heap, writes the text report and, if a report file is
+// mapped, the binary report (with a window of the crashed thread's stack if stack memory was
+// prepared before the fork, see stack_memory.h), and then answers. The crashing process only
+// pays for the notification.
+
+// Forks the helper. Reports go to outputFd and, when reportRegion is set, into that shared
+// file mapping, compressed if compression is given (the helper uses its own copy of the
+// state). Returns false if the helper could not be started.
+bool StartCrashMonitor(int outputFd, void* reportRegion, size_t reportRegionSize,
+    CompressionState* compression = nullptr);
+
+// Tells the helper to exit and reaps it.
+void StopCrashMonitor();
+
+bool CrashMonitorRunning();
+
+// Hands a fatal crash to the helper and waits (bounded) until it has finished reading this
+// process. signalContext is the ucontext_t of a signal handler, or nullptr to use the
+// caller's own context. Async-signal-safe when signalContext is given. Returns false if no
+// helper is running or it did not answer; the helper is then killed and reaped before this
+// returns, and the caller should report in-process.
+bool NotifyCrashMonitor(const ExceptionRecord& exception, const void* signalContext);
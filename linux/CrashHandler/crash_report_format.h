@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary crash report format, version 2.
+//
+// A report is a ReportHeader followed by sections written back to back. Every section is a
+// SectionHeader followed by `size` payload bytes, padded with zeros to a multiple of 8 so
+// the next header is aligned. All integers are little-endian and all records have fixed
+// sizes, so a reader can map the file and use the records in place.
+//
+//   ReportHeader
+//   SectionHeader(Exception)   ExceptionRecord
+//   SectionHeader(Fingerprint) FingerprintRecord         (optional)
+//   SectionHeader(Modules)     ModuleRecord[count]
+//   SectionHeader(Threads)     ThreadRecord[count]
+//   SectionHeader(Frames)      uint64_t[count]           (ThreadRecord::firstFrame indexes this)
+//   SectionHeader(Registers)   RegisterRecord[count]
+//   SectionHeader(StackMemory) StackMemoryRecord + bytes (optional, one section per thread)
+//   SectionHeader(FlightEvents) FlightEventRecord[count] (optional, oldest first per thread)
+//
+// A section with kSectionCompressed set holds CompressedBlockHeader-prefixed blocks instead
+// of its records (see report_compression.h); `size` is then the compressed size and `count`
+// still the number of records. Version 2 added the flag, so writers that compress nothing
+// keep writing version 1.
+//
+// Readers skip section types they do not know, so new sections can be added without a
+// version bump; changing an existing record layout requires one.
+
+constexpr uint32_t kReportMagic = 0x54505243;  // "CRPT"
+constexpr uint16_t kReportVersion = 2;
+constexpr uint16_t kFirstReportVersion = 1;  // Still read, and written when no section is compressed
+
+enum class ReportState : uint32_t {
+    Empty = 0,       // A report file reserved at install time that nothing was written to
+    InProgress = 1,  // The writer has not finished (crashed or killed mid-report)
+    Complete = 2,
+};
+
+struct ReportHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;  // sizeof(ReportHeader), lets later versions grow the header
+    uint32_t state;       // ReportState
+    uint32_t sectionCount;
+    uint64_t totalSize;   // Header plus all sections, in bytes
+    uint64_t timestampNs;  // CLOCK_REALTIME when the report was started
+    int32_t processId;
+    uint32_t reserved;
+};
+
+enum class SectionType : uint16_t {
+    Exception = 1,
+    Modules = 2,
+    Threads = 3,
+    Frames = 4,
+    Registers = 5,
+    StackMemory = 6,
+    Fingerprint = 7,
+    FlightEvents = 8,
+};
+
+struct SectionHeader {
+    uint16_t type;   // SectionType
+    uint16_t flags;  // kSection* flags
+    uint32_t count;  // Number of records, for sections that are arrays
+    uint64_t size;   // Payload bytes, excluding padding; kOpenSectionSize until the section is finished
+};
+
+constexpr uint64_t kOpenSectionSize = UINT64_MAX;
+
+constexpr uint16_t kSectionCompressed = 1u << 0;
+
+// Blocks of a compressed section follow each other without padding
+struct CompressedBlockHeader {
+    uint32_t rawSize;     // Bytes the block decodes to, at most kCompressionBlockSize
+    uint32_t storedSize;  // Bytes that follow, with kBlockStoredRaw set if they are not compressed
+};
+
+constexpr uint32_t kBlockStoredRaw = 1u << 31;
+
+enum class HandlerKind : uint32_t {
+    FatalSignal = 1,  // Linux equivalent of the unhandled exception filter
+    Terminate = 2,
+    NewHandler = 3,
+};
+
+constexpr uint32_t kExceptionHasFaultAddress = 1u << 0;
+constexpr uint32_t kExceptionHasCurrentException = 1u << 1;  // Terminate with an exception in flight
+constexpr uint32_t kExceptionIsStdException = 1u << 2;       // ... derived from std::exception
+
+struct ExceptionRecord {
+    uint32_t handlerKind;  // HandlerKind
+    uint32_t flags;
+    int32_t signalNumber;  // 0 unless handlerKind is FatalSignal
+    int32_t signalCode;
+    int32_t threadId;
+    uint32_t timeToFirstByteMicros;
+    uint64_t faultAddress;
+    char exceptionType[128];    // Mangled type name, NUL-terminated
+    char exceptionMessage[256];  // what(), truncated and NUL-terminated
+};
+
+// Hash of the crashing stack that stays the same across runs (see crash_fingerprint.h)
+struct FingerprintRecord {
+    uint64_t fingerprint;
+    uint64_t previousCount;  // Crashes with this fingerprint already in the crash index
+    uint32_t frameCount;     // Frames that went into the hash
+    uint32_t reserved;
+};
+
+struct ModuleRecord {
+    uint64_t loadBias;
+    uint64_t start;
+    uint64_t end;
+    uint32_t buildIdSize;
+    uint8_t buildId[32];
+    char path[256];  // NUL-terminated
+    uint32_t reserved;
+};
+
+constexpr uint32_t kThreadCrashed = 1u << 0;
+constexpr uint32_t kThreadNoResponse = 1u << 1;  // Did not answer the dump request in time; no frames
+constexpr uint32_t kThreadThrowSite = 1u << 2;   // Where the crashed thread threw the exception std::terminate ran for
+
+struct ThreadRecord {
+    int32_t threadId;
+    uint32_t flags;
+    uint32_t firstFrame;  // Index into the Frames section
+    uint32_t frameCount;
+};
+
+enum class RegisterArch : uint32_t {
+    Unknown = 0,
+    X86_64 = 1,
+    Aarch64 = 2,
+};
+
+constexpr int kMaxRegisters = 34;
+
+struct RegisterRecord {
+    int32_t threadId;
+    uint32_t arch;   // RegisterArch
+    uint32_t count;  // Valid entries in values
+    uint32_t reserved;
+    uint64_t values[kMaxRegisters];  // Order given by RegisterName()
+};
+
+struct StackMemoryRecord {
+    int32_t threadId;
+    uint32_t reserved;
+    uint64_t address;  // Address of the first byte that follows this record
+    uint64_t size;
+};
+
+constexpr uint32_t kFlightEventText = 1u << 0;  // The event carries text instead of values
+
+constexpr int kFlightEventValues = 3;
+constexpr size_t kFlightEventTextSize = 24;
+
+// A flight recorder event (see flight_recorder.h)
+struct FlightEventRecord {
+    int32_t threadId;
+    uint32_t eventId;
+    uint32_t flags;  // kFlightEventText
+    uint32_t reserved;
+    int64_t ageNanos;  // How long before the report the event was recorded
+    union {
+        int64_t values[kFlightEventValues];
+        char text[kFlightEventTextSize];  // NUL-terminated
+    };
+};
+
+// Name of register `index` for an architecture, or nullptr
+inline const char* RegisterName(RegisterArch arch, uint32_t index) {
+    static const char* const kX86_64[] = {
+        "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "rdi", "rsi", "rbp", "rbx",
+        "rdx", "rax", "rcx", "rsp", "rip", "eflags",
+    };
+    static const char* const kAarch64[] = {
+        "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11", "x12",
+        "x13", "x14", "x15", "x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23", "x24",
+        "x25", "x26", "x27", "x28", "fp", "lr", "sp", "pc", "pstate",
+    };
+    switch (arch) {
+    case RegisterArch::X86_64:
+        return index < sizeof(kX86_64) / sizeof(kX86_64[0]) ? kX86_64[index] : nullptr;
+    case RegisterArch::Aarch64:
+        return index < sizeof(kAarch64) / sizeof(kAarch64[0]) ? kAarch64[index] : nullptr;
+    default:
+        return nullptr;
+    }
+}
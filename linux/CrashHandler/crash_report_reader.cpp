@@ -0,0 +1,295 @@
+#include "crash_report_reader.h"
+
+#include "module_map.h"
+#include "report_compression.h"
+#include "report_text.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t kSectionAlignment = 8;
+
+// Module list of a report, looked up the same way as the live module map
+std::vector<ModuleInfo> RecordedModules(const ModuleRecord* records, size_t count) {
+    std::vector<ModuleInfo> modules(count);
+    for (size_t i = 0; i < count; i++) {
+        ModuleInfo& module = modules[i];
+        memset(&module, 0, sizeof(module));
+        module.loadBias = static_cast<uintptr_t>(records[i].loadBias);
+        module.start = static_cast<uintptr_t>(records[i].start);
+        module.end = static_cast<uintptr_t>(records[i].end);
+        module.buildIdSize = std::min<uint32_t>(records[i].buildIdSize, kMaxBuildIdSize);
+        memcpy(module.buildId, records[i].buildId, module.buildIdSize);
+        memcpy(module.path, records[i].path, std::min(sizeof(module.path), sizeof(records[i].path)));
+        module.path[kMaxModulePath - 1] = '\0';
+    }
+    return modules;
+}
+
+// Payload of a compressed section; stops at the first block that is cut short or corrupt
+std::vector<uint8_t> DecodeBlocks(const uint8_t* blocks, uint64_t size) {
+    uint64_t rawTotal = 0;
+    for (uint64_t offset = 0; size - offset >= sizeof(CompressedBlockHeader);) {
+        CompressedBlockHeader block;
+        memcpy(&block, blocks + offset, sizeof(block));
+        uint64_t stored = block.storedSize & ~kBlockStoredRaw;
+        offset += sizeof(block);
+        if (block.rawSize > kCompressionBlockSize || stored > size - offset) {
+            break;
+        }
+        rawTotal += block.rawSize;
+        offset += stored;
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(rawTotal));
+    size_t decoded = 0;
+    for (uint64_t offset = 0; decoded < data.size();) {
+        CompressedBlockHeader block;
+        memcpy(&block, blocks + offset, sizeof(block));
+        uint64_t stored = block.storedSize & ~kBlockStoredRaw;
+        offset += sizeof(block);
+        if (block.storedSize & kBlockStoredRaw) {
+            if (stored != block.rawSize) {
+                break;
+            }
+            memcpy(data.data() + decoded, blocks + offset, block.rawSize);
+        }
+        else if (!DecompressBlock(blocks + offset, static_cast<size_t>(stored), data.data() + decoded, block.rawSize)) {
+            break;
+        }
+        decoded += block.rawSize;
+        offset += stored;
+    }
+    data.resize(decoded);
+    return data;
+}
+
+}  // namespace
+
+CrashReportReader::~CrashReportReader() {
+    if (mappedSize_ > 0) {
+        munmap(const_cast<uint8_t*>(data_), mappedSize_);
+    }
+}
+
+bool CrashReportReader::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error_ = "cannot open " + path;
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(ReportHeader))) {
+        close(fd);
+        error_ = path + " is too small to be a report";
+        return false;
+    }
+    void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error_ = "cannot map " + path;
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(mapping);
+    size_ = static_cast<size_t>(status.st_size);
+    mappedSize_ = size_;
+    return Validate();
+}
+
+bool CrashReportReader::Open(const void* data, size_t size) {
+    if (size < sizeof(ReportHeader)) {
+        error_ = "too small to be a report";
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(data);
+    size_ = size;
+    return Validate();
+}
+
+bool CrashReportReader::Validate() {
+    const ReportHeader& header = Header();
+    if (header.magic != kReportMagic) {
+        error_ = "not a crash report";
+        return false;
+    }
+    if (header.version < kFirstReportVersion || header.version > kReportVersion ||
+        header.headerSize < sizeof(ReportHeader)) {
+        error_ = "unsupported report version " + std::to_string(header.version);
+        return false;
+    }
+    // Bytes past the end of a complete report are leftovers, e.g. a reused report file
+    if (Complete() && header.totalSize >= header.headerSize && header.totalSize < size_) {
+        size_ = static_cast<size_t>(header.totalSize);
+    }
+    DecodeCompressedSections();
+    return true;
+}
+
+void CrashReportReader::DecodeCompressedSections() {
+    decoded_.clear();
+    for (uint64_t offset = FirstSection(); offset != kEndOffset; offset = NextSection(offset)) {
+        const SectionHeader* header = reinterpret_cast<const SectionHeader*>(data_ + offset);
+        if (header->flags & kSectionCompressed) {
+            decoded_.push_back({ offset, DecodeBlocks(data_ + offset + sizeof(SectionHeader), header->size) });
+        }
+    }
+}
+
+const CrashReportReader::DecodedSection* CrashReportReader::Decoded(uint64_t offset) const {
+    for (const DecodedSection& section : decoded_) {
+        if (section.offset == offset) {
+            return &section;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t CrashReportReader::FirstSection() const {
+    uint64_t offset = Header().headerSize;
+    return IntactSection(offset) ? offset : kEndOffset;
+}
+
+uint64_t CrashReportReader::NextSection(uint64_t offset) const {
+    const SectionHeader* header = reinterpret_cast<const SectionHeader*>(data_ + offset);
+    uint64_t next = offset + sizeof(SectionHeader) +
+        (header->size + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+    return IntactSection(next) ? next : kEndOffset;
+}
+
+bool CrashReportReader::IntactSection(uint64_t offset) const {
+    if (offset > size_ || size_ - offset < sizeof(SectionHeader)) {
+        return false;
+    }
+    const SectionHeader* header = reinterpret_cast<const SectionHeader*>(data_ + offset);
+    if (header->size > size_ - offset - sizeof(SectionHeader)) {
+        return false;
+    }
+    // Sections still open when the writer died carry kOpenSectionSize and fail the bounds
+    // check above; type 0 is space that was never written
+    return header->type != 0;
+}
+
+ReportSection CrashReportReader::Iterator::operator*() const {
+    const SectionHeader* header = reinterpret_cast<const SectionHeader*>(reader_->data_ + offset_);
+    ReportSection section;
+    section.type = static_cast<SectionType>(header->type);
+    section.flags = header->flags;
+    section.count = header->count;
+    section.data = reader_->data_ + offset_ + sizeof(SectionHeader);
+    section.size = header->size;
+    if (header->flags & kSectionCompressed) {
+        const DecodedSection* decoded = reader_->Decoded(offset_);
+        section.flags &= static_cast<uint16_t>(~kSectionCompressed);
+        section.data = decoded ? decoded->data.data() : nullptr;
+        section.size = decoded ? decoded->data.size() : 0;
+    }
+    return section;
+}
+
+CrashReportReader::Iterator& CrashReportReader::Iterator::operator++() {
+    offset_ = reader_->NextSection(offset_);
+    return *this;
+}
+
+bool CrashReportReader::FindSection(SectionType type, ReportSection& section) const {
+    for (ReportSection candidate : *this) {
+        if (candidate.type == type) {
+            section = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WriteReportText(SafeWriter& writer, const CrashReportReader& reader) {
+    ReportSection section;
+    size_t count = 0;
+
+    ExceptionRecord exception = {};
+    if (reader.FindSection(SectionType::Exception, section)) {
+        const ExceptionRecord* record = reader.Records<ExceptionRecord>(section, count);
+        if (count > 0) {
+            exception = *record;
+            exception.exceptionType[sizeof(exception.exceptionType) - 1] = '\0';
+            exception.exceptionMessage[sizeof(exception.exceptionMessage) - 1] = '\0';
+        }
+    }
+    if (!reader.Complete()) {
+        writer.Append("Report incomplete: the process died while writing it\n");
+    }
+    WriteReportHeadline(writer, exception);
+    WriteReportDetails(writer, exception);
+    if (reader.FindSection(SectionType::Fingerprint, section)) {
+        const FingerprintRecord* fingerprint = reader.Records<FingerprintRecord>(section, count);
+        if (count > 0) {
+            WriteFingerprint(writer, *fingerprint);
+        }
+    }
+
+    const ModuleRecord* moduleRecords = nullptr;
+    size_t moduleCount = 0;
+    if (reader.FindSection(SectionType::Modules, section)) {
+        moduleRecords = reader.Records<ModuleRecord>(section, moduleCount);
+    }
+    StaticModuleMap modules(RecordedModules(moduleRecords, moduleCount));
+
+    const uint64_t* frames = nullptr;
+    size_t frameCount = 0;
+    if (reader.FindSection(SectionType::Frames, section)) {
+        frames = reader.Records<uint64_t>(section, frameCount);
+    }
+
+    const RegisterRecord* registers = nullptr;
+    size_t registerCount = 0;
+    if (reader.FindSection(SectionType::Registers, section)) {
+        registers = reader.Records<RegisterRecord>(section, registerCount);
+    }
+
+    const ThreadRecord* threads = nullptr;
+    size_t threadCount = 0;
+    if (reader.FindSection(SectionType::Threads, section)) {
+        threads = reader.Records<ThreadRecord>(section, threadCount);
+    }
+    ReportModules used;
+    for (size_t i = 0; i < threadCount; i++) {
+        const ThreadRecord& thread = threads[i];
+        if (i > 0 || thread.threadId != exception.threadId) {
+            WriteThreadHeader(writer, thread.threadId, thread.flags);
+        }
+        // Like the handlers, only the crashed thread's registers go into the text
+        for (size_t j = 0; j < registerCount && (thread.flags & kThreadCrashed); j++) {
+            if (registers[j].threadId == thread.threadId) {
+                WriteRegisters(writer, registers[j]);
+            }
+        }
+        std::vector<uintptr_t> threadFrames;
+        for (uint64_t j = thread.firstFrame; j < frameCount && j < uint64_t(thread.firstFrame) + thread.frameCount; j++) {
+            threadFrames.push_back(static_cast<uintptr_t>(frames[j]));
+        }
+        WriteFrames(writer, threadFrames.data(), static_cast<int>(threadFrames.size()), modules, used);
+        for (ReportSection memory : reader) {
+            size_t memoryCount = 0;
+            const StackMemoryRecord* record = memory.type == SectionType::StackMemory
+                ? reader.Records<StackMemoryRecord>(memory, memoryCount) : nullptr;
+            if (memoryCount > 0 && record->threadId == thread.threadId && !(thread.flags & kThreadThrowSite)) {
+                WriteStackMemorySummary(writer, *record);
+            }
+        }
+    }
+    WriteModuleList(writer, used);
+    if (reader.FindSection(SectionType::FlightEvents, section)) {
+        const FlightEventRecord* events = reader.Records<FlightEventRecord>(section, count);
+        WriteFlightEvents(writer, events, static_cast<int>(count));
+    }
+    if (exception.handlerKind != 0) {
+        WriteTimeToFirstByte(writer, exception.timeToFirstByteMicros);
+    }
+    writer.Flush();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "crash_report_format.h"
+#include "safe_writer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One section of a report, pointing straight into the mapped file
+struct ReportSection {
+    SectionType type;
+    uint16_t flags;
+    uint32_t count;
+    const uint8_t* data;
+    uint64_t size;
+};
+
+// Reads binary reports (crash_report_format.h) in place: the file is mapped read-only and
+// sections and records are handed out as pointers into the mapping, nothing is copied or
+// parsed. Compressed sections are the exception: they are decoded once when the report is
+// opened and handed out like the others, without kSectionCompressed. Every section is
+// bounds-checked, so truncated or unfinished reports (state InProgress) can still be read up
+// to the last intact section, and a compressed section up to its last intact block.
+class CrashReportReader {
+public:
+    class Iterator {
+    public:
+        Iterator(const CrashReportReader* reader, uint64_t offset) : reader_(reader), offset_(offset) {}
+
+        ReportSection operator*() const;
+        Iterator& operator++();
+        bool operator!=(const Iterator& other) const { return offset_ != other.offset_; }
+
+    private:
+        const CrashReportReader* reader_;
+        uint64_t offset_;
+    };
+
+    CrashReportReader() = default;
+    ~CrashReportReader();
+    CrashReportReader(const CrashReportReader&) = delete;
+    CrashReportReader& operator=(const CrashReportReader&) = delete;
+
+    // Maps a report file
+    bool Open(const std::string& path);
+    // Reads a report that is already in memory; the caller keeps it alive and 8-byte aligned
+    bool Open(const void* data, size_t size);
+
+    const std::string& Error() const { return error_; }
+    const ReportHeader& Header() const { return *reinterpret_cast<const ReportHeader*>(data_); }
+    bool Complete() const { return Header().state == static_cast<uint32_t>(ReportState::Complete); }
+
+    Iterator begin() const { return Iterator(this, FirstSection()); }
+    Iterator end() const { return Iterator(this, kEndOffset); }
+
+    // First section of the given type
+    bool FindSection(SectionType type, ReportSection& section) const;
+
+    // Fixed-size records of a section; count is 0 if the section is too short for them
+    template <typename Record>
+    const Record* Records(const ReportSection& section, size_t& count) const {
+        count = section.size / sizeof(Record) < section.count ? section.size / sizeof(Record) : section.count;
+        return reinterpret_cast<const Record*>(section.data);
+    }
+
+private:
+    static constexpr uint64_t kEndOffset = UINT64_MAX;
+
+    struct DecodedSection {
+        uint64_t offset;  // Of the section header in the report
+        std::vector<uint8_t> data;
+    };
+
+    bool Validate();
+    void DecodeCompressedSections();
+    const DecodedSection* Decoded(uint64_t offset) const;
+    uint64_t FirstSection() const;
+    uint64_t NextSection(uint64_t offset) const;  // kEndOffset past the last intact section
+    bool IntactSection(uint64_t offset) const;
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;       // Usable bytes (totalSize of a complete report)
+    size_t mappedSize_ = 0;  // 0 unless the reader owns a mapping
+    std::vector<DecodedSection> decoded_;
+    std::string error_;
+};
+
+// Writes a binary report in the text layout of report_text.h, which crash_symbolizer turns
+// into the PrintStackTrace() layout
+void WriteReportText(SafeWriter& writer, const CrashReportReader& reader);
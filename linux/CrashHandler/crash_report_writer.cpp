@@ -0,0 +1,305 @@
+#include "crash_report_writer.h"
+
+#include "safe_writer.h"
+#include "stack_memory.h"
+
+#include <cerrno>
+#include <cstring>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t kSectionAlignment = 8;
+
+const uint8_t kPadding[kSectionAlignment] = {};
+
+}  // namespace
+
+bool FdReportSink::Write(const void* data, size_t size) {
+    return SafeWriteAll(fd_, static_cast<const char*>(data), size);
+}
+
+bool FdReportSink::WriteAt(uint64_t offset, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = pwrite(fd_, bytes, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        offset += static_cast<uint64_t>(written);
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool MemoryReportSink::Write(const void* data, size_t size) {
+    if (size > capacity_ - size_) {
+        return false;
+    }
+    memcpy(memory_ + size_, data, size);
+    size_ += size;
+    return true;
+}
+
+bool MemoryReportSink::WriteAt(uint64_t offset, const void* data, size_t size) {
+    if (offset > size_ || size > size_ - offset) {
+        return false;
+    }
+    memcpy(memory_ + offset, data, size);
+    return true;
+}
+
+bool ReportWriter::Emit(const void* data, size_t size) {
+    if (failed_ || !sink_.Write(data, size)) {
+        failed_ = true;
+        return false;
+    }
+    offset_ += size;
+    return true;
+}
+
+bool ReportWriter::EmitBlock() {
+    CompressionState& state = *compression_;
+    CompressedBlockHeader block;
+    block.rawSize = static_cast<uint32_t>(state.inputSize);
+    size_t compressed = CompressBlock(state.input, state.inputSize, state.output, state.table);
+    const uint8_t* stored = compressed > 0 ? state.output : state.input;
+    block.storedSize = compressed > 0 ? static_cast<uint32_t>(compressed) : block.rawSize | kBlockStoredRaw;
+    size_t storedSize = compressed > 0 ? compressed : state.inputSize;
+    state.inputSize = 0;
+    if (!Emit(&block, sizeof(block)) || !Emit(stored, storedSize)) {
+        return false;
+    }
+    section_.size += sizeof(block) + storedSize;
+    return true;
+}
+
+bool ReportWriter::Begin() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header_.magic = kReportMagic;
+    header_.version = compression_ ? kReportVersion : kFirstReportVersion;
+    header_.headerSize = sizeof(ReportHeader);
+    header_.state = static_cast<uint32_t>(ReportState::InProgress);
+    header_.timestampNs = static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+    header_.processId = getpid();
+    return Emit(&header_, sizeof(header_));
+}
+
+bool ReportWriter::BeginSection(SectionType type, uint32_t count) {
+    if (inSection_) {
+        EndSection();
+    }
+    section_ = {};
+    section_.type = static_cast<uint16_t>(type);
+    section_.count = count;
+    section_.flags = compression_ ? kSectionCompressed : 0;
+    section_.size = kOpenSectionSize;  // Readers of an unfinished report stop here
+    sectionOffset_ = offset_;
+    inSection_ = true;
+    bool written = Emit(&section_, sizeof(section_));
+    section_.size = 0;
+    if (compression_) {
+        compression_->inputSize = 0;
+    }
+    return written;
+}
+
+bool ReportWriter::Append(const void* data, size_t size) {
+    if (!inSection_) {
+        return false;
+    }
+    if (!compression_) {
+        if (!Emit(data, size)) {
+            return false;
+        }
+        section_.size += size;
+        return true;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        size_t chunk = kCompressionBlockSize - compression_->inputSize;
+        if (chunk > size) {
+            chunk = size;
+        }
+        memcpy(compression_->input + compression_->inputSize, bytes, chunk);
+        compression_->inputSize += chunk;
+        bytes += chunk;
+        size -= chunk;
+        if (compression_->inputSize == kCompressionBlockSize && !EmitBlock()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReportWriter::EndSection() {
+    if (!inSection_) {
+        return false;
+    }
+    inSection_ = false;
+    if (compression_ && compression_->inputSize > 0 && !EmitBlock()) {
+        return false;
+    }
+    uint64_t padding = (kSectionAlignment - section_.size % kSectionAlignment) % kSectionAlignment;
+    if (padding > 0 && !Emit(kPadding, padding)) {
+        return false;
+    }
+    if (failed_ || !sink_.WriteAt(sectionOffset_, &section_, sizeof(section_))) {
+        failed_ = true;
+        return false;
+    }
+    header_.sectionCount++;
+    return true;
+}
+
+bool ReportWriter::AddSection(SectionType type, uint32_t count, const void* data, size_t size) {
+    return BeginSection(type, count) && Append(data, size) && EndSection();
+}
+
+bool ReportWriter::Finish() {
+    if (inSection_) {
+        EndSection();
+    }
+    if (failed_) {
+        return false;
+    }
+    header_.state = static_cast<uint32_t>(ReportState::Complete);
+    header_.totalSize = offset_;
+    return sink_.WriteAt(0, &header_, sizeof(header_));
+}
+
+void CopyReportString(char* destination, size_t capacity, const char* source) {
+    size_t length = 0;
+    if (source) {
+        while (length + 1 < capacity && source[length] != '\0') {
+            destination[length] = source[length];
+            length++;
+        }
+    }
+    destination[length] = '\0';
+}
+
+void FillModuleRecord(const ModuleInfo& module, ModuleRecord& record) {
+    memset(&record, 0, sizeof(record));
+    record.loadBias = module.loadBias;
+    record.start = module.start;
+    record.end = module.end;
+    record.buildIdSize = module.buildIdSize;
+    memcpy(record.buildId, module.buildId, sizeof(record.buildId));
+    CopyReportString(record.path, sizeof(record.path), module.path);
+}
+
+void FillRegisterRecord(const void* signalContext, int32_t threadId, RegisterRecord& record) {
+    memset(&record, 0, sizeof(record));
+    record.threadId = threadId;
+    if (!signalContext) {
+        return;
+    }
+    const ucontext_t* context = static_cast<const ucontext_t*>(signalContext);
+#if defined(__x86_64__)
+    // gregs starts with r8..r15, rdi, rsi, rbp, rbx, rdx, rax, rcx, rsp, rip, eflags
+    record.arch = static_cast<uint32_t>(RegisterArch::X86_64);
+    for (int i = REG_R8; i <= REG_EFL; i++) {
+        record.values[record.count++] = static_cast<uint64_t>(context->uc_mcontext.gregs[i]);
+    }
+#elif defined(__aarch64__)
+    record.arch = static_cast<uint32_t>(RegisterArch::Aarch64);
+    for (int i = 0; i < 31; i++) {
+        record.values[record.count++] = context->uc_mcontext.regs[i];
+    }
+    record.values[record.count++] = context->uc_mcontext.sp;
+    record.values[record.count++] = context->uc_mcontext.pc;
+    record.values[record.count++] = context->uc_mcontext.pstate;
+#else
+    (void)context;
+#endif
+}
+
+uintptr_t RegisterStackPointer(const RegisterRecord& record) {
+    switch (static_cast<RegisterArch>(record.arch)) {
+    case RegisterArch::X86_64:
+        return record.count > 15 ? static_cast<uintptr_t>(record.values[15]) : 0;  // rsp
+    case RegisterArch::Aarch64:
+        return record.count > 31 ? static_cast<uintptr_t>(record.values[31]) : 0;  // sp
+    default:
+        return 0;
+    }
+}
+
+bool WriteCrashReport(ReportSink& sink, const ExceptionRecord& exception, const ThreadCapture* threads,
+    int threadCount, const ModuleInfo* modules, size_t moduleCount, const FingerprintRecord* fingerprint,
+    CompressionState* compression, const StackMemoryPlan* stackMemory, const FlightEventRecord* flightEvents,
+    int flightEventCount) {
+    ReportWriter writer(sink, compression);
+    writer.Begin();
+    writer.AddSection(SectionType::Exception, 1, &exception, sizeof(exception));
+    if (fingerprint) {
+        writer.AddSection(SectionType::Fingerprint, 1, fingerprint, sizeof(*fingerprint));
+    }
+
+    writer.BeginSection(SectionType::Modules, static_cast<uint32_t>(moduleCount));
+    for (size_t i = 0; i < moduleCount; i++) {
+        ModuleRecord record;
+        FillModuleRecord(modules[i], record);
+        writer.Append(&record, sizeof(record));
+    }
+    writer.EndSection();
+
+    writer.BeginSection(SectionType::Threads, static_cast<uint32_t>(threadCount));
+    uint32_t totalFrames = 0;
+    uint32_t registerCount = 0;
+    for (int i = 0; i < threadCount; i++) {
+        ThreadRecord record = {};
+        record.threadId = threads[i].threadId;
+        record.flags = threads[i].flags;
+        record.firstFrame = totalFrames;
+        record.frameCount = static_cast<uint32_t>(threads[i].frameCount);
+        writer.Append(&record, sizeof(record));
+        totalFrames += record.frameCount;
+        if (threads[i].registers && threads[i].registers->count > 0) {
+            registerCount++;
+        }
+    }
+    writer.EndSection();
+
+    writer.BeginSection(SectionType::Frames, totalFrames);
+    for (int i = 0; i < threadCount; i++) {
+        const uintptr_t* frames = threads[i].frames;
+        int frameCount = threads[i].frameCount;
+        if (sizeof(uintptr_t) == sizeof(uint64_t)) {
+            writer.Append(frames, static_cast<size_t>(frameCount) * sizeof(uint64_t));
+        }
+        else {
+            for (int j = 0; j < frameCount; j++) {
+                uint64_t frame = frames[j];
+                writer.Append(&frame, sizeof(frame));
+            }
+        }
+    }
+    writer.EndSection();
+
+    if (registerCount > 0) {
+        writer.BeginSection(SectionType::Registers, registerCount);
+        for (int i = 0; i < threadCount; i++) {
+            if (threads[i].registers && threads[i].registers->count > 0) {
+                writer.Append(threads[i].registers, sizeof(RegisterRecord));
+            }
+        }
+        writer.EndSection();
+    }
+    if (stackMemory) {
+        WriteStackMemory(writer, *stackMemory);
+    }
+    if (flightEvents && flightEventCount > 0) {
+        writer.AddSection(SectionType::FlightEvents, static_cast<uint32_t>(flightEventCount), flightEvents,
+            static_cast<size_t>(flightEventCount) * sizeof(FlightEventRecord));
+    }
+    return writer.Finish();
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "crash_report_format.h"
+#include "module_map.h"
+#include "report_compression.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Destination of a binary report. Implementations must be async-signal-safe.
+class ReportSink {
+public:
+    // Appends bytes at the end of the report
+    virtual bool Write(const void* data, size_t size) = 0;
+    // Overwrites bytes that were already written (section sizes, the header)
+    virtual bool WriteAt(uint64_t offset, const void* data, size_t size) = 0;
+
+protected:
+    ~ReportSink() = default;
+};
+
+// Writes a report to the start of a regular file with write(2), patching with pwrite(2)
+class FdReportSink final : public ReportSink {
+public:
+    explicit FdReportSink(int fd) : fd_(fd) {}
+
+    bool Write(const void* data, size_t size) override;
+    bool WriteAt(uint64_t offset, const void* data, size_t size) override;
+
+private:
+    int fd_;
+};
+
+// Writes a report into caller-provided memory, e.g. a shared mapping of the report file
+// set up at install time. Fails instead of growing once the memory is full.
+class MemoryReportSink final : public ReportSink {
+public:
+    MemoryReportSink(void* memory, size_t capacity)
+        : memory_(static_cast<uint8_t*>(memory)), capacity_(capacity) {}
+
+    bool Write(const void* data, size_t size) override;
+    bool WriteAt(uint64_t offset, const void* data, size_t size) override;
+
+private:
+    uint8_t* memory_;
+    size_t capacity_;
+    size_t size_ = 0;
+};
+
+// Lays out a report in the format of crash_report_format.h. Sections are written in one
+// sequential pass; sizes and the header are patched in place once known, and the header
+// only switches to ReportState::Complete in Finish(). Async-signal-safe, no heap.
+//
+// Given a CompressionState, every section is compressed while it is appended to: each
+// block is compressed and written as soon as it is full, so memory use does not grow with
+// the section. The state must not be shared with a writer running at the same time.
+class ReportWriter {
+public:
+    explicit ReportWriter(ReportSink& sink, CompressionState* compression = nullptr)
+        : sink_(sink), compression_(compression) {}
+
+    bool Begin();
+    bool BeginSection(SectionType type, uint32_t count);
+    bool Append(const void* data, size_t size);
+    bool EndSection();
+    bool AddSection(SectionType type, uint32_t count, const void* data, size_t size);
+    bool Finish();
+
+private:
+    bool Emit(const void* data, size_t size);
+    bool EmitBlock();  // Compresses and writes the buffered part of a section
+
+    ReportSink& sink_;
+    CompressionState* compression_;
+    ReportHeader header_ = {};
+    SectionHeader section_ = {};
+    uint64_t offset_ = 0;
+    uint64_t sectionOffset_ = 0;
+    bool inSection_ = false;
+    bool failed_ = false;
+};
+
+// Copies a string into a fixed-size record field, truncating and always NUL-terminating
+void CopyReportString(char* destination, size_t capacity, const char* source);
+
+void FillModuleRecord(const ModuleInfo& module, ModuleRecord& record);
+
+// Register values from a ucontext_t passed to an SA_SIGINFO handler; count stays 0 on
+// architectures without a register table
+void FillRegisterRecord(const void* signalContext, int32_t threadId, RegisterRecord& record);
+
+// Stack pointer in a register record, 0 if the record has none
+uintptr_t RegisterStackPointer(const RegisterRecord& record);
+
+// One thread's part of a report; the pointers stay owned by the caller
+struct ThreadCapture {
+    int32_t threadId;
+    uint32_t flags;  // kThreadCrashed, kThreadNoResponse, kThreadThrowSite
+    const uintptr_t* frames;
+    int frameCount;
+    const RegisterRecord* registers;  // nullptr if not captured
+    uintptr_t stackPointer;           // Where stack memory is copied from; 0 if unknown
+};
+
+struct StackMemoryPlan;  // stack_memory.h
+
+// Writes a complete report: exception, fingerprint (if given), modules, every thread with its
+// frames, the registers of the threads that have them, the planned stack memory and the
+// flight recorder events, with all sections compressed if compression is given.
+// Async-signal-safe.
+bool WriteCrashReport(ReportSink& sink, const ExceptionRecord& exception, const ThreadCapture* threads,
+    int threadCount, const ModuleInfo* modules, size_t moduleCount,
+    const FingerprintRecord* fingerprint = nullptr, CompressionState* compression = nullptr,
+    const StackMemoryPlan* stackMemory = nullptr, const FlightEventRecord* flightEvents = nullptr,
+    int flightEventCount = 0);
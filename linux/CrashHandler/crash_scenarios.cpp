@@ -0,0 +1,632 @@
+// Runs the demo's crash scenarios in parallel and checks the reports they produce.
+//
+// Every scenario is one run of crash_handler (crash_handler_linux.cpp) with a menu choice and
+// options, forked into its own child with stdout and stderr on pipes, several children at a
+// time. A scenario passes when the child ends the expected way (killed by the expected signal,
+// or exiting normally for the new handler and the no-crash runs), its report has the expected
+// lines (and texts in the expected order, where given), the expected functions appear among
+// its frames (symbolized here from the module paths in the report), frame 0 lies in the
+// expected module and, where one is written, the binary report is complete. A scenario can
+// continue another one on the same crash index, to see a repeat crash; it starts only once
+// that one finished, and naming it on the command line runs both. Time to report is measured from the child's "Triggering ..." line on stdout to
+// the end of its report on stderr, as the runner sees them; with more jobs than cores a child
+// may get through its whole report before the runner reads either, so use --jobs 1 to time.
+//
+// Usage: crash_scenarios [--demo PATH] [--jobs N] [--timeout SECONDS] [--verbose] [--list] [NAME]...
+// The demo defaults to crash_handler next to this executable; scenario 6 also needs
+// libSomeThirdParty.so (../SomeThirdParty) next to the demo. Exits with status 1 if any
+// scenario fails.
+
+#include "crash_index.h"
+#include "crash_report_reader.h"
+#include "crash_report_writer.h"
+#include "elf_symbols.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Scenario {
+    const char* name;
+    // Demo arguments after the menu choice; "@" is the binary report path, "#" the crash index path
+    std::vector<std::string> arguments;
+    int expectedSignal;                  // 0: the demo must exit with status 0
+    std::vector<const char*> reportLines;  // Each must start some line of the report
+    std::vector<const char*> functions;    // Each must be the (demangled) name of some frame
+    const char* firstFrameModule;          // File name of the module frame 0 must be in, or nullptr
+    int minThreads;                        // "Thread ID:" lines the report must have
+    bool stackMemory = false;              // The binary report must hold the crashed thread's stack memory
+    std::vector<const char*> reportSequence = {};  // Must all occur in the report, in this order
+    const char* after = nullptr;  // Runs once this scenario finished, on its crash index
+};
+
+const std::vector<Scenario>& Scenarios() {
+    static const std::vector<Scenario> scenarios = {
+        { "pure-call", { "1" }, SIGABRT,
+            { "Terminate handler: called" }, { "__cxa_pure_virtual", "TriggerPureCallHandler()" }, nullptr, 1 },
+        { "terminate-exception", { "2" }, SIGABRT,
+            { "Terminate handler: Exception type: St13runtime_error",
+              "Terminate handler: Exception message: Unhandled exception to trigger terminate handler",
+              "Exception thrown by thread ID:" },
+            { "__cxa_throw", "TriggerTerminateHandler()" }, nullptr, 1 },
+        { "terminate-direct", { "3" }, SIGABRT,
+            { "Terminate handler: No current exception" }, { "TriggerDirectTerminate()" }, nullptr, 1 },
+        { "segfault", { "4" }, SIGSEGV,
+            { "Fatal signal handler called", "Signal: SIGSEGV (11)", "Fault address: 0x0", "Registers:",
+              "Flight recorder of thread ID", "Event 3 at" },
+            { "TriggerSegmentationFault()", "main" }, "crash_handler", 1 },
+        { "new-handler", { "5" }, 0,
+            { "New handler called: Out of memory!", "Failed allocation size: 400000000 bytes",
+              "Address space limit: 4294967296 bytes", "Largest mapping 0:", "Likely cause: address space limit reached",
+              "Emergency reserve released: 1048576 bytes", "Registered caches released: 268435456 bytes", "Heap site 0:" },
+            { "operator new(unsigned long)", "TriggerNewHandler()" }, nullptr, 1 },
+        { "third-party", { "6" }, SIGSEGV,
+            { "Fatal signal handler called", "Signal: SIGSEGV (11)" },
+            { "CrashFunction", "TriggerThirdPartyCrash()", "main" }, "libSomeThirdParty.so", 1 },
+        { "segfault-binary-report", { "4", "@" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "TriggerSegmentationFault()" }, "crash_handler", 1 },
+        { "segfault-monitor", { "4", "@", "monitor" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "TriggerSegmentationFault()", "main" }, "crash_handler", 1 },
+        // The library is loaded after the helper was forked, so the helper copies its unwind table
+        { "third-party-monitor", { "6", "@", "monitor" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "CrashFunction", "TriggerThirdPartyCrash()", "main" },
+            "libSomeThirdParty.so", 1 },
+        { "segfault-all-threads", { "4", "@", "threads" }, SIGSEGV,
+            { "Fatal signal handler called", "Flight recorder of thread ID", "Event 2 at" }, { "TriggerSegmentationFault()" }, "crash_handler", 4 },
+        { "all-threads-compressed", { "4", "@", "threads", "-", "-", "-", "compress" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "TriggerSegmentationFault()" }, "crash_handler", 4 },
+        { "all-threads-stack-memory", { "4", "@", "threads", "-", "-", "-", "compress,stack" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "TriggerSegmentationFault()" }, "crash_handler", 4, true },
+        { "third-party-all-threads", { "6", "-", "threads" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "CrashFunction", "TriggerThirdPartyCrash()" }, "libSomeThirdParty.so", 4 },
+        { "segfault-frame-pointer", { "4", "-", "-", "-", "frame-pointer" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "TriggerSegmentationFault()", "main" }, "crash_handler", 1 },
+        { "segfault-dwarf", { "4", "-", "-", "-", "dwarf" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "TriggerSegmentationFault()", "main" }, "crash_handler", 1 },
+        { "third-party-dwarf", { "6", "-", "-", "-", "dwarf" }, SIGSEGV,
+            { "Fatal signal handler called" }, { "CrashFunction", "TriggerThirdPartyCrash()", "main" },
+            "libSomeThirdParty.so", 1 },
+        { "hang-detector", { "7" }, 0,
+            { "Hang detector: 1 thread stalled", "Stalled thread ID:", "Hang detector: thread dump requested by SIGUSR2 (12)",
+              "Dumps skipped by the rate limit: 1" },
+            { "TriggerHangDetector()" }, nullptr, 2 },
+        { "throw-storm", { "8" }, 0,
+            { "Throw sites in the last" }, { "__cxa_throw", "TriggerThrowStorm()" }, nullptr, 0, false,
+            { "Throw sites in the last", "Throw site 0: ", "St12out_of_range", "Throw site 1: ", "St16invalid_argument",
+              "Throw site 2: ", "St12length_error" } },
+        // The index starts as a file whose creation was cut off before the header was written
+        { "segfault-index", { "4", "-", "-", "#" }, SIGSEGV,
+            { "Fatal signal handler called", "Fingerprint: " }, { "TriggerSegmentationFault()" }, "crash_handler", 1 },
+        { "segfault-index-repeat", { "4", "-", "-", "#" }, SIGSEGV,
+            { "Fatal signal handler called", "Crash already reported: full report skipped" }, {}, nullptr, 0, false,
+            { "Fingerprint: ", " (seen 1 times before)" }, "segfault-index" },
+        { "terminate-backtrace", { "2", "-", "-", "-", "backtrace" }, SIGABRT,
+            { "Terminate handler: Exception type: St13runtime_error", "Exception thrown by thread ID:" },
+            { "__cxa_throw", "TriggerTerminateHandler()" }, nullptr, 1 },
+    };
+    return scenarios;
+}
+
+struct Run {
+    const Scenario* scenario = nullptr;
+    std::string binaryReportPath;
+    std::string crashIndexPath;
+    bool started = false;
+    bool finished = false;
+    pid_t pid = -1;
+    int outputFd = -1;  // The child's stdout
+    int reportFd = -1;  // The child's stderr, where reports go
+    std::string output;
+    std::string report;
+    uint64_t startNs = 0;
+    uint64_t triggerNs = 0;  // When "Triggering" arrived on stdout
+    uint64_t reportEndNs = 0;
+    uint64_t exitNs = 0;
+    int status = 0;
+    bool timedOut = false;
+};
+
+uint64_t NowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+std::string ExecutableDirectory() {
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        return ".";
+    }
+    std::string executable(path, static_cast<size_t>(length));
+    return executable.substr(0, executable.rfind('/'));
+}
+
+bool StartRun(Run& run, const std::string& demo, const std::string& workDirectory) {
+    int outputPipe[2];
+    int reportPipe[2];
+    if (pipe2(outputPipe, O_CLOEXEC) != 0) {
+        return false;
+    }
+    if (pipe2(reportPipe, O_CLOEXEC) != 0) {
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+        return false;
+    }
+    std::vector<std::string> arguments = { demo };
+    for (const std::string& argument : run.scenario->arguments) {
+        arguments.push_back(argument == "@" ? run.binaryReportPath : argument == "#" ? run.crashIndexPath : argument);
+    }
+    std::vector<char*> argv;
+    for (std::string& argument : arguments) {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    run.startNs = NowNs();
+    run.pid = fork();
+    if (run.pid == 0) {
+        // Files the demo may create (a crash index, an unnamed report) stay in the work directory
+        if (chdir(workDirectory.c_str()) != 0 || dup2(outputPipe[1], STDOUT_FILENO) < 0 ||
+            dup2(reportPipe[1], STDERR_FILENO) < 0) {
+            _exit(127);
+        }
+        int devNull = open("/dev/null", O_RDONLY);
+        if (devNull >= 0) {
+            dup2(devNull, STDIN_FILENO);  // Never wait at the menu
+        }
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(outputPipe[1]);
+    close(reportPipe[1]);
+    if (run.pid < 0) {
+        close(outputPipe[0]);
+        close(reportPipe[0]);
+        return false;
+    }
+    run.outputFd = outputPipe[0];
+    run.reportFd = reportPipe[0];
+    return true;
+}
+
+// Appends what is readable; closes the descriptor at end of file
+void Drain(int& fd, std::string& text) {
+    char buffer[4096];
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count > 0) {
+        text.append(buffer, static_cast<size_t>(count));
+    }
+    else if (count == 0 || (errno != EINTR && errno != EAGAIN)) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+struct ReportFrame {
+    int index;
+    int module;  // -1 when the address is in no module
+    uint64_t offset;
+    std::string path;  // Of the module, from the module list of the frame's report
+};
+
+// Symbols are loaded once per file for all scenarios
+const ElfSymbolTable* SymbolsFor(const std::string& path) {
+    static std::map<std::string, std::unique_ptr<ElfSymbolTable>> tables;
+    auto found = tables.find(path);
+    if (found == tables.end()) {
+        std::unique_ptr<ElfSymbolTable> table(new ElfSymbolTable());
+        if (!table->Load(path)) {
+            table.reset();
+        }
+        found = tables.emplace(path, std::move(table)).first;
+    }
+    return found->second.get();
+}
+
+// A StackMemory section of the crashed thread, whole and starting below its stack pointer
+bool HasStackMemory(const CrashReportReader& reader) {
+    ReportSection section;
+    size_t count = 0;
+    if (!reader.FindSection(SectionType::Exception, section)) {
+        return false;
+    }
+    int32_t crashedThread = reader.Records<ExceptionRecord>(section, count)->threadId;
+    const RegisterRecord* registers = nullptr;
+    if (reader.FindSection(SectionType::Registers, section)) {
+        registers = reader.Records<RegisterRecord>(section, count);
+    }
+    for (ReportSection memory : reader) {
+        const StackMemoryRecord* record = memory.type == SectionType::StackMemory
+            ? reader.Records<StackMemoryRecord>(memory, count) : nullptr;
+        if (!record || count == 0 || record->threadId != crashedThread || record->size == 0 ||
+            memory.size < sizeof(StackMemoryRecord) + record->size) {
+            continue;
+        }
+        uintptr_t stackPointer = registers ? RegisterStackPointer(*registers) : 0;
+        return stackPointer == 0 || record->address <= stackPointer;
+    }
+    return false;
+}
+
+std::vector<std::string> CheckRun(const Run& run) {
+    const Scenario& scenario = *run.scenario;
+    std::vector<std::string> failures;
+    if (run.timedOut) {
+        failures.push_back("timed out");
+    }
+    else if (scenario.expectedSignal != 0 &&
+        (!WIFSIGNALED(run.status) || WTERMSIG(run.status) != scenario.expectedSignal)) {
+        failures.push_back(std::string("expected death by ") + strsignal(scenario.expectedSignal) + ", got " +
+            (WIFSIGNALED(run.status) ? strsignal(WTERMSIG(run.status)) : "exit " + std::to_string(WEXITSTATUS(run.status))));
+    }
+    else if (scenario.expectedSignal == 0 && (!WIFEXITED(run.status) || WEXITSTATUS(run.status) != 0)) {
+        failures.push_back("expected a normal exit");
+    }
+
+    std::vector<std::string> lines;
+    for (size_t start = 0; start < run.report.size();) {
+        size_t end = run.report.find('\n', start);
+        if (end == std::string::npos) {
+            end = run.report.size();
+        }
+        lines.push_back(run.report.substr(start, end - start));
+        start = end + 1;
+    }
+    for (const char* expected : scenario.reportLines) {
+        bool found = false;
+        for (const std::string& line : lines) {
+            found = found || line.compare(0, strlen(expected), expected) == 0;
+        }
+        if (!found) {
+            failures.push_back(std::string("no line \"") + expected + "\"");
+        }
+    }
+
+    size_t position = 0;
+    for (const char* expected : scenario.reportSequence) {
+        position = run.report.find(expected, position);
+        if (position == std::string::npos) {
+            failures.push_back(std::string("no \"") + expected + "\" after the text before it");
+            break;
+        }
+        position += strlen(expected);
+    }
+
+    // Frames of all stacks. Each report lists the modules its frames use after them, numbered
+    // for that report alone, so a frame's module is the one of that number in the next list.
+    std::vector<ReportFrame> frames;
+    std::map<int, std::string> modulePaths;
+    size_t resolved = 0;  // Frames before this one have their module's path
+    bool inModuleList = false;
+    int threads = 0;
+    for (size_t i = 0; i <= lines.size(); i++) {
+        const std::string line = i < lines.size() ? lines[i] : "";
+        ReportFrame frame = { 0, -1, 0, "" };
+        int module = 0;
+        uint64_t base = 0;
+        int pathOffset = 0;
+        char buildId[2 * 32 + 1];
+        bool moduleLine = inModuleList && sscanf(line.c_str(), "Module %d: base 0x%" SCNx64 " build-id %64s path %n",
+            &module, &base, buildId, &pathOffset) == 3 && pathOffset > 0;
+        if (inModuleList && !moduleLine) {
+            for (; resolved < frames.size(); resolved++) {
+                auto found = modulePaths.find(frames[resolved].module);
+                frames[resolved].path = found != modulePaths.end() ? found->second : "";
+            }
+            modulePaths.clear();
+            inModuleList = false;
+        }
+        if (moduleLine) {
+            modulePaths[module] = line.substr(static_cast<size_t>(pathOffset));
+        }
+        else if (line == "Modules:") {
+            inModuleList = true;
+        }
+        else if (sscanf(line.c_str(), "Frame %d:", &frame.index) == 1) {
+            size_t position = line.rfind(" (module ");
+            if (position != std::string::npos &&
+                sscanf(line.c_str() + position, " (module %d + 0x%" SCNx64 ")", &frame.module, &frame.offset) != 2) {
+                frame.module = -1;
+            }
+            frames.push_back(frame);
+        }
+        else if (line.compare(0, 10, "Thread ID:") == 0) {
+            threads++;
+        }
+    }
+    if (frames.empty() && !scenario.functions.empty()) {  // Repeat reports have none
+        failures.push_back("no frames");
+    }
+    if (threads < scenario.minThreads) {
+        failures.push_back("expected " + std::to_string(scenario.minThreads) + " threads, report has " +
+            std::to_string(threads));
+    }
+
+    std::vector<std::string> names;
+    for (const ReportFrame& frame : frames) {
+        const ElfSymbolTable* symbols = !frame.path.empty() ? SymbolsFor(frame.path) : nullptr;
+        // Frames past the first are return addresses; look up the call instruction instead
+        const ElfSymbol* symbol = symbols ? symbols->Find(frame.index > 0 && frame.offset > 0 ? frame.offset - 1 : frame.offset)
+            : nullptr;
+        names.push_back(symbol ? DemangleSymbol(symbol->name) : "");
+    }
+    for (const char* function : scenario.functions) {
+        bool found = false;
+        for (const std::string& name : names) {
+            found = found || name == function || name.compare(0, strlen(function) + 1, std::string(function) + " ") == 0;
+        }
+        if (!found) {
+            failures.push_back(std::string("no frame in ") + function);
+        }
+    }
+    if (scenario.firstFrameModule && !frames.empty()) {
+        const std::string& path = frames[0].path;
+        std::string file = path.substr(path.rfind('/') + 1);
+        if (file != scenario.firstFrameModule) {
+            failures.push_back(std::string("frame 0 is in ") + (path.empty() ? "no module" : path) + ", expected " +
+                scenario.firstFrameModule);
+        }
+    }
+
+    if (!run.binaryReportPath.empty()) {
+        CrashReportReader reader;
+        ReportSection section;
+        size_t count = 0;
+        if (!reader.Open(run.binaryReportPath)) {
+            failures.push_back("binary report: " + reader.Error());
+        }
+        else if (!reader.Complete()) {
+            failures.push_back("binary report is not complete");
+        }
+        else if (!reader.FindSection(SectionType::Exception, section) ||
+            reader.Records<ExceptionRecord>(section, count)->signalNumber != scenario.expectedSignal || count != 1) {
+            failures.push_back("binary report has no exception record for the signal");
+        }
+        // Compressed sections are decoded by the reader, so all frames must be readable either way
+        else if (!reader.FindSection(SectionType::Frames, section) || section.count == 0 ||
+            !reader.Records<uint64_t>(section, count) || count != section.count) {
+            failures.push_back("binary report has no frames");
+        }
+        else if (scenario.stackMemory && !HasStackMemory(reader)) {
+            failures.push_back("binary report has no stack memory of the crashed thread");
+        }
+    }
+    return failures;
+}
+
+void PrintRun(const Run& run, const std::vector<std::string>& failures, bool verbose) {
+    char timing[128] = "";
+    if (run.triggerNs != 0 && run.reportEndNs >= run.triggerNs) {
+        unsigned firstByte = 0;
+        size_t line = run.report.find("Time to first byte: ");
+        if (line != std::string::npos) {
+            sscanf(run.report.c_str() + line, "Time to first byte: %u us", &firstByte);
+        }
+        snprintf(timing, sizeof(timing), "report %.2f ms (first byte %u us), run %.1f ms",
+            (run.reportEndNs - run.triggerNs) / 1e6, firstByte, (run.exitNs - run.startNs) / 1e6);
+    }
+    printf("%s %-26s %s\n", failures.empty() ? "PASS" : "FAIL", run.scenario->name, timing);
+    for (const std::string& failure : failures) {
+        printf("     %s\n", failure.c_str());
+    }
+    if (!failures.empty() || verbose) {
+        printf("---- report of %s\n%s---- end of report\n", run.scenario->name, run.report.c_str());
+    }
+}
+
+// The scenario by name, or nullptr
+const Scenario* FindScenario(const std::string& name) {
+    for (const Scenario& scenario : Scenarios()) {
+        if (name == scenario.name) {
+            return &scenario;
+        }
+    }
+    return nullptr;
+}
+
+// A zero-filled index of the full size, as OpenCrashIndex() leaves it when the process dies
+// right after allocating the file
+bool CreateEmptyCrashIndex(const std::string& path) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ftruncate(fd, static_cast<off_t>(sizeof(CrashIndexHeader) +
+        sizeof(CrashIndexEntry) * kCrashIndexCapacity)) == 0;
+    close(fd);
+    return ok;
+}
+
+// The next run that has not started and whose predecessor, if any, has finished
+Run* NextRun(std::vector<Run>& runs) {
+    for (Run& run : runs) {
+        if (run.started) {
+            continue;
+        }
+        bool ready = true;
+        for (const Run& other : runs) {
+            ready = ready && !(run.scenario->after && strcmp(other.scenario->name, run.scenario->after) == 0 &&
+                !other.finished);
+        }
+        if (ready) {
+            return &run;
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string demo = ExecutableDirectory() + "/crash_handler";
+    int jobs = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    int timeoutSeconds = 60;
+    bool verbose = false;
+    std::vector<const Scenario*> selected;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--demo" && i + 1 < argc) {
+            demo = argv[++i];
+        }
+        else if (argument == "--jobs" && i + 1 < argc) {
+            jobs = std::max(atoi(argv[++i]), 1);
+        }
+        else if (argument == "--timeout" && i + 1 < argc) {
+            timeoutSeconds = std::max(atoi(argv[++i]), 1);
+        }
+        else if (argument == "--verbose") {
+            verbose = true;
+        }
+        else if (argument == "--list") {
+            for (const Scenario& scenario : Scenarios()) {
+                printf("%s\n", scenario.name);
+            }
+            return 0;
+        }
+        else {
+            const Scenario* match = FindScenario(argument);
+            if (!match) {
+                fprintf(stderr, "Usage: crash_scenarios [--demo PATH] [--jobs N] [--timeout SECONDS] [--verbose] [--list] [NAME]...\n");
+                return 2;
+            }
+            // A scenario that continues another one needs it to run first
+            const Scenario* predecessor = match->after ? FindScenario(match->after) : nullptr;
+            if (predecessor && std::find(selected.begin(), selected.end(), predecessor) == selected.end()) {
+                selected.push_back(predecessor);
+            }
+            if (std::find(selected.begin(), selected.end(), match) == selected.end()) {
+                selected.push_back(match);
+            }
+        }
+    }
+    if (selected.empty()) {
+        for (const Scenario& scenario : Scenarios()) {
+            selected.push_back(&scenario);
+        }
+    }
+    if (access(demo.c_str(), X_OK) != 0) {
+        fprintf(stderr, "crash_scenarios: cannot run %s\n", demo.c_str());
+        return 2;
+    }
+    char workTemplate[] = "/tmp/crash_scenarios.XXXXXX";
+    const char* workDirectory = mkdtemp(workTemplate);
+    if (!workDirectory) {
+        fprintf(stderr, "crash_scenarios: cannot create a work directory: %s\n", strerror(errno));
+        return 2;
+    }
+
+    std::vector<Run> runs(selected.size());
+    for (size_t i = 0; i < selected.size(); i++) {
+        runs[i].scenario = selected[i];
+        for (const std::string& argument : selected[i]->arguments) {
+            if (argument == "@") {
+                runs[i].binaryReportPath = std::string(workDirectory) + "/" + selected[i]->name + ".bin";
+            }
+            if (argument == "#") {
+                const char* owner = selected[i]->after ? selected[i]->after : selected[i]->name;
+                runs[i].crashIndexPath = std::string(workDirectory) + "/" + owner + ".idx";
+            }
+        }
+        if (!runs[i].crashIndexPath.empty() && !selected[i]->after && !CreateEmptyCrashIndex(runs[i].crashIndexPath)) {
+            fprintf(stderr, "crash_scenarios: cannot create %s: %s\n", runs[i].crashIndexPath.c_str(), strerror(errno));
+            return 2;
+        }
+    }
+
+    uint64_t timeoutNs = static_cast<uint64_t>(timeoutSeconds) * 1000000000ull;
+    size_t finished = 0;
+    int failed = 0;
+    std::vector<Run*> running;
+    while (finished < runs.size()) {
+        while (static_cast<int>(running.size()) < jobs) {
+            Run* run = NextRun(runs);
+            if (!run) {
+                break;
+            }
+            if (!StartRun(*run, demo, workDirectory)) {
+                fprintf(stderr, "crash_scenarios: cannot start %s: %s\n", run->scenario->name, strerror(errno));
+                return 2;
+            }
+            run->started = true;
+            running.push_back(run);
+        }
+
+        std::vector<pollfd> descriptors;
+        for (Run* run : running) {
+            for (int fd : { run->outputFd, run->reportFd }) {
+                if (fd >= 0) {
+                    descriptors.push_back({ fd, POLLIN, 0 });
+                }
+            }
+        }
+        poll(descriptors.data(), descriptors.size(), 10);
+        uint64_t now = NowNs();
+
+        for (size_t i = 0; i < running.size();) {
+            Run& run = *running[i];
+            for (const pollfd& descriptor : descriptors) {
+                if (descriptor.revents == 0) {
+                    continue;
+                }
+                if (descriptor.fd == run.outputFd) {
+                    Drain(run.outputFd, run.output);
+                    if (run.triggerNs == 0 && run.output.find("Triggering") != std::string::npos) {
+                        run.triggerNs = now;
+                    }
+                }
+                else if (descriptor.fd == run.reportFd) {
+                    Drain(run.reportFd, run.report);
+                    if (run.reportFd < 0) {
+                        run.reportEndNs = now;
+                    }
+                }
+            }
+            if (!run.timedOut && now - run.startNs > timeoutNs) {
+                kill(run.pid, SIGKILL);
+                run.timedOut = true;
+            }
+            // The report ends when the child and everything it forked have closed stderr
+            if (run.outputFd < 0 && run.reportFd < 0 && waitpid(run.pid, &run.status, WNOHANG) == run.pid) {
+                run.exitNs = NowNs();
+                std::vector<std::string> failures = CheckRun(run);
+                failed += failures.empty() ? 0 : 1;
+                PrintRun(run, failures, verbose);
+                fflush(stdout);
+                run.finished = true;
+                running.erase(running.begin() + static_cast<long>(i));
+                finished++;
+                continue;
+            }
+            i++;
+        }
+    }
+
+    for (const Run& run : runs) {
+        if (!run.binaryReportPath.empty()) {
+            unlink(run.binaryReportPath.c_str());
+        }
+        if (!run.crashIndexPath.empty()) {
+            unlink(run.crashIndexPath.c_str());
+        }
+    }
+    rmdir(workDirectory);  // Left behind if a scenario created anything else
+    printf("%zu/%zu scenarios passed\n", runs.size() - static_cast<size_t>(failed), runs.size());
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+// Offline symbolizer for reports written by the Linux crash handler.
+//
+// The handler only records raw frame addresses, module load bases and ELF build-ids
+// (see report_text.h). This tool resolves them later, away from the crashing process,
+// and prints the report with frames in the layout PrintStackTrace() uses on Windows.
+//
+// Binary reports (crash_report_format.h) are accepted too: they are converted to the same
+// text layout first and then symbolized like a text report.
+//
+// Usage: crash_symbolizer [--debug-dir DIR]... [report.txt|report.bin]   (reads stdin without a file)
+
+#include "crash_report_reader.h"
+#include "elf_symbols.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct ReportModule {
+    uint64_t base = 0;
+    std::string buildId;
+    std::string path;
+    ElfSymbolTable symbols;
+    bool symbolsLoaded = false;
+};
+
+bool ParseModuleLine(const std::string& line, int& index, ReportModule& module) {
+    char buildId[2 * 32 + 1];
+    int pathOffset = 0;
+    if (sscanf(line.c_str(), "Module %d: base 0x%" SCNx64 " build-id %64s path %n",
+        &index, &module.base, buildId, &pathOffset) != 3 || pathOffset == 0) {
+        return false;
+    }
+    module.buildId = buildId;
+    module.path = line.substr(pathOffset);
+    return true;
+}
+
+// Loads symbols for a module, preferring a separate debug file found by build-id.
+// A file whose build-id differs from the one recorded at crash time is never used.
+void LoadModuleSymbols(ReportModule& module, const std::vector<std::string>& debugDirs) {
+    std::vector<std::string> candidates;
+    if (module.buildId != "none" && module.buildId.size() > 2) {
+        for (const std::string& dir : debugDirs) {
+            candidates.push_back(dir + "/.build-id/" + module.buildId.substr(0, 2) + "/" +
+                module.buildId.substr(2) + ".debug");
+        }
+    }
+    candidates.push_back(module.path);
+
+    for (const std::string& candidate : candidates) {
+        if (!module.symbols.Load(candidate)) {
+            continue;
+        }
+        std::string fileBuildId = module.symbols.BuildId().empty() ? "none" : BuildIdToHex(module.symbols.BuildId());
+        if (module.buildId == "none" || fileBuildId == module.buildId) {
+            module.symbolsLoaded = true;
+            return;
+        }
+        std::cerr << "crash_symbolizer: " << candidate << " has build-id " << fileBuildId
+            << ", report expects " << module.buildId << "; skipping it" << std::endl;
+    }
+    std::cerr << "crash_symbolizer: no symbols for " << module.path << std::endl;
+}
+
+// Rewrites "Frame N: 0x... (module M + 0x...)" into "Frame N: name - 0x..."
+bool SymbolizeFrameLine(const std::string& line, std::map<int, ReportModule>& modules, std::string& output) {
+    int frame = 0;
+    uint64_t pc = 0;
+    int moduleIndex = 0;
+    uint64_t offset = 0;
+    bool inModule = sscanf(line.c_str(), "Frame %d: 0x%" SCNx64 " (module %d + 0x%" SCNx64 ")",
+        &frame, &pc, &moduleIndex, &offset) == 4;
+    if (!inModule && sscanf(line.c_str(), "Frame %d: 0x%" SCNx64 " (unknown module)", &frame, &pc) != 2) {
+        return false;
+    }
+
+    char text[64];
+    auto found = modules.find(moduleIndex);
+    if (inModule && found != modules.end() && found->second.symbolsLoaded) {
+        // Frames past the first are return addresses; look up the call instruction instead
+        uint64_t lookup = frame > 0 && offset > 0 ? offset - 1 : offset;
+        if (const ElfSymbol* symbol = found->second.symbols.Find(lookup)) {
+            snprintf(text, sizeof(text), "0x%" PRIx64, found->second.base + symbol->address);
+            output = "Frame " + std::to_string(frame) + ": " + DemangleSymbol(symbol->name) + " - " + text;
+            return true;
+        }
+    }
+    snprintf(text, sizeof(text), "0x%" PRIx64, pc);
+    output = "Frame " + std::to_string(frame) + ": Unknown - " + text;
+    return true;
+}
+
+void AppendToString(void* context, const char* data, size_t length) {
+    static_cast<std::string*>(context)->append(data, length);
+}
+
+bool IsBinaryReport(const char* data, size_t size) {
+    uint32_t magic = 0;
+    if (size < sizeof(magic)) {
+        return false;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    return magic == kReportMagic;
+}
+
+bool IsBinaryReportFile(const std::string& path) {
+    char magic[sizeof(uint32_t)];
+    std::ifstream file(path, std::ios::binary);
+    return file.read(magic, sizeof(magic)) && IsBinaryReport(magic, sizeof(magic));
+}
+
+std::string BinaryReportToText(const CrashReportReader& reader) {
+    std::string text;
+    char buffer[4096];
+    SafeWriter writer(buffer, sizeof(buffer), AppendToString, &text);
+    WriteReportText(writer, reader);
+    return text;
+}
+
+// Prints lines [begin, end) of the input, one report and the module list that ends it
+void PrintReport(const std::vector<std::string>& lines, size_t begin, size_t end,
+    std::map<int, ReportModule>& modules, const std::vector<std::string>& debugDirs) {
+    for (auto& entry : modules) {
+        LoadModuleSymbols(entry.second, debugDirs);
+    }
+    for (size_t i = begin; i < end; i++) {
+        std::string symbolized;
+        if (SymbolizeFrameLine(lines[i], modules, symbolized)) {
+            std::cout << symbolized << '\n';
+        }
+        else {
+            std::cout << lines[i] << '\n';
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> debugDirs;
+    std::string reportPath;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--debug-dir" && i + 1 < argc) {
+            debugDirs.push_back(argv[++i]);
+        }
+        else {
+            reportPath = argument;
+        }
+    }
+    debugDirs.push_back("/usr/lib/debug");
+
+    // Binary reports are mapped in place and converted to the text layout first
+    std::string text;
+    CrashReportReader reader;
+    if (!reportPath.empty() && IsBinaryReportFile(reportPath)) {
+        if (!reader.Open(reportPath)) {
+            std::cerr << "crash_symbolizer: " << reader.Error() << std::endl;
+            return 1;
+        }
+        text = BinaryReportToText(reader);
+    }
+    else if (!reportPath.empty()) {
+        std::ifstream file(reportPath);
+        if (!file) {
+            std::cerr << "crash_symbolizer: cannot open " << reportPath << std::endl;
+            return 1;
+        }
+        text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    else {
+        text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        if (IsBinaryReport(text.data(), text.size())) {
+            std::vector<uint64_t> aligned((text.size() + 7) / 8);  // Records are read in place
+            memcpy(aligned.data(), text.data(), text.size());
+            if (!reader.Open(aligned.data(), text.size())) {
+                std::cerr << "crash_symbolizer: " << reader.Error() << std::endl;
+                return 1;
+            }
+            text = BinaryReportToText(reader);
+        }
+    }
+    std::istringstream input(text);
+
+    // Module lines follow the frames that use them, so read the whole input first. A log may
+    // hold several reports, each numbering its modules from 0; frames are symbolized against
+    // the module list that ends their report.
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line);) {
+        lines.push_back(line);
+    }
+    std::map<int, ReportModule> modules;
+    size_t begin = 0;
+    bool inModuleList = false;
+    for (size_t i = 0; i <= lines.size(); i++) {
+        int index = 0;
+        ReportModule module;
+        bool moduleLine = i < lines.size() && inModuleList && ParseModuleLine(lines[i], index, module);
+        if (i == lines.size() || (inModuleList && !moduleLine)) {
+            PrintReport(lines, begin, i, modules, debugDirs);
+            modules.clear();
+            begin = i;
+            inModuleList = false;
+        }
+        if (moduleLine) {
+            modules[index] = std::move(module);
+        }
+        else if (i < lines.size() && lines[i] == "Modules:") {
+            inModuleList = true;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,847 @@
+#include "dwarf_unwinder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// DW_EH_PE_* pointer encodings
+constexpr uint8_t kEncodingOmit = 0xff;
+constexpr uint8_t kEncodingFormatMask = 0x0f;
+constexpr uint8_t kEncodingApplicationMask = 0x70;
+constexpr uint8_t kEncodingAbsolute = 0x00;
+constexpr uint8_t kEncodingUleb128 = 0x01;
+constexpr uint8_t kEncodingUdata2 = 0x02;
+constexpr uint8_t kEncodingUdata4 = 0x03;
+constexpr uint8_t kEncodingUdata8 = 0x04;
+constexpr uint8_t kEncodingSleb128 = 0x09;
+constexpr uint8_t kEncodingSdata2 = 0x0a;
+constexpr uint8_t kEncodingSdata4 = 0x0b;
+constexpr uint8_t kEncodingSdata8 = 0x0c;
+constexpr uint8_t kEncodingPcRelative = 0x10;
+constexpr uint8_t kEncodingDataRelative = 0x30;
+constexpr uint8_t kHeaderTableEncoding = kEncodingDataRelative | kEncodingSdata4;
+
+// DW_CFA_* instructions
+constexpr uint8_t kCfaNop = 0x00;
+constexpr uint8_t kCfaSetLoc = 0x01;
+constexpr uint8_t kCfaAdvanceLoc1 = 0x02;
+constexpr uint8_t kCfaAdvanceLoc2 = 0x03;
+constexpr uint8_t kCfaAdvanceLoc4 = 0x04;
+constexpr uint8_t kCfaOffsetExtended = 0x05;
+constexpr uint8_t kCfaRestoreExtended = 0x06;
+constexpr uint8_t kCfaUndefined = 0x07;
+constexpr uint8_t kCfaSameValue = 0x08;
+constexpr uint8_t kCfaRegister = 0x09;
+constexpr uint8_t kCfaRememberState = 0x0a;
+constexpr uint8_t kCfaRestoreState = 0x0b;
+constexpr uint8_t kCfaDefCfa = 0x0c;
+constexpr uint8_t kCfaDefCfaRegister = 0x0d;
+constexpr uint8_t kCfaDefCfaOffset = 0x0e;
+constexpr uint8_t kCfaDefCfaExpression = 0x0f;
+constexpr uint8_t kCfaExpression = 0x10;
+constexpr uint8_t kCfaOffsetExtendedSf = 0x11;
+constexpr uint8_t kCfaDefCfaSf = 0x12;
+constexpr uint8_t kCfaDefCfaOffsetSf = 0x13;
+constexpr uint8_t kCfaValOffset = 0x14;
+constexpr uint8_t kCfaValOffsetSf = 0x15;
+constexpr uint8_t kCfaValExpression = 0x16;
+constexpr uint8_t kCfaNegateRaState = 0x2d;  // AArch64 pointer authentication (SPARC window save)
+constexpr uint8_t kCfaGnuArgsSize = 0x2e;
+constexpr uint8_t kCfaGnuNegativeOffsetExtended = 0x2f;
+constexpr uint8_t kCfaAdvanceLoc = 0x40;  // Primary opcodes, operand in the low 6 bits
+constexpr uint8_t kCfaOffset = 0x80;
+constexpr uint8_t kCfaRestore = 0xc0;
+
+constexpr int kMaxRememberedRows = 4;
+constexpr int kFramePointerSampleSize = 64;
+constexpr int kRowCacheBits = 9;  // 512 slots
+
+#if defined(__x86_64__)
+constexpr int64_t kEntryCfaOffset = 8;  // The call pushed the return address
+#else
+constexpr int64_t kEntryCfaOffset = 0;
+#endif
+#if defined(__aarch64__)
+constexpr uintptr_t kAarch64AddressMask = 0x0000ffffffffffffull;  // Drops a pointer authentication code
+#endif
+
+// Bounds-checked cursor over call frame information in a loaded module
+class CfiCursor {
+public:
+    CfiCursor(const uint8_t* position, const uint8_t* end) : position_(position), end_(end) {}
+
+    const uint8_t* Position() const { return position_; }
+    const uint8_t* End() const { return end_; }
+    bool AtEnd() const { return position_ >= end_; }
+
+    bool Skip(uint64_t size) {
+        if (size > Remaining()) {
+            return false;
+        }
+        position_ += size;
+        return true;
+    }
+
+    template <typename T>
+    bool Fixed(T& value) {
+        if (sizeof(T) > Remaining()) {
+            return false;
+        }
+        memcpy(&value, position_, sizeof(T));
+        position_ += sizeof(T);
+        return true;
+    }
+
+    bool Uleb(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && position_ < end_; shift += 7) {
+            uint8_t byte = *position_++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Sleb(int64_t& value) {
+        uint64_t result = 0;
+        int shift = 0;
+        while (shift < 64 && position_ < end_) {
+            uint8_t byte = *position_++;
+            result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80)) {
+                if (shift < 64 && (byte & 0x40)) {
+                    result |= ~0ull << shift;
+                }
+                value = static_cast<int64_t>(result);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Reads a pointer in a DW_EH_PE encoding. Indirect pointers are returned unresolved.
+    bool Pointer(uint8_t encoding, uintptr_t dataBase, uintptr_t& value) {
+        uintptr_t field = reinterpret_cast<uintptr_t>(position_);
+        uint64_t raw = 0;
+        bool ok = false;
+        switch (encoding & kEncodingFormatMask) {
+        case kEncodingAbsolute: { uintptr_t v; ok = Fixed(v); raw = v; break; }
+        case kEncodingUleb128: ok = Uleb(raw); break;
+        case kEncodingUdata2: { uint16_t v; ok = Fixed(v); raw = v; break; }
+        case kEncodingUdata4: { uint32_t v; ok = Fixed(v); raw = v; break; }
+        case kEncodingUdata8: ok = Fixed(raw); break;
+        case kEncodingSleb128: { int64_t v; ok = Sleb(v); raw = static_cast<uint64_t>(v); break; }
+        case kEncodingSdata2: { int16_t v; ok = Fixed(v); raw = static_cast<uint64_t>(static_cast<int64_t>(v)); break; }
+        case kEncodingSdata4: { int32_t v; ok = Fixed(v); raw = static_cast<uint64_t>(static_cast<int64_t>(v)); break; }
+        case kEncodingSdata8: { int64_t v; ok = Fixed(v); raw = static_cast<uint64_t>(v); break; }
+        default: return false;
+        }
+        if (!ok) {
+            return false;
+        }
+        switch (encoding & kEncodingApplicationMask) {
+        case 0:
+            break;
+        case kEncodingPcRelative:
+            raw += field;
+            break;
+        case kEncodingDataRelative:
+            if (dataBase == 0) {
+                return false;
+            }
+            raw += dataBase;
+            break;
+        default:
+            return false;  // textrel, funcrel and aligned do not occur in .eh_frame on Linux
+        }
+        value = static_cast<uintptr_t>(raw);
+        return true;
+    }
+
+private:
+    size_t Remaining() const { return position_ < end_ ? static_cast<size_t>(end_ - position_) : 0; }
+
+    const uint8_t* position_;
+    const uint8_t* end_;
+};
+
+struct CieInfo {
+    uint64_t codeAlignment;
+    int64_t dataAlignment;
+    uint64_t returnAddressRegister;
+    uint8_t fdeEncoding;
+    bool hasAugmentationData;
+    bool signalFrame;  // 'S': the frame of a signal trampoline
+    const uint8_t* instructions;
+    const uint8_t* instructionsEnd;
+};
+
+struct FdeInfo {
+    uintptr_t pcBegin;
+    uintptr_t pcEnd;
+    const uint8_t* instructions;
+    const uint8_t* instructionsEnd;
+    CieInfo cie;
+};
+
+enum class RuleKind : uint8_t {
+    Unspecified,  // Not mentioned: keeps the callee's value, like libgcc does
+    Undefined,
+    SameValue,
+    Offset,       // Saved at CFA + value
+    ValOffset,    // Is CFA + value
+    Register,     // Saved in register value
+    Expression,   // DWARF expression, not evaluated
+};
+
+struct RegisterRule {
+    RuleKind kind;
+    int64_t value;
+};
+
+struct FrameRow {
+    int64_t cfaRegister;
+    int64_t cfaOffset;
+    uint64_t returnAddressRegister;
+    bool cfaExpression;
+    bool returnAddressSigned;
+    bool signalFrame;
+    RegisterRule rules[kUnwindRegisterCount];
+};
+
+// The rules of one row that differ from "unspecified", as the unwinder applies and caches them
+struct PackedRule {
+    uint8_t reg;
+    RuleKind kind;
+    int32_t value;
+};
+
+struct PackedRow {
+    uintptr_t pc;  // Cache key: the looked-up program counter
+    uint64_t epoch;
+    int64_t cfaOffset;
+    int16_t cfaRegister;
+    uint8_t returnAddressRegister;
+    uint8_t flags;
+    uint8_t ruleCount;
+    PackedRule rules[kUnwindRegisterCount];
+};
+
+constexpr uint8_t kRowCfaExpression = 1;
+constexpr uint8_t kRowReturnAddressSigned = 2;
+constexpr uint8_t kRowSignalFrame = 4;
+constexpr size_t kPackedHeaderWords = offsetof(PackedRow, rules) / sizeof(uint64_t);
+constexpr size_t kPackedRowWords = sizeof(PackedRow) / sizeof(uint64_t);
+static_assert(sizeof(PackedRule) == sizeof(uint64_t) && offsetof(PackedRow, rules) % sizeof(uint64_t) == 0,
+    "Packed rows are copied word by word, header first");
+
+// Seqlock slot: the sequence is odd while a writer fills the words
+struct RowCacheSlot {
+    uint64_t sequence;
+    uint64_t words[kPackedRowWords];
+};
+
+RowCacheSlot rowCache[1 << kRowCacheBits];
+uint64_t rowCacheEpoch = 1;  // Bumped when the module map changes; older entries miss
+
+// Length field of a CIE or FDE; returns the cursor over the entry's contents
+bool OpenEntry(const uint8_t* entry, const uint8_t* limit, CfiCursor& contents, bool& is64) {
+    CfiCursor cursor(entry, limit);
+    uint32_t length32 = 0;
+    if (!cursor.Fixed(length32) || length32 == 0) {
+        return false;
+    }
+    uint64_t length = length32;
+    is64 = length32 == 0xffffffff;
+    if (is64 && !cursor.Fixed(length)) {
+        return false;
+    }
+    const uint8_t* start = cursor.Position();
+    if (!cursor.Skip(length)) {
+        return false;
+    }
+    contents = CfiCursor(start, start + length);
+    return true;
+}
+
+bool ParseCie(const uint8_t* entry, const uint8_t* limit, CieInfo& cie) {
+    CfiCursor cursor(nullptr, nullptr);
+    bool is64 = false;
+    if (!OpenEntry(entry, limit, cursor, is64)) {
+        return false;
+    }
+    const uint8_t* contentsEnd = cursor.End();
+    uint64_t id = 0;
+    if (is64) {
+        cursor.Fixed(id);
+    }
+    else {
+        uint32_t id32 = 1;
+        cursor.Fixed(id32);
+        id = id32;
+    }
+    uint8_t version = 0;
+    if (id != 0 || !cursor.Fixed(version) || (version != 1 && version != 3 && version != 4)) {
+        return false;
+    }
+
+    const char* augmentation = reinterpret_cast<const char*>(cursor.Position());
+    size_t augmentationLength = strnlen(augmentation, static_cast<size_t>(contentsEnd - cursor.Position()));
+    if (!cursor.Skip(augmentationLength + 1)) {
+        return false;
+    }
+    if (augmentation[0] == 'e' && augmentation[1] == 'h' && !cursor.Skip(sizeof(uintptr_t))) {
+        return false;
+    }
+    if (version == 4) {
+        uint8_t addressSize = 0;
+        uint8_t segmentSize = 0;
+        if (!cursor.Fixed(addressSize) || !cursor.Fixed(segmentSize)) {
+            return false;
+        }
+    }
+    if (!cursor.Uleb(cie.codeAlignment) || !cursor.Sleb(cie.dataAlignment)) {
+        return false;
+    }
+    if (version == 1) {
+        uint8_t reg = 0;
+        if (!cursor.Fixed(reg)) {
+            return false;
+        }
+        cie.returnAddressRegister = reg;
+    }
+    else if (!cursor.Uleb(cie.returnAddressRegister)) {
+        return false;
+    }
+
+    cie.fdeEncoding = kEncodingAbsolute;
+    cie.signalFrame = false;
+    cie.hasAugmentationData = augmentation[0] == 'z';
+    if (cie.hasAugmentationData) {
+        uint64_t dataLength = 0;
+        if (!cursor.Uleb(dataLength)) {
+            return false;
+        }
+        const uint8_t* dataEnd = cursor.Position() + dataLength;
+        if (dataEnd > contentsEnd) {
+            return false;
+        }
+        for (const char* c = augmentation + 1; *c; c++) {
+            if (*c == 'R') {
+                cursor.Fixed(cie.fdeEncoding);
+            }
+            else if (*c == 'P') {
+                uint8_t encoding = 0;
+                uintptr_t personality = 0;
+                if (!cursor.Fixed(encoding) || !cursor.Pointer(encoding, 0, personality)) {
+                    break;  // Only the position matters, and dataEnd gives it
+                }
+            }
+            else if (*c == 'L') {
+                cursor.Skip(1);
+            }
+            else if (*c == 'S') {
+                cie.signalFrame = true;
+            }
+            else if (*c != 'B') {
+                break;
+            }
+        }
+        cursor = CfiCursor(dataEnd, contentsEnd);
+    }
+    else if (augmentation[0] != '\0') {
+        return false;  // Unknown augmentation without a length: cannot find the instructions
+    }
+    cie.instructions = cursor.Position();
+    cie.instructionsEnd = contentsEnd;
+    return true;
+}
+
+bool ParseFde(const uint8_t* entry, const ModuleInfo& module, FdeInfo& fde) {
+    const uint8_t* moduleStart = reinterpret_cast<const uint8_t*>(module.start);
+    const uint8_t* moduleEnd = reinterpret_cast<const uint8_t*>(module.end);
+    CfiCursor cursor(nullptr, nullptr);
+    bool is64 = false;
+    if (entry < moduleStart || !OpenEntry(entry, moduleEnd, cursor, is64)) {
+        return false;
+    }
+    const uint8_t* pointerField = cursor.Position();
+    uint64_t ciePointer = 0;
+    if (is64) {
+        cursor.Fixed(ciePointer);
+    }
+    else {
+        uint32_t pointer32 = 0;
+        cursor.Fixed(pointer32);
+        ciePointer = pointer32;
+    }
+    if (ciePointer == 0 || ciePointer > static_cast<uint64_t>(pointerField - moduleStart)) {
+        return false;  // A CIE, or a pointer out of the module
+    }
+    if (!ParseCie(pointerField - ciePointer, moduleEnd, fde.cie)) {
+        return false;
+    }
+    uintptr_t range = 0;
+    if (!cursor.Pointer(fde.cie.fdeEncoding, 0, fde.pcBegin) ||
+        !cursor.Pointer(fde.cie.fdeEncoding & kEncodingFormatMask, 0, range)) {
+        return false;
+    }
+    fde.pcEnd = fde.pcBegin + range;
+    if (fde.cie.hasAugmentationData) {
+        uint64_t dataLength = 0;
+        if (!cursor.Uleb(dataLength) || !cursor.Skip(dataLength)) {
+            return false;
+        }
+    }
+    fde.instructions = cursor.Position();
+    fde.instructionsEnd = cursor.End();
+    return true;
+}
+
+// The .eh_frame_hdr search table: { initial location, FDE address } pairs sorted by location
+bool OpenSearchTable(const ModuleInfo& module, const uint8_t*& header, const uint8_t*& table, uintptr_t& count) {
+    if (module.ehFrameHdr == 0) {
+        return false;
+    }
+    header = reinterpret_cast<const uint8_t*>(module.ehFrameHdr);
+    CfiCursor cursor(header, reinterpret_cast<const uint8_t*>(module.end));
+    uint8_t version = 0;
+    uint8_t frameEncoding = 0;
+    uint8_t countEncoding = 0;
+    uint8_t tableEncoding = 0;
+    uintptr_t ehFrame = 0;
+    if (!cursor.Fixed(version) || !cursor.Fixed(frameEncoding) || !cursor.Fixed(countEncoding) ||
+        !cursor.Fixed(tableEncoding) || version != 1 || !cursor.Pointer(frameEncoding, module.ehFrameHdr, ehFrame)) {
+        return false;
+    }
+    // Without the table the FDE could only be found by a linear scan of .eh_frame
+    if (countEncoding == kEncodingOmit || tableEncoding != kHeaderTableEncoding ||
+        !cursor.Pointer(countEncoding, module.ehFrameHdr, count)) {
+        return false;
+    }
+    table = cursor.Position();
+    return count > 0 && cursor.Skip(static_cast<uint64_t>(count) * 2 * sizeof(int32_t));
+}
+
+bool FdeAt(const ModuleInfo& module, const uint8_t* header, const uint8_t* table, uintptr_t index, FdeInfo& fde) {
+    int32_t fdeOffset = 0;
+    memcpy(&fdeOffset, table + index * 2 * sizeof(int32_t) + sizeof(int32_t), sizeof(fdeOffset));
+    return ParseFde(header + fdeOffset, module, fde);
+}
+
+bool FindFde(const ModuleInfo& module, uintptr_t pc, FdeInfo& fde) {
+    const uint8_t* header = nullptr;
+    const uint8_t* table = nullptr;
+    uintptr_t count = 0;
+    if (!OpenSearchTable(module, header, table, count)) {
+        return false;
+    }
+    uintptr_t low = 0;
+    uintptr_t high = count;
+    while (low < high) {  // First entry starting above pc
+        uintptr_t middle = low + (high - low) / 2;
+        int32_t location = 0;
+        memcpy(&location, table + middle * 2 * sizeof(int32_t), sizeof(location));
+        if (reinterpret_cast<uintptr_t>(header) + location <= pc) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low > 0 && FdeAt(module, header, table, low - 1, fde) && pc >= fde.pcBegin && pc < fde.pcEnd;
+}
+
+void SetRule(FrameRow& row, uint64_t reg, RuleKind kind, int64_t value) {
+    if (reg < static_cast<uint64_t>(kUnwindRegisterCount)) {
+        row.rules[reg] = { kind, value };
+    }
+}
+
+// Runs CFA instructions until the row for pc is reached. initial is the row after the CIE
+// instructions, which DW_CFA_restore goes back to.
+bool Execute(const uint8_t* begin, const uint8_t* end, const FdeInfo& fde, uintptr_t pc,
+    const FrameRow* initial, FrameRow& row) {
+    const CieInfo& cie = fde.cie;
+    CfiCursor cursor(begin, end);
+    FrameRow remembered[kMaxRememberedRows];
+    int rememberedCount = 0;
+    uintptr_t location = fde.pcBegin;
+
+    while (!cursor.AtEnd()) {
+        uint8_t opcode = 0;
+        cursor.Fixed(opcode);
+        uint8_t operand = opcode & 0x3f;
+        uint64_t reg = 0;
+        uint64_t unsignedValue = 0;
+        int64_t signedValue = 0;
+        uint64_t delta = 0;
+        bool ok = true;
+
+        switch (opcode & 0xc0) {
+        case kCfaAdvanceLoc:
+            delta = operand;
+            break;
+        case kCfaOffset:
+            ok = cursor.Uleb(unsignedValue);
+            SetRule(row, operand, RuleKind::Offset, static_cast<int64_t>(unsignedValue) * cie.dataAlignment);
+            break;
+        case kCfaRestore:
+            if (operand < kUnwindRegisterCount) {
+                row.rules[operand] = initial ? initial->rules[operand] : RegisterRule{ RuleKind::Unspecified, 0 };
+            }
+            break;
+        default:
+            switch (opcode) {
+            case kCfaNop:
+                break;
+            case kCfaSetLoc: {
+                uintptr_t newLocation = 0;
+                ok = cursor.Pointer(cie.fdeEncoding, 0, newLocation);
+                if (ok && newLocation > pc) {
+                    return true;
+                }
+                location = newLocation;
+                break;
+            }
+            case kCfaAdvanceLoc1: { uint8_t v = 0; ok = cursor.Fixed(v); delta = v; break; }
+            case kCfaAdvanceLoc2: { uint16_t v = 0; ok = cursor.Fixed(v); delta = v; break; }
+            case kCfaAdvanceLoc4: { uint32_t v = 0; ok = cursor.Fixed(v); delta = v; break; }
+            case kCfaOffsetExtended:
+                ok = cursor.Uleb(reg) && cursor.Uleb(unsignedValue);
+                SetRule(row, reg, RuleKind::Offset, static_cast<int64_t>(unsignedValue) * cie.dataAlignment);
+                break;
+            case kCfaOffsetExtendedSf:
+                ok = cursor.Uleb(reg) && cursor.Sleb(signedValue);
+                SetRule(row, reg, RuleKind::Offset, signedValue * cie.dataAlignment);
+                break;
+            case kCfaGnuNegativeOffsetExtended:
+                ok = cursor.Uleb(reg) && cursor.Uleb(unsignedValue);
+                SetRule(row, reg, RuleKind::Offset, -static_cast<int64_t>(unsignedValue) * cie.dataAlignment);
+                break;
+            case kCfaValOffset:
+                ok = cursor.Uleb(reg) && cursor.Uleb(unsignedValue);
+                SetRule(row, reg, RuleKind::ValOffset, static_cast<int64_t>(unsignedValue) * cie.dataAlignment);
+                break;
+            case kCfaValOffsetSf:
+                ok = cursor.Uleb(reg) && cursor.Sleb(signedValue);
+                SetRule(row, reg, RuleKind::ValOffset, signedValue * cie.dataAlignment);
+                break;
+            case kCfaRestoreExtended:
+                ok = cursor.Uleb(reg);
+                if (reg < static_cast<uint64_t>(kUnwindRegisterCount)) {
+                    row.rules[reg] = initial ? initial->rules[reg] : RegisterRule{ RuleKind::Unspecified, 0 };
+                }
+                break;
+            case kCfaUndefined:
+                ok = cursor.Uleb(reg);
+                SetRule(row, reg, RuleKind::Undefined, 0);
+                break;
+            case kCfaSameValue:
+                ok = cursor.Uleb(reg);
+                SetRule(row, reg, RuleKind::SameValue, 0);
+                break;
+            case kCfaRegister:
+                ok = cursor.Uleb(reg) && cursor.Uleb(unsignedValue);
+                SetRule(row, reg, RuleKind::Register, static_cast<int64_t>(unsignedValue));
+                break;
+            case kCfaRememberState:
+                if (rememberedCount == kMaxRememberedRows) {
+                    return false;
+                }
+                remembered[rememberedCount++] = row;
+                break;
+            case kCfaRestoreState:
+                if (rememberedCount == 0) {
+                    return false;
+                }
+                row = remembered[--rememberedCount];
+                break;
+            case kCfaDefCfa:
+                ok = cursor.Uleb(reg) && cursor.Uleb(unsignedValue);
+                row.cfaRegister = static_cast<int64_t>(reg);
+                row.cfaOffset = static_cast<int64_t>(unsignedValue);
+                row.cfaExpression = false;
+                break;
+            case kCfaDefCfaSf:
+                ok = cursor.Uleb(reg) && cursor.Sleb(signedValue);
+                row.cfaRegister = static_cast<int64_t>(reg);
+                row.cfaOffset = signedValue * cie.dataAlignment;
+                row.cfaExpression = false;
+                break;
+            case kCfaDefCfaRegister:
+                ok = cursor.Uleb(reg);
+                row.cfaRegister = static_cast<int64_t>(reg);
+                row.cfaExpression = false;
+                break;
+            case kCfaDefCfaOffset:
+                ok = cursor.Uleb(unsignedValue);
+                row.cfaOffset = static_cast<int64_t>(unsignedValue);
+                break;
+            case kCfaDefCfaOffsetSf:
+                ok = cursor.Sleb(signedValue);
+                row.cfaOffset = signedValue * cie.dataAlignment;
+                break;
+            case kCfaDefCfaExpression:
+                ok = cursor.Uleb(unsignedValue) && cursor.Skip(unsignedValue);
+                row.cfaExpression = true;
+                break;
+            case kCfaExpression:
+            case kCfaValExpression:
+                ok = cursor.Uleb(reg) && cursor.Uleb(unsignedValue) && cursor.Skip(unsignedValue);
+                SetRule(row, reg, RuleKind::Expression, 0);
+                break;
+            case kCfaGnuArgsSize:
+                ok = cursor.Uleb(unsignedValue);
+                break;
+            case kCfaNegateRaState:
+                row.returnAddressSigned = !row.returnAddressSigned;
+                break;
+            default:
+                return false;
+            }
+        }
+        if (!ok) {
+            return false;
+        }
+        if (delta != 0) {
+            uintptr_t newLocation = location + delta * cie.codeAlignment;
+            if (newLocation > pc) {
+                return true;
+            }
+            location = newLocation;
+        }
+    }
+    return true;
+}
+
+// Unwind rules in effect at pc
+bool ComputeRow(const FdeInfo& fde, uintptr_t pc, FrameRow& row) {
+    row.cfaRegister = -1;
+    row.cfaOffset = 0;
+    row.returnAddressRegister = fde.cie.returnAddressRegister;
+    row.cfaExpression = false;
+    row.returnAddressSigned = false;
+    row.signalFrame = fde.cie.signalFrame;
+    for (RegisterRule& rule : row.rules) {
+        rule = { RuleKind::Unspecified, 0 };
+    }
+    if (!Execute(fde.cie.instructions, fde.cie.instructionsEnd, fde, UINTPTR_MAX, nullptr, row)) {
+        return false;
+    }
+    FrameRow initial = row;
+    return Execute(fde.instructions, fde.instructionsEnd, fde, pc, &initial, row);
+}
+
+// Fails only for rows no step could use: a CFA or return address column out of range
+bool PackRow(const FrameRow& row, uintptr_t pc, uint64_t epoch, PackedRow& packed) {
+    if (row.cfaRegister < 0 || row.cfaRegister >= kUnwindRegisterCount ||
+        row.returnAddressRegister >= static_cast<uint64_t>(kUnwindRegisterCount)) {
+        return false;
+    }
+    packed.pc = pc;
+    packed.epoch = epoch;
+    packed.cfaOffset = row.cfaOffset;
+    packed.cfaRegister = static_cast<int16_t>(row.cfaRegister);
+    packed.returnAddressRegister = static_cast<uint8_t>(row.returnAddressRegister);
+    packed.flags = (row.cfaExpression ? kRowCfaExpression : 0) | (row.returnAddressSigned ? kRowReturnAddressSigned : 0) |
+        (row.signalFrame ? kRowSignalFrame : 0);
+    packed.ruleCount = 0;
+    for (int reg = 0; reg < kUnwindRegisterCount; reg++) {
+        const RegisterRule& rule = row.rules[reg];
+        if (rule.kind == RuleKind::Unspecified) {
+            continue;
+        }
+        if (rule.value < INT32_MIN || rule.value > INT32_MAX) {
+            return false;
+        }
+        packed.rules[packed.ruleCount++] = { static_cast<uint8_t>(reg), rule.kind, static_cast<int32_t>(rule.value) };
+    }
+    return true;
+}
+
+RowCacheSlot& CacheSlot(uintptr_t pc) {
+    return rowCache[(static_cast<uint64_t>(pc) * 0x9e3779b97f4a7c15ull) >> (64 - kRowCacheBits)];
+}
+
+bool LoadCachedRow(uintptr_t pc, uint64_t epoch, PackedRow& packed) {
+    RowCacheSlot& slot = CacheSlot(pc);
+    uint64_t sequence = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1) {
+        return false;
+    }
+    uint64_t words[kPackedRowWords];
+    for (size_t i = 0; i < kPackedHeaderWords; i++) {
+        words[i] = __atomic_load_n(&slot.words[i], __ATOMIC_RELAXED);
+    }
+    memcpy(&packed, words, kPackedHeaderWords * sizeof(uint64_t));
+    if (packed.pc != pc || packed.epoch != epoch) {
+        return false;
+    }
+    // Only the rules the row has; a torn count is caught by the sequence check
+    size_t ruleCount = packed.ruleCount < kUnwindRegisterCount ? packed.ruleCount : kUnwindRegisterCount;
+    for (size_t i = kPackedHeaderWords; i < kPackedHeaderWords + ruleCount; i++) {
+        words[i] = __atomic_load_n(&slot.words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != sequence) {
+        return false;  // Overwritten while we copied it
+    }
+    memcpy(packed.rules, words + kPackedHeaderWords, ruleCount * sizeof(uint64_t));
+    packed.ruleCount = static_cast<uint8_t>(ruleCount);
+    return true;
+}
+
+void StoreCachedRow(const PackedRow& packed) {
+    // Another thread (a parallel thread dump) may be filling the slot; leave it to that one
+    RowCacheSlot& slot = CacheSlot(packed.pc);
+    uint64_t sequence = __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED);
+    if ((sequence & 1) ||
+        !__atomic_compare_exchange_n(&slot.sequence, &sequence, sequence + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    uint64_t words[kPackedRowWords];
+    size_t wordCount = kPackedHeaderWords + packed.ruleCount;
+    memcpy(words, &packed, wordCount * sizeof(uint64_t));
+    for (size_t i = 0; i < wordCount; i++) {
+        __atomic_store_n(&slot.words[i], words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot.sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Moves state to the caller using the rules of its frame
+bool ApplyRow(const PackedRow& row, UnwindState& state, UnwindMemory& memory) {
+    uintptr_t base = 0;
+    if ((row.flags & kRowCfaExpression) || !state.Get(row.cfaRegister, base)) {
+        return false;
+    }
+    uintptr_t cfa = base + static_cast<uintptr_t>(row.cfaOffset);
+    uintptr_t sp = 0;
+    bool signalFrame = (row.flags & kRowSignalFrame) != 0;
+    if (state.Get(kDwarfStackPointer, sp) && cfa <= sp && !signalFrame) {
+        return false;  // The caller's frame must be above this one
+    }
+
+    // Only the registers with a rule change
+    UnwindState next = state;
+    for (int i = 0; i < row.ruleCount; i++) {
+        const PackedRule& rule = row.rules[i];
+        uintptr_t value = 0;
+        switch (rule.kind) {
+        case RuleKind::Unspecified:
+        case RuleKind::SameValue:
+            break;
+        case RuleKind::Offset:
+            if (!memory.ReadWord(cfa + static_cast<uintptr_t>(static_cast<intptr_t>(rule.value)), value)) {
+                return false;
+            }
+            next.Set(rule.reg, value);
+            break;
+        case RuleKind::ValOffset:
+            next.Set(rule.reg, cfa + static_cast<uintptr_t>(static_cast<intptr_t>(rule.value)));
+            break;
+        case RuleKind::Register:
+            if (state.Get(rule.value, value)) {
+                next.Set(rule.reg, value);
+            }
+            else {
+                next.Clear(rule.reg);
+            }
+            break;
+        case RuleKind::Undefined:
+            if (rule.reg == row.returnAddressRegister) {
+                return false;  // Outermost frame (_start, clone)
+            }
+            next.Clear(rule.reg);
+            break;
+        case RuleKind::Expression:
+            next.Clear(rule.reg);
+            break;
+        }
+    }
+
+    uintptr_t returnAddress = 0;
+    if (!next.Get(row.returnAddressRegister, returnAddress)) {
+        return false;
+    }
+#if defined(__aarch64__)
+    if (row.flags & kRowReturnAddressSigned) {
+        returnAddress &= kAarch64AddressMask;
+    }
+#endif
+    if (returnAddress == 0) {
+        return false;
+    }
+    next.Set(kDwarfStackPointer, cfa);  // The CFA is the caller's stack pointer at the call
+    next.pc = returnAddress;
+    next.exactPc = signalFrame;
+    next.stackLimit = cfa;
+    state = next;
+    return true;
+}
+
+}  // namespace
+
+bool DwarfUnwinder::Step(UnwindState& state, UnwindMemory& memory, const ModuleLookup& modules) const {
+    // A return address may be the first byte after the call's function; look up the call
+    uintptr_t pc = state.exactPc ? state.pc : state.pc - 1;
+    // Deep stacks keep returning to the same call sites: their rows come from the cache
+    // without searching .eh_frame_hdr or running any CFA instructions
+    uint64_t epoch = __atomic_load_n(&rowCacheEpoch, __ATOMIC_ACQUIRE);
+    PackedRow packed;
+    if (!LoadCachedRow(pc, epoch, packed)) {
+        const ModuleInfo* module = modules.Find(pc);
+        FdeInfo fde;
+        FrameRow row;
+        if (!module || !FindFde(*module, pc, fde) || !ComputeRow(fde, pc, row) || !PackRow(row, pc, epoch, packed)) {
+            return false;
+        }
+        StoreCachedRow(packed);
+    }
+    return ApplyRow(packed, state, memory);
+}
+
+void InvalidateDwarfUnwindCache() {
+    __atomic_add_fetch(&rowCacheEpoch, 1, __ATOMIC_ACQ_REL);
+}
+
+bool ModuleUsesFramePointers(const ModuleInfo& module) {
+    const uint8_t* header = nullptr;
+    const uint8_t* table = nullptr;
+    uintptr_t count = 0;
+    if (!OpenSearchTable(module, header, table, count)) {
+        return false;
+    }
+    // Look at the rules in the middle of each sampled function, past its prologue. Functions
+    // that never move the CFA (leaves) say nothing either way.
+    uintptr_t step = count > kFramePointerSampleSize ? count / kFramePointerSampleSize : 1;
+    int framed = 0;
+    int unframed = 0;
+    for (uintptr_t i = 0; i < count; i += step) {
+        FdeInfo fde;
+        FrameRow row;
+        if (!FdeAt(module, header, table, i, fde) || !ComputeRow(fde, fde.pcBegin + (fde.pcEnd - fde.pcBegin) / 2, row)) {
+            continue;
+        }
+        bool savesFrameRecord = false;
+#if defined(__aarch64__)
+        // GCC keeps the CFA on sp on AArch64; a saved { x29, x30 } pair marks the frame record
+        const RegisterRule& fp = row.rules[kDwarfFramePointer];
+        const RegisterRule& lr = row.rules[kDwarfReturnAddress];
+        savesFrameRecord = fp.kind == RuleKind::Offset && lr.kind == RuleKind::Offset && lr.value == fp.value + 8;
+#endif
+        if (row.cfaRegister == kDwarfFramePointer || savesFrameRecord) {
+            framed++;
+        }
+        else if (row.cfaRegister == kDwarfStackPointer && row.cfaOffset != kEntryCfaOffset) {
+            unframed++;
+        }
+    }
+    return framed > 0 && framed * 4 >= (framed + unframed) * 3;
+}
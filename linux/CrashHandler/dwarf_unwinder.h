@@ -0,0 +1,28 @@
+#pragma once
+
+#include "unwinder.h"
+
+// Unwinder driven by DWARF call frame information (.eh_frame).
+//
+// The function's FDE is found with a binary search of the module's .eh_frame_hdr table
+// (ModuleInfo::ehFrameHdr), and the CIE and FDE instructions are run up to the program
+// counter to get the rules for the canonical frame address (CFA) and the saved registers.
+// Rules given as DWARF expressions are not evaluated; such frames (mostly PLT stubs and
+// hand-written assembly) fail the step so the auto walker can try the frame pointer.
+//
+// The resulting rows are kept in a process-wide cache keyed by program counter (fixed size,
+// seqlock per slot, no allocation), so a return address seen in an earlier walk costs one
+// hash lookup. The CFI is always read from this process's memory.
+class DwarfUnwinder final : public Unwinder {
+public:
+    bool Step(UnwindState& state, UnwindMemory& memory, const ModuleLookup& modules) const override;
+};
+
+// Whether most functions of a module keep a frame pointer, judged from a sample of its FDEs:
+// those that set the CFA relative to the frame pointer register. Called when the module map
+// is refreshed, never from a handler.
+bool ModuleUsesFramePointers(const ModuleInfo& module);
+
+// Drops all cached rows. RefreshModuleMap() calls it when a module went away, since an
+// unloaded module's addresses may be reused by the next one.
+void InvalidateDwarfUnwindCache();
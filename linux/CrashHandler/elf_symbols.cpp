@@ -0,0 +1,189 @@
+#include "elf_symbols.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Read-only view of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat status;
+        if (fstat(fd, &status) == 0 && status.st_size > 0) {
+            void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const uint8_t*>(data);
+                size_ = static_cast<size_t>(status.st_size);
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+    bool Contains(uint64_t offset, uint64_t length) const {
+        return offset <= size_ && length <= size_ - offset;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+void ReadBuildIdNote(const MappedFile& file, const Elf64_Shdr& section, std::vector<uint8_t>& buildId) {
+    uint64_t offset = section.sh_offset;
+    uint64_t end = section.sh_offset + section.sh_size;
+    while (offset + sizeof(Elf64_Nhdr) <= end) {
+        Elf64_Nhdr note;
+        memcpy(&note, file.Data() + offset, sizeof(note));
+        uint64_t nameOffset = offset + sizeof(Elf64_Nhdr);
+        uint64_t descOffset = nameOffset + ((note.n_namesz + 3) & ~3u);
+        uint64_t nextOffset = descOffset + ((note.n_descsz + 3) & ~3u);
+        if (nextOffset > end) {
+            return;
+        }
+        if (note.n_type == NT_GNU_BUILD_ID && note.n_namesz == 4 &&
+            memcmp(file.Data() + nameOffset, "GNU", 4) == 0) {
+            buildId.assign(file.Data() + descOffset, file.Data() + descOffset + note.n_descsz);
+            return;
+        }
+        offset = nextOffset;
+    }
+}
+
+void ReadSymbols(const MappedFile& file, const Elf64_Shdr& symbolSection, const Elf64_Shdr& stringSection,
+    std::vector<ElfSymbol>& symbols) {
+    if (symbolSection.sh_entsize != sizeof(Elf64_Sym)) {
+        return;
+    }
+    const char* strings = reinterpret_cast<const char*>(file.Data() + stringSection.sh_offset);
+    uint64_t count = symbolSection.sh_size / sizeof(Elf64_Sym);
+    for (uint64_t i = 0; i < count; i++) {
+        Elf64_Sym symbol;
+        memcpy(&symbol, file.Data() + symbolSection.sh_offset + i * sizeof(Elf64_Sym), sizeof(symbol));
+        int type = ELF64_ST_TYPE(symbol.st_info);
+        if ((type != STT_FUNC && type != STT_GNU_IFUNC) || symbol.st_value == 0 ||
+            symbol.st_shndx == SHN_UNDEF || symbol.st_name >= stringSection.sh_size) {
+            continue;
+        }
+        const char* name = strings + symbol.st_name;
+        symbols.push_back({ symbol.st_value, symbol.st_size,
+            std::string(name, strnlen(name, stringSection.sh_size - symbol.st_name)) });
+    }
+}
+
+}  // namespace
+
+bool ElfSymbolTable::Load(const std::string& path) {
+    symbols_.clear();
+    buildId_.clear();
+    fileStartAddress_ = 0;
+
+    MappedFile file(path);
+    if (!file.Data() || !file.Contains(0, sizeof(Elf64_Ehdr))) {
+        return false;
+    }
+    Elf64_Ehdr header;
+    memcpy(&header, file.Data(), sizeof(header));
+    if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_shentsize != sizeof(Elf64_Shdr) ||
+        !file.Contains(header.e_shoff, static_cast<uint64_t>(header.e_shnum) * sizeof(Elf64_Shdr))) {
+        return false;
+    }
+
+    if (header.e_phentsize == sizeof(Elf64_Phdr) &&
+        file.Contains(header.e_phoff, static_cast<uint64_t>(header.e_phnum) * sizeof(Elf64_Phdr))) {
+        for (Elf64_Half i = 0; i < header.e_phnum; i++) {
+            Elf64_Phdr segment;
+            memcpy(&segment, file.Data() + header.e_phoff + i * sizeof(Elf64_Phdr), sizeof(segment));
+            if (segment.p_type == PT_LOAD) {
+                fileStartAddress_ = segment.p_vaddr - segment.p_offset;
+                break;
+            }
+        }
+    }
+
+    std::vector<Elf64_Shdr> sections(header.e_shnum);
+    if (header.e_shnum > 0) {
+        memcpy(sections.data(), file.Data() + header.e_shoff, header.e_shnum * sizeof(Elf64_Shdr));
+    }
+
+    for (const Elf64_Shdr& section : sections) {
+        bool inFile = section.sh_type == SHT_NOBITS || file.Contains(section.sh_offset, section.sh_size);
+        if (!inFile) {
+            continue;
+        }
+        if (section.sh_type == SHT_NOTE && buildId_.empty()) {
+            ReadBuildIdNote(file, section, buildId_);
+        }
+        else if ((section.sh_type == SHT_SYMTAB || section.sh_type == SHT_DYNSYM) &&
+            section.sh_link < sections.size()) {
+            const Elf64_Shdr& strings = sections[section.sh_link];
+            if (strings.sh_type == SHT_STRTAB && file.Contains(strings.sh_offset, strings.sh_size)) {
+                ReadSymbols(file, section, strings, symbols_);
+            }
+        }
+    }
+
+    // .symtab and .dynsym overlap and aliases share addresses; keep the largest entry per address
+    std::sort(symbols_.begin(), symbols_.end(), [](const ElfSymbol& a, const ElfSymbol& b) {
+        return a.address != b.address ? a.address < b.address : a.size > b.size;
+    });
+    symbols_.erase(std::unique(symbols_.begin(), symbols_.end(), [](const ElfSymbol& a, const ElfSymbol& b) {
+        return a.address == b.address;
+    }), symbols_.end());
+    return true;
+}
+
+const ElfSymbol* ElfSymbolTable::Find(uint64_t address) const {
+    auto next = std::upper_bound(symbols_.begin(), symbols_.end(), address,
+        [](uint64_t value, const ElfSymbol& symbol) { return value < symbol.address; });
+    if (next == symbols_.begin()) {
+        return nullptr;
+    }
+    const ElfSymbol& symbol = *(next - 1);
+    if (symbol.size != 0 && address >= symbol.address + symbol.size) {
+        return nullptr;
+    }
+    return &symbol;
+}
+
+std::string DemangleSymbol(const std::string& name) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (status != 0 || !demangled) {
+        return name;
+    }
+    std::string result(demangled);
+    free(demangled);
+    return result;
+}
+
+std::string BuildIdToHex(const std::vector<uint8_t>& buildId) {
+    static const char kHexDigits[] = "0123456789abcdef";
+    std::string text;
+    for (uint8_t byte : buildId) {
+        text += kHexDigits[byte >> 4];
+        text += kHexDigits[byte & 0xf];
+    }
+    return text;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Function symbols of an ELF file on disk, read from .symtab and .dynsym.
+// Used away from the crash path (offline symbolizer, symbol cache), so it is free to allocate.
+
+struct ElfSymbol {
+    uint64_t address;  // ELF virtual address; add the module's load bias for the runtime address
+    uint64_t size;
+    std::string name;  // Mangled
+};
+
+class ElfSymbolTable {
+public:
+    // Reads the symbols and build-id of a 64-bit ELF file. Returns false if the file
+    // could not be read or is not a 64-bit ELF object.
+    bool Load(const std::string& path);
+
+    // Function containing the ELF virtual address, or nullptr.
+    const ElfSymbol* Find(uint64_t address) const;
+
+    // Sorted by address, one entry per address
+    const std::vector<ElfSymbol>& Symbols() const { return symbols_; }
+    const std::vector<uint8_t>& BuildId() const { return buildId_; }
+    // Virtual address the start of the file is loaded at (first PT_LOAD); the load bias is
+    // the runtime address of the file's offset-0 mapping minus this
+    uint64_t FileStartAddress() const { return fileStartAddress_; }
+
+private:
+    std::vector<ElfSymbol> symbols_;
+    std::vector<uint8_t> buildId_;
+    uint64_t fileStartAddress_ = 0;
+};
+
+// Demangled C++ name, or the input unchanged if it is not a mangled name
+std::string DemangleSymbol(const std::string& name);
+
+// Lower-case hex string of a build-id, as written in crash reports
+std::string BuildIdToHex(const std::vector<uint8_t>& buildId);
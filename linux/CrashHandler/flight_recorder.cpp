@@ -0,0 +1,166 @@
+#include "flight_recorder.h"
+
+#include <cerrno>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+thread_local FlightRing* flightRing = nullptr;
+std::atomic<bool> flightRecording{ false };
+
+namespace {
+
+FlightRing rings[kMaxFlightRecorderThreads];
+FlightRecorderEntry* pool = nullptr;
+uint64_t ringSize = 0;
+
+// Clock readings at start, against which ticks are turned into nanoseconds
+uint64_t startTicks = 0;
+uint64_t startNanos = 0;
+
+uint64_t MonotonicNanos() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+bool ThreadExited(int32_t threadId) {
+    return syscall(SYS_tgkill, getpid(), threadId, 0) != 0 && errno == ESRCH;
+}
+
+// Takes a free ring or, once there is none, the ring of a thread that has exited
+FlightRing* TakeRing(int32_t threadId) {
+    for (int pass = 0; pass < 2; pass++) {
+        for (FlightRing& ring : rings) {
+            int32_t owner = ring.threadId.load(std::memory_order_relaxed);
+            if ((pass == 0 ? owner == 0 : owner != 0 && ThreadExited(owner)) &&
+                ring.threadId.compare_exchange_strong(owner, threadId)) {
+                return &ring;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Copies the newest perThread whole events of a ring, oldest first
+int CollectRing(const FlightRing& ring, int32_t threadId, FlightEventRecord* events, int maxEvents, int perThread,
+    uint64_t nowTicks, double nanosPerTick) {
+    uint64_t next = __atomic_load_n(&ring.next, __ATOMIC_RELAXED);
+    uint64_t available = next < ring.mask + 1 ? next : ring.mask + 1;
+    uint64_t wanted = available < static_cast<uint64_t>(perThread) ? available : static_cast<uint64_t>(perThread);
+    int count = 0;
+    for (uint64_t position = next - wanted; position < next && count < maxEvents; position++) {
+        const FlightRecorderEntry& entry = ring.entries[position & ring.mask];
+        if (entry.sequence.load(std::memory_order_acquire) != position + 1) {
+            continue;
+        }
+        FlightEventRecord& event = events[count];
+        event = {};
+        event.threadId = threadId;
+        event.eventId = entry.eventId;
+        event.flags = entry.flags;
+        for (int i = 0; i < kFlightEventValues; i++) {
+            event.values[i] = entry.values[i];
+        }
+        uint64_t ticks = entry.ticks;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.sequence.load(std::memory_order_relaxed) != position + 1) {
+            continue;  // Overwritten while we copied it
+        }
+        event.text[kFlightEventTextSize - 1] = '\0';
+        event.ageNanos = nowTicks > ticks ? static_cast<int64_t>(static_cast<double>(nowTicks - ticks) * nanosPerTick) : 0;
+        count++;
+    }
+    return count;
+}
+
+}  // namespace
+
+bool StartFlightRecorder(size_t eventsPerThread) {
+    if (eventsPerThread == 0) {
+        StopFlightRecorder();
+        return true;
+    }
+    if (!pool) {
+        uint64_t size = 1;
+        while (size < eventsPerThread) {
+            size <<= 1;
+        }
+        size_t bytes = sizeof(FlightRecorderEntry) * size * kMaxFlightRecorderThreads;
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+        // Never unmapped: threads keep appending to the rings they claimed
+        pool = static_cast<FlightRecorderEntry*>(memory);
+        ringSize = size;
+        for (int i = 0; i < kMaxFlightRecorderThreads; i++) {
+            rings[i].entries = pool + static_cast<size_t>(i) * size;
+            rings[i].mask = size - 1;
+        }
+        startTicks = FlightRecorderTicks();
+        startNanos = MonotonicNanos();
+    }
+    flightRecording.store(true);
+    return true;
+}
+
+void StopFlightRecorder() {
+    flightRecording.store(false);
+}
+
+FlightRing* ClaimFlightRing() {
+    int32_t threadId = static_cast<int32_t>(syscall(SYS_gettid));
+    FlightRing* ring = TakeRing(threadId);
+    if (!ring) {
+        return nullptr;
+    }
+    // Clear what the previous owner left, so its events are not taken for ours
+    for (uint64_t i = 0; i < ringSize; i++) {
+        ring->entries[i].sequence.store(0, std::memory_order_relaxed);
+    }
+    ring->next = 0;
+    flightRing = ring;
+    return ring;
+}
+
+void RecordFlightText(uint32_t eventId, const char* text) {
+    FlightRing* ring;
+    uint64_t position;
+    FlightRecorderEntry* entry = BeginFlightEntry(ring, position);
+    if (!entry) {
+        return;
+    }
+    entry->eventId = eventId;
+    entry->flags = kFlightEventText;
+    size_t length = 0;
+    while (text && text[length] != '\0' && length < kFlightEventTextSize - 1) {
+        entry->text[length] = text[length];
+        length++;
+    }
+    entry->text[length] = '\0';
+    entry->sequence.store(position + 1, std::memory_order_release);
+}
+
+int CollectFlightEvents(FlightEventRecord* events, int maxEvents, int perThread, int32_t firstThreadId) {
+    if (!pool || perThread <= 0) {
+        return 0;
+    }
+    uint64_t nowTicks = FlightRecorderTicks();
+    uint64_t elapsedTicks = nowTicks - startTicks;
+    uint64_t elapsedNanos = MonotonicNanos() - startNanos;
+    double nanosPerTick = elapsedTicks > 0 ? static_cast<double>(elapsedNanos) / static_cast<double>(elapsedTicks) : 1.0;
+
+    int count = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (const FlightRing& ring : rings) {
+            int32_t owner = ring.threadId.load(std::memory_order_acquire);
+            if (owner == 0 || (pass == 0) != (owner == firstThreadId) || ThreadExited(owner)) {
+                continue;
+            }
+            count += CollectRing(ring, owner, events + count, maxEvents - count, perThread, nowTicks, nanosPerTick);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "crash_report_format.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Per-thread flight recorder: breadcrumbs of what each thread did just before a crash.
+//
+// RecordFlightEvent() appends a timestamped record (an event id plus three integers, or a
+// short string) to the calling thread's ring buffer, overwriting the oldest once the ring is
+// full. A thread claims a ring from a pool mapped by StartFlightRecorder() on its first
+// event, and its rings are reused once it has exited and the pool runs dry. Appending is
+// inline: a flag and a thread-local load, a cycle counter read and a handful of stores,
+// with no locks, no atomics beyond ordered stores and no allocation, so it can stay on in
+// request paths.
+//
+// Each record carries a sequence number written last, so CollectFlightEvents() can read
+// other threads' rings while they keep appending and drop the record being overwritten. It
+// is async-signal-safe; the fatal handlers list the last events of every thread with it.
+
+constexpr int kMaxFlightRecorderThreads = 256;
+
+struct FlightRecorderEntry {
+    std::atomic<uint64_t> sequence;  // Position in the ring + 1 once written, 0 while being written
+    uint64_t ticks;                  // FlightRecorderTicks() when recorded
+    uint32_t eventId;
+    uint32_t flags;  // kFlightEventText
+    union {
+        int64_t values[kFlightEventValues];
+        char text[kFlightEventTextSize];
+    };
+};
+
+struct FlightRing {
+    std::atomic<int32_t> threadId;  // Owner; 0 while free
+    uint64_t next;                  // Position of the next event; only the owner writes it
+    FlightRecorderEntry* entries;
+    uint64_t mask;  // Ring size - 1
+};
+
+// Maps the pool on first use with rings of eventsPerThread (rounded up to a power of two)
+// and starts recording; 0 stops it. The pool is kept for the life of the process, with the
+// size of the first start. Not async-signal-safe; call at install time.
+bool StartFlightRecorder(size_t eventsPerThread);
+void StopFlightRecorder();
+
+// Copies the newest perThread events of every live thread into events, oldest first, the
+// threads in ring order except firstThreadId's, which come first. Rings of threads that have
+// exited are left out. Returns how many were written. Async-signal-safe.
+int CollectFlightEvents(FlightEventRecord* events, int maxEvents, int perThread, int32_t firstThreadId);
+
+// Appends a string event; text is cut to kFlightEventTextSize - 1 characters
+void RecordFlightText(uint32_t eventId, const char* text);
+
+// Cycle counter where there is one, CLOCK_MONOTONIC otherwise. CollectFlightEvents() turns
+// ticks into nanoseconds against the clock readings of StartFlightRecorder().
+inline uint64_t FlightRecorderTicks() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+// The calling thread's ring, claimed on its first event while the recorder is on
+extern thread_local FlightRing* flightRing;
+FlightRing* ClaimFlightRing();
+
+// Checked on every append, so StopFlightRecorder() also stops threads that hold a ring
+extern std::atomic<bool> flightRecording;
+
+inline FlightRecorderEntry* BeginFlightEntry(FlightRing*& ring, uint64_t& position) {
+    if (!flightRecording.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    ring = flightRing;
+    if (!ring && !(ring = ClaimFlightRing())) {
+        return nullptr;
+    }
+    position = ring->next++;
+    FlightRecorderEntry* entry = &ring->entries[position & ring->mask];
+    entry->sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry->ticks = FlightRecorderTicks();
+    return entry;
+}
+
+inline void RecordFlightEvent(uint32_t eventId, int64_t value0 = 0, int64_t value1 = 0, int64_t value2 = 0) {
+    FlightRing* ring;
+    uint64_t position;
+    FlightRecorderEntry* entry = BeginFlightEntry(ring, position);
+    if (!entry) {
+        return;
+    }
+    entry->eventId = eventId;
+    entry->flags = 0;
+    entry->values[0] = value0;
+    entry->values[1] = value1;
+    entry->values[2] = value2;
+    entry->sequence.store(position + 1, std::memory_order_release);
+}
+
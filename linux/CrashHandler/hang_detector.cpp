@@ -0,0 +1,287 @@
+#include "hang_detector.h"
+
+#include "module_map.h"
+#include "report_text.h"
+#include "safe_writer.h"
+#include "symbol_cache.h"
+#include "thread_dump.h"
+
+#include <cerrno>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+thread_local HeartbeatSlot* heartbeatSlot = nullptr;
+
+namespace {
+
+constexpr size_t kDumpBufferSize = 64 * 1024;
+
+enum StallState : int {
+    kRunning = 0,
+    kStallPending,   // Stalled, not dumped yet because of the rate limit
+    kStallReported,  // Dumped; reported again only after progress
+};
+
+// What the watchdog knows of a slot; only the watchdog thread touches it
+struct WatchState {
+    int32_t threadId;  // Owner when the state was last reset
+    uint64_t beats;
+    uint64_t progressMicros;  // When beats last changed, or the thread was last idle
+    int stall;
+};
+
+HeartbeatSlot heartbeats[kMaxWatchedThreads];
+WatchState watchStates[kMaxWatchedThreads];
+
+// Watchdog settings and state, set by StartHangDetector()
+int reportFd = -1;
+int checkInterval = 0;
+int dumpSignal = 0;
+uint64_t minDumpIntervalMicros = 0;
+int threadTimeout = 0;
+bool symbolizeDumps = false;
+int wakeupFd = -1;  // eventfd the request signal handler and StopHangDetector() write to
+std::atomic<bool> stopping{ false };
+// A plain pthread rather than std::thread: a process that exits without uninstalling the
+// handlers must not end in std::terminate over a joinable thread
+pthread_t watchdogThread;
+bool watchdogRunning = false;
+struct sigaction previousRequestAction;
+
+// Dump state; only the watchdog thread touches it
+uint64_t lastDumpMicros = 0;
+bool dumpedBefore = false;
+uint64_t skippedDumps = 0;
+pid_t stalledIds[kMaxWatchedThreads];
+int stalledSlots[kMaxWatchedThreads];
+ThreadCapture captures[kMaxDumpThreads];
+char dumpBuffer[kDumpBufferSize];
+
+uint64_t MonotonicMicros() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + static_cast<uint64_t>(now.tv_nsec) / 1000;
+}
+
+bool ThreadExited(int32_t threadId) {
+    return syscall(SYS_tgkill, getpid(), threadId, 0) != 0 && errno == ESRCH;
+}
+
+void RequestSignalHandler(int) {
+    int savedErrno = errno;
+    uint64_t one = 1;
+    ssize_t written = write(wakeupFd, &one, sizeof(one));
+    (void)written;
+    errno = savedErrno;
+}
+
+// Samples every watched thread's heartbeat and collects the slots of threads past their
+// deadline that have not been dumped yet. Frees slots of threads that exited unwatched.
+int FindStalledThreads(uint64_t now, bool& newStall) {
+    int count = 0;
+    for (int i = 0; i < kMaxWatchedThreads; i++) {
+        HeartbeatSlot& slot = heartbeats[i];
+        WatchState& state = watchStates[i];
+        int32_t threadId = slot.threadId.load(std::memory_order_acquire);
+        if (threadId <= 0) {  // Free, or being claimed
+            state.threadId = 0;
+            continue;
+        }
+        uint64_t beats = slot.beats.load(std::memory_order_relaxed);
+        if (state.threadId != threadId || beats != state.beats || slot.idle.load(std::memory_order_relaxed)) {
+            state = { threadId, beats, now, kRunning };
+            continue;
+        }
+        if (now - state.progressMicros < uint64_t(slot.deadlineMillis.load(std::memory_order_relaxed)) * 1000) {
+            continue;
+        }
+        if (ThreadExited(threadId)) {
+            slot.threadId.compare_exchange_strong(threadId, 0);
+            continue;
+        }
+        if (state.stall == kStallReported) {
+            continue;
+        }
+        if (state.stall == kRunning) {
+            state.stall = kStallPending;
+            newStall = true;
+        }
+        stalledIds[count] = threadId;
+        stalledSlots[count++] = i;
+    }
+    return count;
+}
+
+void WriteStalledThreads(SafeWriter& writer, int stalledCount, uint64_t now, const ModuleLookup& modules,
+    ReportModules& used, const SymbolLookup* symbols) {
+    int captured = DumpThreads(stalledIds, stalledCount, captures, kMaxDumpThreads, threadTimeout,
+        ThreadDumpUser::Watchdog);
+    for (int i = 0; i < stalledCount; i++) {
+        const HeartbeatSlot& slot = heartbeats[stalledSlots[i]];
+        WatchState& state = watchStates[stalledSlots[i]];
+        const ThreadCapture* capture = nullptr;
+        for (int j = 0; j < captured && !capture; j++) {
+            capture = captures[j].threadId == stalledIds[i] ? &captures[j] : nullptr;
+        }
+        WriteStalledThreadHeader(writer, stalledIds[i], slot.name.load(std::memory_order_acquire),
+            (now - state.progressMicros) / 1000, slot.deadlineMillis.load(std::memory_order_relaxed),
+            capture ? capture->flags : kThreadNoResponse);
+        if (capture) {
+            WriteFrames(writer, capture->frames, capture->frameCount, modules, used, symbols);
+        }
+        state.stall = kStallReported;
+    }
+    ReleaseThreadCaptures(ThreadDumpUser::Watchdog);
+}
+
+void WriteAllThreads(SafeWriter& writer, const ModuleLookup& modules, ReportModules& used,
+    const SymbolLookup* symbols) {
+    int captured = DumpOtherThreads(captures, kMaxDumpThreads, threadTimeout, ThreadDumpUser::Watchdog);
+    for (int i = 0; i < captured; i++) {
+        WriteThreadHeader(writer, captures[i].threadId, captures[i].flags);
+        WriteFrames(writer, captures[i].frames, captures[i].frameCount, modules, used, symbols);
+    }
+    ReleaseThreadCaptures(ThreadDumpUser::Watchdog);
+}
+
+// One check: dumps the newly stalled threads and, if requested, every thread, unless the
+// previous dump was too recent
+void Check(bool requested) {
+    uint64_t now = MonotonicMicros();
+    bool newStall = false;
+    int stalledCount = checkInterval > 0 ? FindStalledThreads(now, newStall) : 0;
+    if (stalledCount == 0 && !requested) {
+        return;
+    }
+    if (dumpedBefore && now - lastDumpMicros < minDumpIntervalMicros) {
+        skippedDumps += (requested ? 1 : 0) + (newStall ? 1 : 0);
+        return;
+    }
+    SafeWriter writer(dumpBuffer, sizeof(dumpBuffer), reportFd);
+    WriteHangReportHeadline(writer, stalledCount, requested ? dumpSignal : 0, skippedDumps);
+    ModuleMapView moduleMap;
+    ReportModules used;
+    const SymbolLookup* symbols = symbolizeDumps ? &ProcessSymbolCache() : nullptr;
+    if (stalledCount > 0) {
+        WriteStalledThreads(writer, stalledCount, now, moduleMap, used, symbols);
+    }
+    if (requested) {
+        WriteAllThreads(writer, moduleMap, used, symbols);
+    }
+    WriteModuleList(writer, used);
+    writer.Flush();
+    lastDumpMicros = MonotonicMicros();
+    dumpedBefore = true;
+    skippedDumps = 0;
+}
+
+void* WatchdogLoop(void*) {
+    pollfd wakeup = { wakeupFd, POLLIN, 0 };
+    while (!stopping.load()) {
+        int ready = poll(&wakeup, 1, checkInterval > 0 ? checkInterval : -1);
+        if (stopping.load()) {
+            break;
+        }
+        uint64_t requests = 0;
+        if (ready > 0 && read(wakeupFd, &requests, sizeof(requests)) != static_cast<ssize_t>(sizeof(requests))) {
+            requests = 0;
+        }
+        Check(requests > 0);  // Requests that arrived together share one dump
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+bool StartHangDetector(int fd, int checkMillis, int requestSignal, int minDumpIntervalMillis,
+    int dumpTimeoutMillis, bool symbolize) {
+    if ((checkMillis <= 0 && requestSignal == 0) || watchdogRunning) {
+        return true;
+    }
+    reportFd = fd;
+    checkInterval = checkMillis > 0 ? checkMillis : 0;
+    dumpSignal = requestSignal;
+    minDumpIntervalMicros = minDumpIntervalMillis > 0 ? static_cast<uint64_t>(minDumpIntervalMillis) * 1000 : 0;
+    threadTimeout = dumpTimeoutMillis;
+    symbolizeDumps = symbolize;
+    dumpedBefore = false;
+    skippedDumps = 0;
+    wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeupFd < 0) {
+        return false;
+    }
+    if (requestSignal != 0) {
+        struct sigaction action = {};
+        action.sa_handler = RequestSignalHandler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(requestSignal, &action, &previousRequestAction) != 0) {
+            close(wakeupFd);
+            wakeupFd = -1;
+            return false;
+        }
+    }
+    stopping = false;
+    if (pthread_create(&watchdogThread, nullptr, WatchdogLoop, nullptr) != 0) {
+        StopHangDetector();
+        return false;
+    }
+    watchdogRunning = true;
+    return true;
+}
+
+void StopHangDetector() {
+    if (wakeupFd < 0) {
+        return;
+    }
+    if (dumpSignal != 0) {
+        sigaction(dumpSignal, &previousRequestAction, nullptr);
+    }
+    if (watchdogRunning) {
+        stopping = true;
+        uint64_t one = 1;
+        ssize_t written = write(wakeupFd, &one, sizeof(one));
+        (void)written;
+        pthread_join(watchdogThread, nullptr);
+        watchdogRunning = false;
+    }
+    close(wakeupFd);
+    wakeupFd = -1;
+}
+
+bool WatchCurrentThread(const char* name, int deadlineMillis) {
+    if (heartbeatSlot) {
+        heartbeatSlot->name.store(name, std::memory_order_release);
+        heartbeatSlot->deadlineMillis.store(static_cast<uint32_t>(deadlineMillis), std::memory_order_relaxed);
+        return true;
+    }
+    int32_t threadId = static_cast<int32_t>(syscall(SYS_gettid));
+    for (HeartbeatSlot& slot : heartbeats) {
+        int32_t owner = slot.threadId.load(std::memory_order_relaxed);
+        if (owner != 0) {
+            continue;
+        }
+        // Claimed with a placeholder, so the watchdog never sees a half-set slot
+        if (slot.threadId.compare_exchange_strong(owner, -1)) {
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.deadlineMillis.store(static_cast<uint32_t>(deadlineMillis), std::memory_order_relaxed);
+            slot.idle.store(false, std::memory_order_relaxed);
+            slot.threadId.store(threadId, std::memory_order_release);
+            heartbeatSlot = &slot;
+            return true;
+        }
+    }
+    return false;
+}
+
+void UnwatchCurrentThread() {
+    if (heartbeatSlot) {
+        heartbeatSlot->threadId.store(0, std::memory_order_release);
+        heartbeatSlot = nullptr;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hang and stall detection: stacks of stuck threads from a process that keeps running.
+//
+// A thread that should make progress calls WatchCurrentThread() with a deadline and then
+// Heartbeat() whenever it gets something done: one relaxed increment of a counter in its
+// slot of a fixed table, no clock read. A watchdog thread samples the counters every check
+// interval; a thread whose counter has not moved for longer than its deadline is stalled.
+// The watchdog captures the stalled threads through the thread dump machinery
+// (thread_dump.h), so each unwinds itself with the handler's unwinder from the dump
+// signal, and writes their stacks to the report descriptor. A thread is reported once per
+// stall; it is reported again only after it made progress and stalled anew. Threads that
+// wait for work call HeartbeatIdle() first, which exempts them until their next heartbeat.
+//
+// A dump request signal (kill -USR2, say) makes the watchdog dump every thread. The
+// handler only writes to an eventfd the watchdog polls, so the dump itself never runs in
+// signal context. Dumps of either kind are at least the minimum interval apart; stalls
+// and requests that come sooner are counted and the count is printed with the next dump, so
+// a storm of requests or flapping threads cannot keep the process busy dumping.
+
+constexpr int kMaxWatchedThreads = 256;
+
+struct HeartbeatSlot {
+    std::atomic<int32_t> threadId;  // 0 while free
+    std::atomic<uint64_t> beats;    // Written only by the owner
+    std::atomic<bool> idle;
+    // Atomic because the owner may change them with WatchCurrentThread() while the
+    // watchdog reads them
+    std::atomic<const char*> name;
+    std::atomic<uint32_t> deadlineMillis;
+};
+
+// Starts the watchdog thread, checking every checkMillis (0: no stall checks) and dumping
+// every thread when requestSignal arrives (0: no request signal), with dumps written to fd
+// at least minDumpIntervalMillis apart. Threads get dumpTimeoutMillis to answer. The thread
+// dump must be prepared (PrepareThreadDump()). Not async-signal-safe; call at install time.
+bool StartHangDetector(int fd, int checkMillis, int requestSignal, int minDumpIntervalMillis,
+    int dumpTimeoutMillis, bool symbolize);
+void StopHangDetector();
+
+// Watches the calling thread under name (kept by pointer) from now on: it is stalled when
+// it makes no heartbeat for deadlineMillis. False if the table is full.
+bool WatchCurrentThread(const char* name, int deadlineMillis);
+void UnwatchCurrentThread();
+
+// The calling thread's slot; nullptr while it is not watched
+extern thread_local HeartbeatSlot* heartbeatSlot;
+
+// Progress of the calling thread; does nothing for threads that are not watched
+inline void Heartbeat() {
+    HeartbeatSlot* slot = heartbeatSlot;
+    if (slot) {
+        slot->beats.store(slot->beats.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (slot->idle.load(std::memory_order_relaxed)) {
+            slot->idle.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+// The calling thread waits for work and cannot stall until its next heartbeat
+inline void HeartbeatIdle() {
+    HeartbeatSlot* slot = heartbeatSlot;
+    if (slot) {
+        slot->idle.store(true, std::memory_order_relaxed);
+    }
+}
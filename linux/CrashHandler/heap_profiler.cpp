@@ -0,0 +1,248 @@
+#include "heap_profiler.h"
+
+#include "crash_fingerprint.h"
+#include "module_map.h"
+#include "stack_capture.h"
+
+#include <cmath>
+#include <sys/mman.h>
+#include <time.h>
+
+std::atomic<bool> heapSamplingActive{ false };
+std::atomic<uint64_t> heapLiveSamples{ 0 };
+
+namespace {
+
+constexpr int kMaxLiveSamples = 32768;  // Power of two
+// A sample lives at most this many slots past its hash slot, so a lookup stays short however
+// many freed samples have left kRemovedSample behind; a sample with no room there is dropped
+constexpr int kMaxSampleProbes = 32;
+constexpr uintptr_t kRemovedSample = 1;
+constexpr uint64_t kHashMultiplier = 0x9e3779b97f4a7c15ull;
+
+struct HeapSite {
+    std::atomic<uint64_t> fingerprint;  // 0: free
+    std::atomic<uint32_t> ready;        // Set once frames are written
+    int32_t frameCount;
+    uintptr_t frames[kMaxHeapSiteFrames];
+    std::atomic<uint64_t> liveBytes;
+    std::atomic<uint64_t> allocatedBytes;
+    std::atomic<uint64_t> liveSamples;
+};
+
+// A sampled block that has not been freed yet
+struct LiveSample {
+    std::atomic<uintptr_t> address;  // 0: free, kRemovedSample: freed (the probe goes on)
+    uint32_t site;
+    uint64_t bytes;  // What the sample stands for
+};
+
+struct SamplerState {
+    int64_t bytesUntilSample;
+    uint64_t random;    // xorshift64* state, 0 until seeded
+    bool insideSample;  // The unwinder or the module map allocating while we sample
+};
+
+HeapSite* sites = nullptr;
+LiveSample* liveSamples = nullptr;
+std::atomic<size_t> meanSampleBytes{ 0 };
+std::atomic<uint64_t> droppedSamples{ 0 };
+thread_local SamplerState sampler;
+
+uint64_t NextRandom(SamplerState& state) {
+    state.random ^= state.random >> 12;
+    state.random ^= state.random << 25;
+    state.random ^= state.random >> 27;
+    return state.random * 0x2545f4914f6cdd1dull;
+}
+
+// Exponentially distributed gap to the next sample, so samples form a Poisson process over
+// allocated bytes
+int64_t NextSampleGap(SamplerState& state, size_t mean) {
+    double uniform = static_cast<double>((NextRandom(state) >> 11) + 1) * 0x1.0p-53;  // (0, 1]
+    return static_cast<int64_t>(-std::log(uniform) * static_cast<double>(mean)) + 1;
+}
+
+// Bytes a sample of this size stands for: the size divided by the chance of sampling it
+uint64_t SampleWeight(size_t size, size_t mean) {
+    double probability = -std::expm1(-static_cast<double>(size) / static_cast<double>(mean));
+    return probability > 0 ? static_cast<uint64_t>(static_cast<double>(size) / probability) : size;
+}
+
+uint32_t LiveSampleSlot(uintptr_t address) {
+    return static_cast<uint32_t>(((address >> 4) * kHashMultiplier) >> 49) & (kMaxLiveSamples - 1);
+}
+
+// Site for the fingerprint, claiming a free one for a new stack; -1 when the table is full
+int FindSite(uint64_t fingerprint, const uintptr_t* frames, int frameCount) {
+    int index = static_cast<int>(fingerprint & (kMaxHeapSites - 1));
+    for (int probe = 0; probe < kMaxHeapSites; probe++, index = (index + 1) & (kMaxHeapSites - 1)) {
+        HeapSite& site = sites[index];
+        uint64_t current = site.fingerprint.load(std::memory_order_acquire);
+        if (current == 0 && site.fingerprint.compare_exchange_strong(current, fingerprint)) {
+            for (int i = 0; i < frameCount; i++) {
+                site.frames[i] = frames[i];
+            }
+            site.frameCount = frameCount;
+            site.ready.store(1, std::memory_order_release);
+            return index;
+        }
+        if (current == fingerprint) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+bool AddLiveSample(uintptr_t address, uint32_t site, uint64_t bytes) {
+    uint32_t index = LiveSampleSlot(address);
+    for (int probe = 0; probe < kMaxSampleProbes; probe++, index = (index + 1) & (kMaxLiveSamples - 1)) {
+        LiveSample& sample = liveSamples[index];
+        uintptr_t current = sample.address.load(std::memory_order_relaxed);
+        if ((current == 0 || current == kRemovedSample) && sample.address.compare_exchange_strong(current, address)) {
+            sample.site = site;
+            sample.bytes = bytes;
+            return true;
+        }
+    }
+    return false;
+}
+
+void RecordSample(void* memory, size_t size, size_t mean, const uintptr_t* frames, int frameCount) {
+    FingerprintRecord fingerprint = {};
+    {
+        ModuleMapView moduleMap;
+        FingerprintStack(frames, frameCount, moduleMap, fingerprint);
+    }
+    uint64_t key = fingerprint.fingerprint != 0 ? fingerprint.fingerprint : 1;
+    int index = FindSite(key, frames, frameCount);
+    if (index < 0) {
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    HeapSite& site = sites[index];
+    uint64_t bytes = SampleWeight(size, mean);
+    site.allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (!AddLiveSample(reinterpret_cast<uintptr_t>(memory), static_cast<uint32_t>(index), bytes)) {
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    site.liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+    site.liveSamples.fetch_add(1, std::memory_order_relaxed);
+    heapLiveSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+bool StartHeapProfiler(size_t meanBytesBetweenSamples) {
+    if (meanBytesBetweenSamples == 0) {
+        StopHeapProfiler();
+        return true;
+    }
+    if (!sites) {
+        void* siteMemory = mmap(nullptr, sizeof(HeapSite) * kMaxHeapSites, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void* sampleMemory = mmap(nullptr, sizeof(LiveSample) * kMaxLiveSamples, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (siteMemory == MAP_FAILED || sampleMemory == MAP_FAILED) {
+            if (siteMemory != MAP_FAILED) {
+                munmap(siteMemory, sizeof(HeapSite) * kMaxHeapSites);
+            }
+            if (sampleMemory != MAP_FAILED) {
+                munmap(sampleMemory, sizeof(LiveSample) * kMaxLiveSamples);
+            }
+            return false;
+        }
+        // Never unmapped: frees of sampled blocks look them up for the rest of the process
+        sites = static_cast<HeapSite*>(siteMemory);
+        liveSamples = static_cast<LiveSample*>(sampleMemory);
+    }
+    meanSampleBytes.store(meanBytesBetweenSamples);
+    heapSamplingActive.store(true);
+    return true;
+}
+
+void StopHeapProfiler() {
+    heapSamplingActive.store(false);
+}
+
+void SampleHeapAllocationSlow(void* memory, size_t size) {
+    SamplerState& state = sampler;
+    state.bytesUntilSample -= static_cast<int64_t>(size);
+    if (state.bytesUntilSample > 0 || state.insideSample) {
+        return;
+    }
+    size_t mean = meanSampleBytes.load(std::memory_order_relaxed);
+    if (state.random == 0) {
+        // First allocation on this thread: seed and start counting, without sampling it
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        state.random = (reinterpret_cast<uintptr_t>(&state) ^ static_cast<uint64_t>(now.tv_nsec)) | 1;
+        state.bytesUntilSample = NextSampleGap(state, mean);
+        return;
+    }
+    state.bytesUntilSample = NextSampleGap(state, mean);
+
+    state.insideSample = true;
+    // Drops this function and operator new, so frame 0 is the code that allocated
+    uintptr_t frames[kMaxHeapSiteFrames];
+    int frameCount = CaptureStack(frames, kMaxHeapSiteFrames, 2);
+    RecordSample(memory, size, mean, frames, frameCount);
+    state.insideSample = false;
+}
+
+void ForgetHeapAllocationSlow(void* memory) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(memory);
+    uint32_t index = LiveSampleSlot(address);
+    for (int probe = 0; probe < kMaxSampleProbes; probe++, index = (index + 1) & (kMaxLiveSamples - 1)) {
+        LiveSample& sample = liveSamples[index];
+        uintptr_t current = sample.address.load(std::memory_order_relaxed);
+        if (current == 0) {
+            return;  // Not sampled
+        }
+        if (current == address) {
+            HeapSite& site = sites[sample.site];
+            site.liveBytes.fetch_sub(sample.bytes, std::memory_order_relaxed);
+            site.liveSamples.fetch_sub(1, std::memory_order_relaxed);
+            heapLiveSamples.fetch_sub(1, std::memory_order_relaxed);
+            sample.address.store(kRemovedSample, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+int TopHeapSites(HeapSiteSummary* top, int maxSites) {
+    if (!sites) {
+        return 0;
+    }
+    int count = 0;
+    for (int i = 0; i < kMaxHeapSites; i++) {
+        const HeapSite& site = sites[i];
+        uint64_t liveBytes = site.liveBytes.load(std::memory_order_relaxed);
+        if (liveBytes == 0 || site.ready.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+        int position = count;
+        while (position > 0 && top[position - 1].liveBytes < liveBytes) {
+            position--;
+        }
+        if (position >= maxSites) {
+            continue;
+        }
+        int last = count < maxSites ? count : maxSites - 1;
+        for (int j = last; j > position; j--) {
+            top[j] = top[j - 1];
+        }
+        top[position] = { site.fingerprint.load(std::memory_order_relaxed), liveBytes,
+            site.allocatedBytes.load(std::memory_order_relaxed), site.liveSamples.load(std::memory_order_relaxed),
+            site.frames, site.frameCount };
+        if (count < maxSites) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint64_t DroppedHeapSamples() {
+    return droppedSamples.load(std::memory_order_relaxed);
+}
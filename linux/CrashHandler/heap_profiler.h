@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Sampled heap profiler built on the handlers' stack capture.
+//
+// Allocations made through operator new are sampled as a Poisson process: on average one
+// sample every meanBytesBetweenSamples allocated bytes, so large allocations are almost
+// always caught and the cost per allocation does not depend on the allocation pattern.
+// A sample captures the stack and adds the bytes it stands for to a site keyed by the stack
+// fingerprint (see crash_fingerprint.h) in a fixed-size lock-free table; the sampled
+// address goes into a second lock-free table, so operator delete can take the bytes off
+// the site's live total. The new handler lists the sites holding the most live bytes.
+//
+// Both tables are mapped once and kept for the life of the process; nothing allocates from
+// the heap, so sampling can run inside operator new.
+
+constexpr int kMaxHeapSiteFrames = 32;
+constexpr int kMaxHeapSites = 1024;
+
+struct HeapSiteSummary {
+    uint64_t fingerprint;
+    uint64_t liveBytes;       // Estimated from the samples still allocated
+    uint64_t allocatedBytes;  // Estimated, including freed samples
+    uint64_t liveSamples;
+    const uintptr_t* frames;  // The first stack seen with this fingerprint; frame 0 is the caller of operator new
+    int frameCount;
+};
+
+// Maps the tables on first use and starts sampling; meanBytesBetweenSamples 0 stops it.
+// Not async-signal-safe; call at install time.
+bool StartHeapProfiler(size_t meanBytesBetweenSamples);
+void StopHeapProfiler();
+
+// Fills sites with up to maxSites sites ordered by live bytes, largest first, and returns
+// how many were written. Does not allocate.
+int TopHeapSites(HeapSiteSummary* sites, int maxSites);
+
+// Samples dropped because a table was full
+uint64_t DroppedHeapSamples();
+
+// Hooks for operator new and delete (memory_reserve.cpp). While sampling is off they cost
+// one load; frees keep being looked up as long as sampled blocks are live, also
+// after StopHeapProfiler().
+extern std::atomic<bool> heapSamplingActive;
+extern std::atomic<uint64_t> heapLiveSamples;
+void SampleHeapAllocationSlow(void* memory, size_t size);
+void ForgetHeapAllocationSlow(void* memory);
+
+inline void SampleHeapAllocation(void* memory, size_t size) {
+    if (heapSamplingActive.load(std::memory_order_acquire)) {
+        SampleHeapAllocationSlow(memory, size);
+    }
+}
+
+inline void ForgetHeapAllocation(void* memory) {
+    if (heapLiveSamples.load(std::memory_order_relaxed) > 0 && memory) {
+        ForgetHeapAllocationSlow(memory);
+    }
+}
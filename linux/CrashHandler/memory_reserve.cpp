@@ -0,0 +1,246 @@
+#include "memory_reserve.h"
+
+#include "heap_profiler.h"
+#include "proc_reader.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<void*> reserve{ nullptr };
+size_t reserveSize = 0;
+
+struct CacheReleaser {
+    CacheReleaseFunction release;
+    void* context;
+};
+
+std::mutex releaserMutex;
+CacheReleaser releasers[kMaxCacheReleasers];
+int releaserCount = 0;
+thread_local bool insideCacheRelease = false;  // A callback that runs out of memory itself
+
+thread_local size_t failedAllocationSize = 0;
+
+// Keeps mapping among the largest, which stay sorted by size
+void RankMapping(MemoryUsage& usage, const MemoryMapping& mapping) {
+    uintptr_t size = mapping.end - mapping.start;
+    int position = usage.largestCount;
+    while (position > 0 && usage.largest[position - 1].end - usage.largest[position - 1].start < size) {
+        position--;
+    }
+    if (position >= kMaxLargestMappings) {
+        return;
+    }
+    int last = usage.largestCount < kMaxLargestMappings ? usage.largestCount : kMaxLargestMappings - 1;
+    for (int i = last; i > position; i--) {
+        usage.largest[i] = usage.largest[i - 1];
+    }
+    usage.largest[position] = mapping;
+    if (usage.largestCount < kMaxLargestMappings) {
+        usage.largestCount++;
+    }
+}
+
+// "start-end perms offset dev inode    path"
+void ReadMappings(MemoryUsage& usage) {
+    ProcLineReader maps("/proc/self/maps");
+    const char* line;
+    size_t length;
+    while (maps.NextLine(line, length)) {
+        const char* end = line + length;
+        MemoryMapping mapping = {};
+        mapping.start = ParseNumber(line, end, 16);
+        if (line == end || *line != '-') {
+            continue;
+        }
+        line++;
+        mapping.end = ParseNumber(line, end, 16);
+        for (int field = 0; field < 4; field++) {  // perms, offset, dev, inode
+            line = SkipField(line, end);
+        }
+        line = SkipSpaces(line, end);
+        size_t nameLength = static_cast<size_t>(end - line);
+        if (nameLength >= kMaxMappingName) {
+            line = end - (kMaxMappingName - 1);  // The file name is the interesting part of a path
+            nameLength = kMaxMappingName - 1;
+        }
+        memcpy(mapping.name, line, nameLength);
+        mapping.name[nameLength] = '\0';
+
+        usage.mappedBytes += mapping.end - mapping.start;
+        usage.mappingCount++;
+        RankMapping(usage, mapping);
+    }
+}
+
+// Second field of /proc/self/statm, in pages
+void ReadResidentSize(MemoryUsage& usage) {
+    ProcLineReader statm("/proc/self/statm");
+    const char* line;
+    size_t length;
+    if (statm.NextLine(line, length)) {
+        const char* end = line + length;
+        line = SkipField(line, end);
+        line = SkipSpaces(line, end);
+        usage.residentBytes = ParseNumber(line, end, 10) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+}
+
+void ReadAvailableMemory(MemoryUsage& usage) {
+    static const char kAvailable[] = "MemAvailable:";
+    ProcLineReader meminfo("/proc/meminfo");
+    const char* line;
+    size_t length;
+    while (meminfo.NextLine(line, length)) {
+        if (length > sizeof(kAvailable) - 1 && memcmp(line, kAvailable, sizeof(kAvailable) - 1) == 0) {
+            const char* end = line + length;
+            line = SkipSpaces(line + sizeof(kAvailable) - 1, end);
+            usage.availableBytes = ParseNumber(line, end, 10) * 1024;  // Always in kB
+            return;
+        }
+    }
+}
+
+// Records the failing size and gives the new handler a chance; the loop operator new is
+// specified to run
+void CallNewHandler(size_t size) {
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) {
+        throw std::bad_alloc();
+    }
+    failedAllocationSize = size;
+    handler();
+}
+
+}  // namespace
+
+bool PrepareEmergencyReserve(size_t bytes) {
+    if (bytes == 0 || reserve.load()) {
+        return true;
+    }
+    void* memory = malloc(bytes);
+    if (!memory) {
+        return false;
+    }
+    reserveSize = bytes;
+    reserve.store(memory);
+    return true;
+}
+
+size_t ReleaseEmergencyReserve() {
+    void* memory = reserve.exchange(nullptr);
+    if (!memory) {
+        return 0;
+    }
+    free(memory);
+    return reserveSize;
+}
+
+bool RegisterCacheReleaser(CacheReleaseFunction release, void* context) {
+    std::lock_guard<std::mutex> lock(releaserMutex);
+    if (releaserCount == kMaxCacheReleasers) {
+        return false;
+    }
+    releasers[releaserCount++] = { release, context };
+    return true;
+}
+
+void UnregisterCacheReleaser(CacheReleaseFunction release, void* context) {
+    std::lock_guard<std::mutex> lock(releaserMutex);
+    for (int i = 0; i < releaserCount; i++) {
+        if (releasers[i].release == release && releasers[i].context == context) {
+            releasers[i] = releasers[--releaserCount];
+            return;
+        }
+    }
+}
+
+size_t ReleaseRegisteredCaches() {
+    if (insideCacheRelease) {
+        return 0;
+    }
+    insideCacheRelease = true;
+    size_t released = 0;
+    {
+        std::lock_guard<std::mutex> lock(releaserMutex);
+        for (int i = 0; i < releaserCount; i++) {
+            released += releasers[i].release(releasers[i].context);
+        }
+    }
+    insideCacheRelease = false;
+    return released;
+}
+
+size_t FailedAllocationSize() {
+    return failedAllocationSize;
+}
+
+void ReadMemoryUsage(MemoryUsage& usage) {
+    usage = {};
+    ReadResidentSize(usage);
+    ReadMappings(usage);
+    rlimit limit;
+    if (getrlimit(RLIMIT_AS, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        usage.addressSpaceLimit = limit.rlim_cur;
+    }
+    ReadAvailableMemory(usage);
+}
+
+void* operator new(std::size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    for (;;) {
+        if (void* memory = malloc(size)) {
+            SampleHeapAllocation(memory, size);
+            return memory;
+        }
+        CallNewHandler(size);
+    }
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    size_t align = static_cast<size_t>(alignment);
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    for (;;) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, align, size) == 0) {
+            SampleHeapAllocation(memory, size);
+            return memory;
+        }
+        CallNewHandler(size);
+    }
+}
+
+// The array and nothrow forms of the runtime end up in these
+void operator delete(void* memory) noexcept {
+    ForgetHeapAllocation(memory);
+    free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    ForgetHeapAllocation(memory);
+    free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    ForgetHeapAllocation(memory);
+    free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    ForgetHeapAllocation(memory);
+    free(memory);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Out-of-memory support for the new handler.
+//
+// InstallCrashHandlers() sets aside an emergency reserve from the heap. The first time an
+// allocation fails it is handed back to the allocator, so the report (and the symbol cache
+// it may fill) has memory to work with. Caches the program can rebuild are registered as
+// release callbacks; the new handler runs them after reporting and lets operator new retry
+// if they freed anything, before giving up with std::bad_alloc.
+//
+// This file replaces the global operator new and delete (the plain, sized and aligned
+// forms, which the array and nothrow forms call), so the size of the failing request is
+// known to the handler and the heap profiler (heap_profiler.h) sees every block.
+
+// Allocates the reserve. Not async-signal-safe; call at install time. The pages are not
+// touched: what the reserve holds back is address space and commit charge, which is what
+// runs out under RLIMIT_AS or strict overcommit, without adding to the resident set.
+bool PrepareEmergencyReserve(size_t bytes);
+
+// Frees the reserve; returns how many bytes that released, 0 if it was already released
+size_t ReleaseEmergencyReserve();
+
+// Frees whatever the cache holds and returns how many bytes that was (0 if it was empty).
+// Called from the new handler, so it must not need much memory itself.
+using CacheReleaseFunction = size_t (*)(void* context);
+
+constexpr int kMaxCacheReleasers = 16;
+
+// Returns false once kMaxCacheReleasers are registered
+bool RegisterCacheReleaser(CacheReleaseFunction release, void* context);
+void UnregisterCacheReleaser(CacheReleaseFunction release, void* context);
+
+// Runs every registered callback and returns the bytes they freed in total. Callbacks do not
+// run again if one of them runs out of memory itself.
+size_t ReleaseRegisteredCaches();
+
+// Size of the last request operator new failed to allocate on this thread (the one the new
+// handler is running for), 0 if there was none
+size_t FailedAllocationSize();
+
+constexpr int kMaxLargestMappings = 5;
+constexpr size_t kMaxMappingName = 64;
+
+struct MemoryMapping {
+    uintptr_t start;
+    uintptr_t end;
+    char name[kMaxMappingName];  // Path or [heap], [stack]; empty for anonymous memory
+};
+
+// Memory state of the process at the time of a failed allocation. A request that fails
+// while mapped memory is far below the limits points at fragmentation (or a single huge
+// request); mapped memory at the address space limit, or no memory available system-wide,
+// is real exhaustion.
+struct MemoryUsage {
+    uint64_t residentBytes;      // 0 if /proc/self/statm could not be read
+    uint64_t mappedBytes;        // Sum of all mappings in /proc/self/maps
+    int mappingCount;
+    uint64_t addressSpaceLimit;  // RLIMIT_AS, 0 if unlimited
+    uint64_t availableBytes;     // MemAvailable of /proc/meminfo, 0 if unknown
+    MemoryMapping largest[kMaxLargestMappings];  // By size, largest first
+    int largestCount;
+};
+
+// Reads /proc/self/statm, /proc/self/maps and /proc/meminfo with raw read(2) into stack
+// buffers; does not allocate.
+void ReadMemoryUsage(MemoryUsage& usage);
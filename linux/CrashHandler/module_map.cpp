@@ -0,0 +1,268 @@
+#include "module_map.h"
+
+#include "dwarf_unwinder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+struct ModuleSnapshot {
+    std::vector<ModuleInfo> modules;  // Sorted by start, non-overlapping
+    // dlpi_adds and dlpi_subs of the loader when the snapshot was taken
+    unsigned long long loaderAdds = 0;
+    unsigned long long loaderSubs = 0;
+};
+
+namespace {
+
+std::atomic<ModuleSnapshot*> currentSnapshot{ nullptr };
+std::atomic<int> activeReaders{ 0 };
+
+// Writers are serialized; readers never take this lock
+std::mutex refreshMutex;
+std::vector<ModuleSnapshot*> retiredSnapshots;
+
+void CopyPath(char* destination, const char* source) {
+    size_t length = strnlen(source, kMaxModulePath - 1);
+    memcpy(destination, source, length);
+    destination[length] = '\0';
+}
+
+// Copies the NT_GNU_BUILD_ID note out of a loaded PT_NOTE segment
+bool ReadBuildId(const ElfW(Addr) loadBias, const ElfW(Phdr)& header, ModuleInfo& module) {
+    const char* notes = reinterpret_cast<const char*>(loadBias + header.p_vaddr);
+    size_t offset = 0;
+    while (offset + sizeof(ElfW(Nhdr)) <= header.p_memsz) {
+        const ElfW(Nhdr)* note = reinterpret_cast<const ElfW(Nhdr)*>(notes + offset);
+        size_t nameOffset = offset + sizeof(ElfW(Nhdr));
+        size_t descOffset = nameOffset + ((note->n_namesz + 3) & ~3u);
+        size_t nextOffset = descOffset + ((note->n_descsz + 3) & ~3u);
+        if (nextOffset > header.p_memsz) {
+            break;
+        }
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+            memcmp(notes + nameOffset, "GNU", 4) == 0 && note->n_descsz <= kMaxBuildIdSize) {
+            memcpy(module.buildId, notes + descOffset, note->n_descsz);
+            module.buildIdSize = note->n_descsz;
+            return true;
+        }
+        offset = nextOffset;
+    }
+    return false;
+}
+
+// The loader's counts of objects loaded and unloaded so far, from the first entry
+int ReadLoaderCounts(dl_phdr_info* info, size_t size, void* data) {
+    ModuleSnapshot& snapshot = *static_cast<ModuleSnapshot*>(data);
+    if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+        snapshot.loaderAdds = info->dlpi_adds;
+        snapshot.loaderSubs = info->dlpi_subs;
+    }
+    return 1;
+}
+
+int AddModule(dl_phdr_info* info, size_t size, void* data) {
+    ModuleSnapshot& snapshot = *static_cast<ModuleSnapshot*>(data);
+    std::vector<ModuleInfo>& modules = snapshot.modules;
+    bool isMainExecutable = modules.empty();
+    if (isMainExecutable) {
+        ReadLoaderCounts(info, size, data);  // Under the same loader lock as the modules
+    }
+
+    ModuleInfo module;
+    memset(&module, 0, sizeof(module));
+    module.loadBias = info->dlpi_addr;
+    module.start = UINTPTR_MAX;
+
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)& header = info->dlpi_phdr[i];
+        if (header.p_type == PT_LOAD) {
+            uintptr_t segmentStart = info->dlpi_addr + header.p_vaddr;
+            uintptr_t segmentEnd = segmentStart + header.p_memsz;
+            if (segmentStart < module.start) {
+                module.start = segmentStart;
+            }
+            if (segmentEnd > module.end) {
+                module.end = segmentEnd;
+            }
+        }
+        else if (header.p_type == PT_NOTE && module.buildIdSize == 0) {
+            ReadBuildId(info->dlpi_addr, header, module);
+        }
+        else if (header.p_type == PT_GNU_EH_FRAME) {
+            module.ehFrameHdr = info->dlpi_addr + header.p_vaddr;
+        }
+    }
+    if (module.end == 0) {
+        return 0;  // Nothing mapped, e.g. an empty entry
+    }
+
+    if (info->dlpi_name && info->dlpi_name[0] != '\0') {
+        CopyPath(module.path, info->dlpi_name);
+    }
+    else if (isMainExecutable) {
+        // The main executable is reported with an empty name
+        ssize_t length = readlink("/proc/self/exe", module.path, kMaxModulePath - 1);
+        module.path[length > 0 ? length : 0] = '\0';
+    }
+    modules.push_back(module);
+    return 0;
+}
+
+}  // namespace
+
+const ModuleInfo* FindModule(const ModuleInfo* modules, size_t count, uintptr_t address) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {  // First module starting above the address
+        size_t middle = low + (high - low) / 2;
+        if (modules[middle].start <= address) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    if (low == 0 || address >= modules[low - 1].end) {
+        return nullptr;
+    }
+    return &modules[low - 1];
+}
+
+namespace {
+
+// The same object mapped at the same place: same start and build-id, or same path without one
+bool SameModule(const ModuleInfo& a, const ModuleInfo& b) {
+    if (a.start != b.start || a.end != b.end || a.buildIdSize != b.buildIdSize) {
+        return false;
+    }
+    return a.buildIdSize != 0 ? memcmp(a.buildId, b.buildId, a.buildIdSize) == 0 : strcmp(a.path, b.path) == 0;
+}
+
+// Rebuilds the snapshot; with onlyIfLoaded, only when the loader has loaded or unloaded an
+// object since the current one was taken (dlopen of a library already loaded just counts a
+// reference)
+bool Refresh(bool onlyIfLoaded) {
+    std::lock_guard<std::mutex> lock(refreshMutex);
+
+    ModuleSnapshot* previous = currentSnapshot.load();
+    if (onlyIfLoaded && previous) {
+        ModuleSnapshot counts;
+        dl_iterate_phdr(ReadLoaderCounts, &counts);
+        if (counts.loaderAdds == previous->loaderAdds && counts.loaderSubs == previous->loaderSubs) {
+            return !previous->modules.empty();
+        }
+    }
+
+    ModuleSnapshot* snapshot = new ModuleSnapshot();
+    dl_iterate_phdr(AddModule, snapshot);
+    std::sort(snapshot->modules.begin(), snapshot->modules.end(),
+        [](const ModuleInfo& a, const ModuleInfo& b) { return a.start < b.start; });
+    // Modules still mapped keep their frame pointer verdict; only new ones are sampled, and
+    // outside the loader lock
+    size_t kept = 0;
+    for (ModuleInfo& module : snapshot->modules) {
+        const ModuleInfo* old = previous
+            ? FindModule(previous->modules.data(), previous->modules.size(), module.start) : nullptr;
+        if (old && SameModule(*old, module)) {
+            module.framePointers = old->framePointers;
+            kept++;
+        }
+        else {
+            module.framePointers = ModuleUsesFramePointers(module);
+        }
+    }
+    bool found = !snapshot->modules.empty();
+
+    currentSnapshot.store(snapshot);
+    // Cached rows stay right while every module they came from is still mapped; an unloaded
+    // module's addresses may be reused by the next one
+    if (!previous || kept != previous->modules.size()) {
+        InvalidateDwarfUnwindCache();
+    }
+    if (previous) {
+        retiredSnapshots.push_back(previous);
+    }
+    // A reader registers before loading the pointer, so once the count is zero no reader
+    // can still hold any of the retired snapshots
+    if (activeReaders.load() == 0) {
+        for (ModuleSnapshot* retired : retiredSnapshots) {
+            delete retired;
+        }
+        retiredSnapshots.clear();
+    }
+    return found;
+}
+
+}  // namespace
+
+bool RefreshModuleMap() {
+    return Refresh(false);
+}
+
+ModuleMapView::ModuleMapView() {
+    activeReaders.fetch_add(1);
+    snapshot_ = currentSnapshot.load();
+}
+
+ModuleMapView::~ModuleMapView() {
+    activeReaders.fetch_sub(1);
+}
+
+const ModuleInfo* ModuleMapView::Find(uintptr_t address) const {
+    if (!snapshot_) {
+        return nullptr;
+    }
+    return FindModule(snapshot_->modules.data(), snapshot_->modules.size(), address);
+}
+
+int ModuleMapView::Count() const {
+    return snapshot_ ? static_cast<int>(snapshot_->modules.size()) : 0;
+}
+
+const ModuleInfo& ModuleMapView::At(int index) const {
+    return snapshot_->modules[index];
+}
+
+const ModuleInfo* ModuleMapView::Modules() const {
+    return Count() > 0 ? snapshot_->modules.data() : nullptr;
+}
+
+StaticModuleMap::StaticModuleMap(std::vector<ModuleInfo> modules) : modules_(std::move(modules)) {
+    std::sort(modules_.begin(), modules_.end(),
+        [](const ModuleInfo& a, const ModuleInfo& b) { return a.start < b.start; });
+}
+
+const ModuleInfo* StaticModuleMap::Find(uintptr_t address) const {
+    return FindModule(modules_.data(), modules_.size(), address);
+}
+
+// Keep the snapshot in step with the loader. These definitions take precedence over the
+// C library's for calls from the executable; link with -rdynamic so shared libraries'
+// calls are routed here too.
+extern "C" void* dlopen(const char* file, int mode) {
+    using DlopenFunction = void* (*)(const char*, int);
+    static DlopenFunction realDlopen = reinterpret_cast<DlopenFunction>(dlsym(RTLD_NEXT, "dlopen"));
+    void* handle = realDlopen(file, mode);
+    if (handle && currentSnapshot.load()) {
+        Refresh(true);
+    }
+    return handle;
+}
+
+extern "C" int dlclose(void* handle) {
+    using DlcloseFunction = int (*)(void*);
+    static DlcloseFunction realDlclose = reinterpret_cast<DlcloseFunction>(dlsym(RTLD_NEXT, "dlclose"));
+    int result = realDlclose(handle);
+    if (result == 0 && currentSnapshot.load()) {
+        Refresh(true);
+    }
+    return result;
+}
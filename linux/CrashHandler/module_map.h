@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr size_t kMaxModulePath = 256;
+constexpr size_t kMaxBuildIdSize = 32;
+
+// A loaded ELF object (the executable or a shared library)
+struct ModuleInfo {
+    uintptr_t loadBias;  // Runtime address minus ELF virtual address (dlpi_addr)
+    uintptr_t start;     // Lowest address covered by a PT_LOAD segment
+    uintptr_t end;       // One past the highest address covered by a PT_LOAD segment
+    uint8_t buildId[kMaxBuildIdSize];
+    uint32_t buildIdSize;  // 0 when the module has no NT_GNU_BUILD_ID note
+    char path[kMaxModulePath];
+    uintptr_t ehFrameHdr;  // Runtime address of .eh_frame_hdr (PT_GNU_EH_FRAME), 0 if unknown
+    bool framePointers;    // Most functions keep a frame pointer (see dwarf_unwinder.h)
+};
+
+struct ModuleSnapshot;
+
+// Module containing the address in an array sorted by start, or nullptr
+const ModuleInfo* FindModule(const ModuleInfo* modules, size_t count, uintptr_t address);
+
+// Address-to-module lookup used when laying out a report: the live module map inside the
+// process, or the module list stored in a binary report when converting it offline.
+class ModuleLookup {
+public:
+    virtual const ModuleInfo* Find(uintptr_t address) const = 0;
+
+protected:
+    ~ModuleLookup() = default;
+};
+
+// Rebuilds the module table with dl_iterate_phdr and publishes it with an atomic pointer
+// swap (RCU style); snapshots replaced while a reader still holds them are freed later.
+// Not async-signal-safe. Called by InstallCrashHandlers() and after every dlopen/dlclose
+// that loaded or unloaded an object (this file interposes both); call it yourself if
+// modules are mapped by other means.
+bool RefreshModuleMap();
+
+// Pins the current module snapshot for the lifetime of the object. Construction is
+// lock-free and async-signal-safe, and lookups never touch the dynamic loader, so a
+// handler cannot deadlock on a loader lock held by a thread in the middle of dlopen.
+class ModuleMapView : public ModuleLookup {
+public:
+    ModuleMapView();
+    ~ModuleMapView();
+    ModuleMapView(const ModuleMapView&) = delete;
+    ModuleMapView& operator=(const ModuleMapView&) = delete;
+
+    // Module containing the address, or nullptr. Binary search over modules sorted by
+    // address; the pointer stays valid while the view is alive.
+    const ModuleInfo* Find(uintptr_t address) const override;
+
+    int Count() const;
+    const ModuleInfo& At(int index) const;  // Sorted by start address
+    const ModuleInfo* Modules() const;      // All Count() modules, or nullptr if there are none
+
+private:
+    const ModuleSnapshot* snapshot_;
+};
+
+// A fixed module list, such as one read back from a report or from another process
+class StaticModuleMap : public ModuleLookup {
+public:
+    explicit StaticModuleMap(std::vector<ModuleInfo> modules);  // Sorted here
+
+    const ModuleInfo* Find(uintptr_t address) const override;
+    const std::vector<ModuleInfo>& Modules() const { return modules_; }
+
+private:
+    std::vector<ModuleInfo> modules_;
+};
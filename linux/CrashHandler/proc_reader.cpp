@@ -0,0 +1,119 @@
+#include "proc_reader.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+ProcLineReader::ProcLineReader(const char* path) : fd_(open(path, O_RDONLY | O_CLOEXEC)) {
+}
+
+ProcLineReader::~ProcLineReader() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool ProcLineReader::NextLine(const char*& line, size_t& length) {
+    for (;;) {
+        const char* begin = buffer_ + start_;
+        const char* newline = static_cast<const char*>(memchr(begin, '\n', end_ - start_));
+        if (newline) {
+            start_ = static_cast<size_t>(newline - buffer_) + 1;
+            if (skipping_) {
+                skipping_ = false;
+                continue;
+            }
+            line = begin;
+            length = static_cast<size_t>(newline - begin);
+            return true;
+        }
+        if (fd_ < 0 || endOfFile_) {
+            if (start_ == end_ || skipping_) {
+                return false;
+            }
+            line = begin;
+            length = end_ - start_;
+            start_ = end_;
+            return true;
+        }
+        if (start_ == 0 && end_ == sizeof(buffer_)) {
+            line = buffer_;
+            length = end_;
+            start_ = end_ = 0;
+            skipping_ = true;
+            return true;
+        }
+        memmove(buffer_, begin, end_ - start_);
+        end_ -= start_;
+        start_ = 0;
+        ssize_t count = read(fd_, buffer_ + end_, sizeof(buffer_) - end_);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            endOfFile_ = true;
+        }
+        else {
+            end_ += static_cast<size_t>(count);
+        }
+        if (skipping_ && end_ == sizeof(buffer_) && !memchr(buffer_, '\n', end_)) {
+            end_ = 0;  // Still inside the long line
+        }
+    }
+}
+
+uint64_t ParseNumber(const char*& text, const char* end, unsigned base) {
+    uint64_t value = 0;
+    for (; text < end; text++) {
+        unsigned digit;
+        if (*text >= '0' && *text <= '9') {
+            digit = static_cast<unsigned>(*text - '0');
+        }
+        else if (base == 16 && *text >= 'a' && *text <= 'f') {
+            digit = static_cast<unsigned>(*text - 'a' + 10);
+        }
+        else {
+            break;
+        }
+        value = value * base + digit;
+    }
+    return value;
+}
+
+const char* SkipSpaces(const char* text, const char* end) {
+    while (text < end && *text == ' ') {
+        text++;
+    }
+    return text;
+}
+
+const char* SkipField(const char* text, const char* end) {
+    text = SkipSpaces(text, end);
+    while (text < end && *text != ' ') {
+        text++;
+    }
+    return text;
+}
+
+uint64_t ReadableExtent(uint64_t address) {
+    // "start-end perms offset dev inode    path"
+    ProcLineReader maps("/proc/self/maps");
+    const char* line;
+    size_t length;
+    while (maps.NextLine(line, length)) {
+        const char* end = line + length;
+        uint64_t start = ParseNumber(line, end, 16);
+        if (line == end || *line != '-') {
+            continue;
+        }
+        line++;
+        uint64_t stop = ParseNumber(line, end, 16);
+        if (address < start || address >= stop) {
+            continue;
+        }
+        line = SkipSpaces(line, end);
+        return line != end && *line == 'r' ? stop - address : 0;
+    }
+    return 0;
+}
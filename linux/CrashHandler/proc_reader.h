@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocation-free parsing of /proc text files (maps, statm, meminfo, ...): only open(2),
+// read(2) and a fixed buffer, so it can run in signal handlers and on an exhausted heap.
+
+constexpr size_t kProcLineBufferSize = 1024;
+
+// Reads a /proc file line by line through a fixed buffer. Lines longer than the buffer are
+// cut; the rest of such a line is skipped.
+class ProcLineReader {
+public:
+    explicit ProcLineReader(const char* path);
+    ~ProcLineReader();
+    ProcLineReader(const ProcLineReader&) = delete;
+    ProcLineReader& operator=(const ProcLineReader&) = delete;
+
+    // Next line without its newline; the pointer is valid until the next call
+    bool NextLine(const char*& line, size_t& length);
+
+private:
+    int fd_;
+    char buffer_[kProcLineBufferSize];
+    size_t start_ = 0;
+    size_t end_ = 0;
+    bool endOfFile_ = false;
+    bool skipping_ = false;  // Dropping the rest of a line that did not fit
+};
+
+// Parses a number in the given base (10 or 16, lowercase) at text, advancing it past the digits
+uint64_t ParseNumber(const char*& text, const char* end, unsigned base);
+
+const char* SkipSpaces(const char* text, const char* end);
+
+// Skips leading spaces and then one space-separated field
+const char* SkipField(const char* text, const char* end);
+
+// Bytes from address to the end of the readable mapping of this process that holds it, from
+// /proc/self/maps; 0 if no readable mapping does. mincore cannot tell: it also succeeds on
+// PROT_NONE guard pages.
+uint64_t ReadableExtent(uint64_t address);
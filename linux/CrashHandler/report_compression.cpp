@@ -0,0 +1,170 @@
+#include "report_compression.h"
+
+#include <cstring>
+#include <sys/mman.h>
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;        // The LZ4 format ends every block with this many literals or more
+constexpr size_t kMatchSafeDistance = 12;  // ... and starts its last match at least this far from the end
+constexpr size_t kMaxOffset = 65535;
+constexpr int kSkipShift = 6;  // After 64 bytes without a match, test every other position, and so on
+
+uint32_t Read32(const uint8_t* bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+uint32_t HashOf(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kCompressionHashBits);
+}
+
+// The part of a length past the 15 its token nibble holds: 255s, then the remainder
+uint8_t* WriteLength(uint8_t* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+bool ReadLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    for (;;) {
+        if (in == end) {
+            return false;
+        }
+        uint8_t byte = *in++;
+        length += byte;
+        if (byte != 255) {
+            return true;
+        }
+    }
+}
+
+// One sequence: token, literal run and, unless matchLength is 0 (the last sequence), the match
+uint8_t* WriteSequence(uint8_t* out, const uint8_t* literals, size_t literalLength, size_t offset,
+    size_t matchLength) {
+    uint8_t* token = out++;
+    *token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+    if (literalLength >= 15) {
+        out = WriteLength(out, literalLength - 15);
+    }
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength == 0) {
+        return out;
+    }
+    *out++ = static_cast<uint8_t>(offset);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    size_t code = matchLength - kMinMatch;
+    *token |= static_cast<uint8_t>(code < 15 ? code : 15);
+    if (code >= 15) {
+        out = WriteLength(out, code - 15);
+    }
+    return out;
+}
+
+}  // namespace
+
+CompressionState* AllocateCompressionState() {
+    void* memory = mmap(nullptr, sizeof(CompressionState), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? nullptr : static_cast<CompressionState*>(memory);
+}
+
+void ReleaseCompressionState(CompressionState* state) {
+    if (state) {
+        munmap(state, sizeof(CompressionState));
+    }
+}
+
+size_t CompressBlock(const uint8_t* input, size_t size, uint8_t* output, uint32_t* table) {
+    // The table is not cleared: an entry left by an earlier block is checked like any other
+    // candidate, so it only costs a missed or an extra match, and small sections stay cheap
+    const uint8_t* end = input + size;
+    const uint8_t* anchor = input;  // Start of the pending literal run
+    uint8_t* out = output;
+    if (size > kMatchSafeDistance) {
+        const uint8_t* matchLimit = end - kLastLiterals;
+        const uint8_t* lastMatchStart = end - kMatchSafeDistance;
+        const uint8_t* position = input;
+        while (position <= lastMatchStart) {
+            uint32_t sequence = Read32(position);
+            uint32_t& slot = table[HashOf(sequence)];
+            size_t candidateOffset = slot;
+            size_t positionOffset = static_cast<size_t>(position - input);
+            slot = static_cast<uint32_t>(positionOffset);
+            if (candidateOffset >= positionOffset || positionOffset - candidateOffset > kMaxOffset ||
+                Read32(input + candidateOffset) != sequence) {
+                position += 1 + (static_cast<size_t>(position - anchor) >> kSkipShift);
+                continue;
+            }
+            const uint8_t* candidate = input + candidateOffset;
+            while (position > anchor && candidate > input && position[-1] == candidate[-1]) {
+                position--;
+                candidate--;
+            }
+            size_t length = kMinMatch;
+            while (position + length < matchLimit && position[length] == candidate[length]) {
+                length++;
+            }
+            out = WriteSequence(out, anchor, static_cast<size_t>(position - anchor),
+                static_cast<size_t>(position - candidate), length);
+            position += length;
+            anchor = position;
+        }
+    }
+    out = WriteSequence(out, anchor, static_cast<size_t>(end - anchor), 0, 0);
+    size_t compressed = static_cast<size_t>(out - output);
+    return compressed < size ? compressed : 0;
+}
+
+bool DecompressBlock(const uint8_t* input, size_t size, uint8_t* output, size_t rawSize) {
+    const uint8_t* in = input;
+    const uint8_t* inEnd = input + size;
+    uint8_t* out = output;
+    uint8_t* outEnd = output + rawSize;
+    while (in < inEnd) {
+        uint8_t token = *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(in, inEnd, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+        if (in == inEnd) {
+            break;  // The last sequence has no match
+        }
+
+        if (inEnd - in < 2) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(in[0]) | static_cast<size_t>(in[1]) << 8;
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(in, inEnd, matchLength)) {
+            return false;
+        }
+        matchLength += kMinMatch;
+        if (offset == 0 || offset > static_cast<size_t>(out - output) || matchLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        const uint8_t* match = out - offset;
+        if (offset >= matchLength) {
+            memcpy(out, match, matchLength);
+        }
+        else {
+            for (size_t i = 0; i < matchLength; i++) {
+                out[i] = match[i];  // Overlapping: repeats the last offset bytes
+            }
+        }
+        out += matchLength;
+    }
+    return out == outEnd;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Dependency-free block compressor for binary report sections.
+//
+// ReportWriter cuts a compressed section into blocks of up to kCompressionBlockSize bytes
+// as it is appended to, and writes every full block straight out (see CompressedBlockHeader
+// in crash_report_format.h). Blocks use the LZ4 block format: one greedy pass that looks up
+// the next 4 bytes in a table of recent positions, emitting literal runs and back references
+// of up to 64 KB. That runs at a few hundred MB/s to GB/s and shrinks the zero-padded records
+// and clustered addresses a report is made of several times over. Blocks are independent, so
+// a damaged block only loses itself.
+//
+// The compressor works on a CompressionState mapped at install time and touches no heap and
+// little stack, so it can run in a signal handler; decompression is bounds-checked against
+// corrupt input.
+
+constexpr size_t kCompressionBlockSize = 64 * 1024;
+// Worst case output for incompressible input: the literals plus their length bytes
+constexpr size_t kCompressedBlockBound = kCompressionBlockSize + kCompressionBlockSize / 255 + 16;
+constexpr int kCompressionHashBits = 12;
+
+struct CompressionState {
+    uint32_t table[1u << kCompressionHashBits];  // Block offsets by hash of the 4 bytes there; any values are valid
+    uint8_t input[kCompressionBlockSize];        // The block being filled
+    size_t inputSize;
+    uint8_t output[kCompressedBlockBound];
+};
+
+// Not async-signal-safe; call at install time. nullptr if the mapping fails.
+CompressionState* AllocateCompressionState();
+void ReleaseCompressionState(CompressionState* state);
+
+// Compresses size bytes (at most kCompressionBlockSize) into output, which must hold
+// kCompressedBlockBound bytes. Returns the compressed size, or 0 if that is not smaller
+// than the input, in which case the block is better stored as it is.
+size_t CompressBlock(const uint8_t* input, size_t size, uint8_t* output, uint32_t* table);
+
+// Decodes a block into exactly rawSize bytes. False if the block is corrupt or does not
+// decode to rawSize bytes; nothing outside input and output is touched either way.
+bool DecompressBlock(const uint8_t* input, size_t size, uint8_t* output, size_t rawSize);
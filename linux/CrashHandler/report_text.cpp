@@ -0,0 +1,295 @@
+#include "report_text.h"
+
+#include <signal.h>
+
+namespace {
+
+constexpr int kRegistersPerLine = 4;
+
+const char* SignalName(int signalNumber) {
+    switch (signalNumber) {
+    case SIGSEGV: return "SIGSEGV";
+    case SIGBUS: return "SIGBUS";
+    case SIGILL: return "SIGILL";
+    case SIGFPE: return "SIGFPE";
+    case SIGABRT: return "SIGABRT";
+    case SIGTRAP: return "SIGTRAP";
+    case SIGSYS: return "SIGSYS";
+    case SIGQUIT: return "SIGQUIT";
+    case SIGUSR1: return "SIGUSR1";
+    case SIGUSR2: return "SIGUSR2";
+    default: return "unknown signal";
+    }
+}
+
+const char* HandlerKindName(uint32_t handlerKind) {
+    switch (static_cast<HandlerKind>(handlerKind)) {
+    case HandlerKind::FatalSignal: return "fatal-signal";
+    case HandlerKind::Terminate: return "terminate";
+    case HandlerKind::NewHandler: return "new-handler";
+    default: return "unknown";
+    }
+}
+
+// Tells running into a limit apart from a request that should have fit
+const char* OutOfMemoryCause(size_t requestSize, const MemoryUsage& usage) {
+    if (usage.addressSpaceLimit > 0 && usage.mappedBytes + requestSize > usage.addressSpaceLimit) {
+        return "address space limit reached";
+    }
+    if (usage.availableBytes > 0 && requestSize > usage.availableBytes) {
+        return "system memory exhausted";
+    }
+    if (requestSize == 0) {
+        return "unknown";
+    }
+    return "request fits in free memory (fragmentation or overcommit policy)";
+}
+
+}  // namespace
+
+void WriteReportHeadline(SafeWriter& writer, const ExceptionRecord& exception) {
+    switch (static_cast<HandlerKind>(exception.handlerKind)) {
+    case HandlerKind::FatalSignal:
+        writer.Append("Fatal signal handler called\n");
+        break;
+    case HandlerKind::Terminate:
+        writer.Append("Terminate handler: called\n");
+        break;
+    case HandlerKind::NewHandler:
+        writer.Append("New handler called: Out of memory!\n");
+        break;
+    default:
+        writer.Append("Unknown handler called\n");
+        break;
+    }
+}
+
+void WriteReportDetails(SafeWriter& writer, const ExceptionRecord& exception) {
+    if (exception.handlerKind == static_cast<uint32_t>(HandlerKind::FatalSignal)) {
+        writer.Append("Signal: ").Append(SignalName(exception.signalNumber))
+            .Append(" (").AppendDec(exception.signalNumber).Append(")\n");
+        writer.Append("Signal code: ").AppendSignedDec(exception.signalCode).NewLine();
+        if (exception.flags & kExceptionHasFaultAddress) {
+            writer.Append("Fault address: ").AppendHex(exception.faultAddress).NewLine();
+        }
+    }
+    else if (exception.handlerKind == static_cast<uint32_t>(HandlerKind::Terminate)) {
+        if (exception.flags & kExceptionHasCurrentException) {
+            writer.Append("Terminate handler: Exception type: ").Append(exception.exceptionType).NewLine();
+            if (exception.flags & kExceptionIsStdException) {
+                writer.Append("Terminate handler: Exception message: ").Append(exception.exceptionMessage).NewLine();
+            }
+            else {
+                writer.Append("Terminate handler: Unknown exception type\n");
+            }
+        }
+        else {
+            writer.Append("Terminate handler: No current exception\n");
+        }
+    }
+    writer.Append("Thread ID: ").AppendDec(static_cast<uint32_t>(exception.threadId)).NewLine();
+}
+
+void WriteFingerprint(SafeWriter& writer, const FingerprintRecord& fingerprint) {
+    writer.Append("Fingerprint: ").AppendHex(fingerprint.fingerprint);
+    if (fingerprint.previousCount > 0) {
+        writer.Append(" (seen ").AppendDec(fingerprint.previousCount).Append(" times before)");
+    }
+    writer.NewLine();
+}
+
+void WriteThreadHeader(SafeWriter& writer, int32_t threadId, uint32_t flags) {
+    if (flags & kThreadThrowSite) {
+        writer.Append("Exception thrown by thread ID: ").AppendDec(static_cast<uint32_t>(threadId)).NewLine();
+        return;
+    }
+    writer.Append("Thread ID: ").AppendDec(static_cast<uint32_t>(threadId));
+    if (flags & kThreadNoResponse) {
+        writer.Append(" (did not respond)");
+    }
+    writer.NewLine();
+}
+
+void WriteRegisters(SafeWriter& writer, const RegisterRecord& registers) {
+    writer.Append("Registers:");
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < registers.count && i < kMaxRegisters; i++) {
+        const char* name = RegisterName(static_cast<RegisterArch>(registers.arch), i);
+        if (!name) {
+            break;
+        }
+        writer.Append(written % kRegistersPerLine == 0 ? "\n" : " ")
+            .Append(name).AppendChar(' ').AppendHex(registers.values[i]);
+        written++;
+    }
+    writer.NewLine();
+}
+
+void WriteMemoryUsage(SafeWriter& writer, size_t requestSize, const MemoryUsage& usage) {
+    if (requestSize > 0) {
+        writer.Append("Failed allocation size: ").AppendDec(requestSize).Append(" bytes\n");
+    }
+    writer.Append("Resident memory: ").AppendDec(usage.residentBytes).Append(" bytes\n");
+    writer.Append("Mapped memory: ").AppendDec(usage.mappedBytes).Append(" bytes in ")
+        .AppendDec(static_cast<uint64_t>(usage.mappingCount)).Append(" mappings\n");
+    writer.Append("Address space limit: ");
+    if (usage.addressSpaceLimit > 0) {
+        writer.AppendDec(usage.addressSpaceLimit).Append(" bytes\n");
+    }
+    else {
+        writer.Append("unlimited\n");
+    }
+    if (usage.availableBytes > 0) {
+        writer.Append("Available system memory: ").AppendDec(usage.availableBytes).Append(" bytes\n");
+    }
+    for (int i = 0; i < usage.largestCount; i++) {
+        const MemoryMapping& mapping = usage.largest[i];
+        writer.Append("Largest mapping ").AppendDec(static_cast<uint64_t>(i)).Append(": ")
+            .AppendHex(mapping.start).Append("-").AppendHex(mapping.end).Append(" ")
+            .AppendDec(mapping.end - mapping.start).Append(" bytes ")
+            .Append(mapping.name[0] != '\0' ? mapping.name : "[anonymous]").NewLine();
+    }
+    writer.Append("Likely cause: ").Append(OutOfMemoryCause(requestSize, usage)).NewLine();
+}
+
+void WriteHeapSiteHeader(SafeWriter& writer, int index, const HeapSiteSummary& site) {
+    writer.Append("Heap site ").AppendDec(static_cast<uint64_t>(index)).Append(": ")
+        .AppendDec(site.liveBytes).Append(" bytes live in ").AppendDec(site.liveSamples).Append(" samples, ")
+        .AppendDec(site.allocatedBytes).Append(" bytes allocated, fingerprint ").AppendHex(site.fingerprint).NewLine();
+}
+
+void WriteThrowSiteHeader(SafeWriter& writer, int index, const ThrowSiteSummary& site) {
+    writer.Append("Throw site ").AppendDec(static_cast<uint64_t>(index)).Append(": ")
+        .AppendDec(site.throwsPerSecond).Append(" throws/s, ").AppendDec(site.recentThrows).Append(" in the interval, ")
+        .AppendDec(site.totalThrows).Append(" in all, type ").Append(site.type ? site.type->name() : "unknown").NewLine();
+}
+
+void WriteHangReportHeadline(SafeWriter& writer, int stalledThreads, int requestSignal, uint64_t skippedDumps) {
+    writer.Append("Hang detector: ");
+    if (requestSignal != 0) {
+        writer.Append("thread dump requested by ").Append(SignalName(requestSignal))
+            .Append(" (").AppendDec(static_cast<uint32_t>(requestSignal)).Append(")");
+        if (stalledThreads > 0) {
+            writer.Append(", ");
+        }
+    }
+    if (stalledThreads > 0) {
+        writer.AppendDec(static_cast<uint32_t>(stalledThreads)).Append(stalledThreads == 1 ? " thread" : " threads")
+            .Append(" stalled");
+    }
+    writer.NewLine();
+    if (skippedDumps > 0) {
+        writer.Append("Dumps skipped by the rate limit: ").AppendDec(skippedDumps).NewLine();
+    }
+}
+
+void WriteStalledThreadHeader(SafeWriter& writer, int32_t threadId, const char* name, uint64_t stalledMillis,
+    uint32_t deadlineMillis, uint32_t flags) {
+    writer.Append("Stalled thread ID: ").AppendDec(static_cast<uint32_t>(threadId));
+    if (name) {
+        writer.Append(" (").Append(name).AppendChar(')');
+    }
+    writer.Append(", no progress for ").AppendDec(stalledMillis).Append(" ms, deadline ").AppendDec(deadlineMillis)
+        .Append(" ms");
+    if (flags & kThreadNoResponse) {
+        writer.Append(" (did not respond)");
+    }
+    writer.NewLine();
+}
+
+void WriteStackMemorySummary(SafeWriter& writer, const StackMemoryRecord& record) {
+    writer.Append("Stack memory: ").AppendDec(record.size).Append(" bytes at ").AppendHex(record.address).NewLine();
+}
+
+void WriteFlightEvents(SafeWriter& writer, const FlightEventRecord* events, int count) {
+    for (int i = 0; i < count; i++) {
+        const FlightEventRecord& event = events[i];
+        if (i == 0 || event.threadId != events[i - 1].threadId) {
+            writer.Append("Flight recorder of thread ID ").AppendSignedDec(event.threadId).Append(":\n");
+        }
+        writer.Append("Event ").AppendDec(event.eventId).Append(" at -")
+            .AppendDec(static_cast<uint64_t>(event.ageNanos > 0 ? event.ageNanos : 0) / 1000).Append(" us:");
+        if (event.flags & kFlightEventText) {
+            writer.Append(" \"");
+            for (size_t j = 0; j < kFlightEventTextSize - 1 && event.text[j] != '\0'; j++) {
+                writer.AppendChar(event.text[j]);
+            }
+            writer.AppendChar('"');
+        }
+        else {
+            for (int j = 0; j < kFlightEventValues; j++) {
+                writer.AppendChar(' ').AppendSignedDec(event.values[j]);
+            }
+        }
+        writer.NewLine();
+    }
+}
+
+void WriteReportJson(SafeWriter& writer, const ExceptionRecord& exception, uint64_t fingerprint,
+    const uintptr_t* frames, int count, const ModuleLookup& modules) {
+    writer.Append("{\"handler\":\"").Append(HandlerKindName(exception.handlerKind)).AppendChar('"');
+    if (exception.handlerKind == static_cast<uint32_t>(HandlerKind::FatalSignal)) {
+        writer.Append(",\"signal\":\"").Append(SignalName(exception.signalNumber))
+            .Append("\",\"signalNumber\":").AppendDec(static_cast<uint32_t>(exception.signalNumber))
+            .Append(",\"signalCode\":").AppendSignedDec(exception.signalCode);
+        if (exception.flags & kExceptionHasFaultAddress) {
+            writer.Append(",\"faultAddress\":\"").AppendHex(exception.faultAddress).AppendChar('"');
+        }
+    }
+    if (exception.flags & kExceptionHasCurrentException) {
+        writer.Append(",\"exceptionType\":");
+        AppendJsonString(writer, exception.exceptionType);
+        if (exception.flags & kExceptionIsStdException) {
+            writer.Append(",\"exceptionMessage\":");
+            AppendJsonString(writer, exception.exceptionMessage);
+        }
+    }
+    writer.Append(",\"thread\":").AppendDec(static_cast<uint32_t>(exception.threadId));
+    if (fingerprint != 0) {
+        writer.Append(",\"fingerprint\":\"").AppendHex(fingerprint).AppendChar('"');
+    }
+    writer.Append(",\"trace\":");
+    ReportModules used;
+    StackFormatter formatter(writer, StackLayout::Json, modules, used);
+    bool fatal = exception.handlerKind != static_cast<uint32_t>(HandlerKind::NewHandler);
+    formatter.BeginStack(exception.threadId, fatal ? kThreadCrashed : 0);
+    formatter.AddFrames(frames, count);
+    formatter.EndStack();
+    formatter.Finish();
+    writer.Append("}\n");
+}
+
+void WriteTimeToFirstByte(SafeWriter& writer, uint64_t micros) {
+    writer.Append("Time to first byte: ").AppendDec(micros).Append(" us\n");
+}
+
+void WriteStackTrace(SafeWriter& writer, const uintptr_t* frames, int count,
+    const ModuleLookup& modules, const SymbolLookup* symbols) {
+    ReportModules used;
+    WriteFrames(writer, frames, count, modules, used, symbols);
+    WriteModuleList(writer, used);
+}
+
+void WriteFrames(SafeWriter& writer, const uintptr_t* frames, int count, const ModuleLookup& modules,
+    ReportModules& used, const SymbolLookup* symbols) {
+    StackFormatter formatter(writer, StackLayout::Text, modules, used, symbols);
+    formatter.BeginStack();
+    formatter.AddFrames(frames, count);
+    formatter.EndStack();
+}
+
+void WriteModuleList(SafeWriter& writer, const ReportModules& used) {
+    writer.Append("Modules:\n");
+    for (int i = 0; i < used.count; i++) {
+        const ModuleInfo* module = used.modules[i];
+        writer.Append("Module ").AppendDec(i).Append(": base ").AppendHex(module->loadBias)
+            .Append(" build-id ");
+        if (module->buildIdSize > 0) {
+            writer.AppendHexBytes(module->buildId, module->buildIdSize);
+        }
+        else {
+            writer.Append("none");
+        }
+        writer.Append(" path ").Append(module->path[0] ? module->path : "(unknown)").NewLine();
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "crash_report_format.h"
+#include "heap_profiler.h"
+#include "memory_reserve.h"
+#include "module_map.h"
+#include "safe_writer.h"
+#include "stack_formatter.h"
+#include "symbol_cache.h"
+#include "throw_profiler.h"
+
+#include <cstdint>
+
+// Text layout of a crash report. The handlers and the binary report converter both go
+// through these functions, so a report looks the same whichever way it was produced.
+// Stacks are laid out by StackFormatter (stack_formatter.h), which can also write them as JSON.
+// Frames are written unsymbolized:
+//
+//   Stack trace:
+//   Frame 0: 0x55d0c1a2b8a4 (module 0 + 0x18a4)
+//   Frame 1: 0x7f3c2d445f1a (unknown module)
+//   Modules:
+//   Module 0: base 0x55d0c1a2a000 build-id 5e1f...c3 path /opt/app/server
+//
+// crash_symbolizer reads this back later and rewrites the frames into the layout of
+// PrintStackTrace() in crash_handler_windows.cpp ("Frame 0: name - 0x...").
+// Non-fatal handlers may resolve symbols in-process through the symbol cache, and the crash
+// monitor from outside; those frames are written as "Frame 0: name - 0x... (module 0 + 0x18a4)".
+
+// First line of a report ("Fatal signal handler called", ...). Written and flushed before
+// anything else, so it is the line time to first byte is measured on.
+void WriteReportHeadline(SafeWriter& writer, const ExceptionRecord& exception);
+
+// Signal, fault address, exception type and message, and thread lines
+void WriteReportDetails(SafeWriter& writer, const ExceptionRecord& exception);
+
+// "Fingerprint: 0x...", plus how often it was seen before when the crash index knew it
+void WriteFingerprint(SafeWriter& writer, const FingerprintRecord& fingerprint);
+
+// Header of every stack after the crashing thread's ("Thread ID: 42", plus a note if the
+// thread did not respond to the dump request), or "Exception thrown by thread ID: 42" for
+// the stack that threw the exception of a terminate report
+void WriteThreadHeader(SafeWriter& writer, int32_t threadId, uint32_t flags);
+
+// Register values, four per line
+void WriteRegisters(SafeWriter& writer, const RegisterRecord& registers);
+
+// Writes the frames followed by the modules they belong to. Async-signal-safe unless
+// symbols are given; ProcessSymbolCache() resolves through the symbol cache (see symbol_cache.h).
+void WriteStackTrace(SafeWriter& writer, const uintptr_t* frames, int count,
+    const ModuleLookup& modules, const SymbolLookup* symbols = nullptr);
+
+// The two halves of WriteStackTrace, for reports with several stacks:
+// WriteFrames for each stack, then WriteModuleList once.
+void WriteFrames(SafeWriter& writer, const uintptr_t* frames, int count, const ModuleLookup& modules,
+    ReportModules& used, const SymbolLookup* symbols = nullptr);
+void WriteModuleList(SafeWriter& writer, const ReportModules& used);
+
+// Out-of-memory details of a new handler report: the failed request, resident and mapped
+// memory against the limits, the largest mappings and a guess at the cause
+void WriteMemoryUsage(SafeWriter& writer, size_t requestSize, const MemoryUsage& usage);
+
+// Header of a heap profiler site's stack ("Heap site 0: 400000000 bytes live in 10 samples, ...")
+void WriteHeapSiteHeader(SafeWriter& writer, int index, const HeapSiteSummary& site);
+
+// Header of a throw site's stack in a throw site dump ("Throw site 0: 1200000 throws/s,
+// 2400000 in the interval, 9000000 in all, type St13runtime_error")
+void WriteThrowSiteHeader(SafeWriter& writer, int index, const ThrowSiteSummary& site);
+
+// First line of a hang detector dump ("Hang detector: 2 threads stalled", "Hang detector:
+// thread dump requested by SIGUSR2 (12)"), plus how many dumps the rate limit skipped since
+// the previous one
+void WriteHangReportHeadline(SafeWriter& writer, int stalledThreads, int requestSignal, uint64_t skippedDumps);
+
+// Header of a stalled thread's stack ("Stalled thread ID: 42 (worker), no progress for
+// 5012 ms, deadline 2000 ms"), plus a note if the thread did not respond to the dump request
+void WriteStalledThreadHeader(SafeWriter& writer, int32_t threadId, const char* name, uint64_t stalledMillis,
+    uint32_t deadlineMillis, uint32_t flags);
+
+// Summary of a stack memory copy in a binary report ("Stack memory: 65536 bytes at 0x7ffc..."),
+// written after the stack of the thread it belongs to
+void WriteStackMemorySummary(SafeWriter& writer, const StackMemoryRecord& record);
+
+// Flight recorder events under one header per thread ("Flight recorder of thread ID 42:"),
+// one line each with its age and values or text ("Event 7 at -1523 us: 1 2 3")
+void WriteFlightEvents(SafeWriter& writer, const FlightEventRecord* events, int count);
+
+// The report as one line of JSON for log pipelines: handler kind, signal, fault address,
+// exception type and message, thread and fingerprint, plus the stack in the JSON layout of
+// StackFormatter under "trace". Async-signal-safe.
+void WriteReportJson(SafeWriter& writer, const ExceptionRecord& exception, uint64_t fingerprint,
+    const uintptr_t* frames, int count, const ModuleLookup& modules);
+
+void WriteTimeToFirstByte(SafeWriter& writer, uint64_t micros);
@@ -0,0 +1,131 @@
+#include "safe_writer.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+}  // namespace
+
+bool SafeWriteAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;  // Nothing sensible left to do from inside a crash handler
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+SafeWriter::SafeWriter(char* buffer, size_t capacity, int fd)
+    : buffer_(buffer), capacity_(capacity), size_(0), fd_(fd), flush_(nullptr), flushContext_(nullptr),
+      flushed_(false) {
+}
+
+SafeWriter::SafeWriter(char* buffer, size_t capacity, FlushFunction flush, void* context)
+    : buffer_(buffer), capacity_(capacity), size_(0), fd_(-1), flush_(flush), flushContext_(context),
+      flushed_(false) {
+}
+
+SafeWriter& SafeWriter::Append(const char* text) {
+    if (!text) {
+        return Append("(null)");
+    }
+    return Append(text, strlen(text));
+}
+
+SafeWriter& SafeWriter::Append(const char* text, size_t length) {
+    while (length > 0) {
+        if (size_ == capacity_) {
+            Flush();
+            if (size_ == capacity_) {
+                return *this;  // No file descriptor to drain into: drop the rest
+            }
+        }
+        size_t chunk = capacity_ - size_;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(buffer_ + size_, text, chunk);  // memcpy and strlen are async-signal-safe (POSIX.1-2016)
+        size_ += chunk;
+        text += chunk;
+        length -= chunk;
+    }
+    return *this;
+}
+
+SafeWriter& SafeWriter::AppendChar(char c) {
+    return Append(&c, 1);
+}
+
+SafeWriter& SafeWriter::AppendDec(uint64_t value) {
+    // Filled from the end, so the digits come out in order without a second pass
+    char text[20];
+    size_t first = sizeof(text);
+    do {
+        text[--first] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return Append(text + first, sizeof(text) - first);
+}
+
+SafeWriter& SafeWriter::AppendSignedDec(int64_t value) {
+    if (value < 0) {
+        AppendChar('-');
+        return AppendDec(0 - static_cast<uint64_t>(value));
+    }
+    return AppendDec(static_cast<uint64_t>(value));
+}
+
+SafeWriter& SafeWriter::AppendHex(uint64_t value) {
+    char text[18];
+    size_t count = 0;
+    text[count++] = '0';
+    text[count++] = 'x';
+
+    // Skip leading zeros, but always keep the last digit
+    int shift = value == 0 ? 0 : (63 - __builtin_clzll(value)) / 4 * 4;
+    for (; shift >= 0; shift -= 4) {
+        text[count++] = kHexDigits[(value >> shift) & 0xf];
+    }
+    return Append(text, count);
+}
+
+SafeWriter& SafeWriter::AppendHexBytes(const uint8_t* bytes, size_t length) {
+    char text[64];
+    while (length > 0) {
+        size_t chunk = length < sizeof(text) / 2 ? length : sizeof(text) / 2;
+        for (size_t i = 0; i < chunk; i++) {
+            text[2 * i] = kHexDigits[bytes[i] >> 4];
+            text[2 * i + 1] = kHexDigits[bytes[i] & 0xf];
+        }
+        Append(text, 2 * chunk);
+        bytes += chunk;
+        length -= chunk;
+    }
+    return *this;
+}
+
+void SafeWriter::Flush() {
+    if (size_ == 0) {
+        return;
+    }
+    if (flush_) {
+        flush_(flushContext_, buffer_, size_);
+        size_ = 0;
+        flushed_ = true;
+    }
+    else if (fd_ >= 0) {
+        SafeWriteAll(fd_, buffer_, size_);
+        size_ = 0;
+        flushed_ = true;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Writes the whole range to fd with raw write(2), retrying on EINTR and short writes.
+// Async-signal-safe: no locks, no heap, no stdio. Returns false if write(2) failed.
+bool SafeWriteAll(int fd, const char* data, size_t length);
+
+// Fixed-capacity text builder for use inside crash handlers.
+// All storage is supplied by the caller; when the buffer fills up it is flushed to the
+// file descriptor or callback (if any) so output is never silently truncated.
+class SafeWriter {
+public:
+    using FlushFunction = void (*)(void* context, const char* data, size_t length);
+
+    SafeWriter(char* buffer, size_t capacity, int fd);
+    // Hands every flushed chunk to a callback instead of a file descriptor
+    SafeWriter(char* buffer, size_t capacity, FlushFunction flush, void* context);
+
+    SafeWriter& Append(const char* text);
+    SafeWriter& Append(const char* text, size_t length);
+    SafeWriter& AppendChar(char c);
+    SafeWriter& AppendDec(uint64_t value);
+    SafeWriter& AppendSignedDec(int64_t value);
+    SafeWriter& AppendHex(uint64_t value);  // Printed with a "0x" prefix
+    SafeWriter& AppendHexBytes(const uint8_t* bytes, size_t length);  // Two digits per byte, no prefix
+    SafeWriter& NewLine() { return AppendChar('\n'); }
+
+    // Writes out everything buffered so far and empties the buffer.
+    void Flush();
+
+    const char* Data() const { return buffer_; }
+    size_t Size() const { return size_; }
+    // True once anything was written out; until then Data() holds everything appended
+    bool Flushed() const { return flushed_; }
+
+private:
+    char* buffer_;
+    size_t capacity_;
+    size_t size_;
+    int fd_;
+    FlushFunction flush_;
+    void* flushContext_;
+    bool flushed_;
+};
@@ -0,0 +1,125 @@
+#include "stack_capture.h"
+
+#include "unwinder.h"
+
+#include <atomic>
+#include <execinfo.h>
+#include <ucontext.h>
+
+namespace {
+
+std::atomic<UnwinderKind> selectedUnwinder{ UnwinderKind::Auto };
+
+}  // namespace
+
+void SetStackUnwinder(UnwinderKind kind) {
+    selectedUnwinder.store(kind);
+}
+
+UnwinderKind StackUnwinder() {
+    return selectedUnwinder.load();
+}
+
+const char* UnwinderName(UnwinderKind kind) {
+    switch (kind) {
+    case UnwinderKind::Auto: return "auto";
+    case UnwinderKind::FramePointer: return "frame-pointer";
+    case UnwinderKind::Dwarf: return "dwarf";
+    case UnwinderKind::Backtrace: return "backtrace";
+    default: return "unknown";
+    }
+}
+
+void PrepareStackCapture() {
+    // glibc's backtrace() dlopens libgcc_s on first use; do that now, outside any handler
+    void* frames[4];
+    backtrace(frames, 4);
+}
+
+int CaptureStack(uintptr_t* frames, int maxFrames, int skip) {
+    const Unwinder* unwinder = GetUnwinder(selectedUnwinder.load());
+    UnwindState state;
+    if (unwinder && UnwindStateHere(state)) {
+        // Frame 0 is this function; the walk writes into a scratch buffer to drop it and `skip`
+        uintptr_t raw[kMaxStackFrames + 16];
+        int wanted = maxFrames + skip + 1;
+        if (wanted > kMaxStackFrames + 16) {
+            wanted = kMaxStackFrames + 16;
+        }
+        ModuleMapView modules;
+        LocalUnwindMemory memory;
+        int captured = UnwindStack(*unwinder, state, memory, modules, raw, wanted);
+        int count = 0;
+        for (int i = skip + 1; i < captured && count < maxFrames; i++) {
+            frames[count++] = raw[i];
+        }
+        return count;
+    }
+
+    void* raw[kMaxStackFrames + 16];
+    int wanted = maxFrames + skip + 1;  // +1 for this function's own frame
+    if (wanted > kMaxStackFrames + 16) {
+        wanted = kMaxStackFrames + 16;
+    }
+    int captured = backtrace(raw, wanted);
+
+    int count = 0;
+    for (int i = skip + 1; i < captured && count < maxFrames; i++) {
+        frames[count++] = reinterpret_cast<uintptr_t>(raw[i]);
+    }
+    return count;
+}
+
+int CaptureStackFromContext(const void* signalContext, uintptr_t* frames, int maxFrames) {
+    if (maxFrames <= 0) {
+        return 0;
+    }
+    const Unwinder* unwinder = GetUnwinder(selectedUnwinder.load());
+    UnwindState state;
+    if (unwinder && UnwindStateFromContext(signalContext, state)) {
+        // Starts at the interrupted frame, so the handler and trampoline are never walked
+        ModuleMapView modules;
+        LocalUnwindMemory memory;
+        return UnwindStack(*unwinder, state, memory, modules, frames, maxFrames);
+    }
+
+    uintptr_t faultingPc = ContextProgramCounter(signalContext);
+    void* raw[kMaxStackFrames + 16];
+    int captured = backtrace(raw, kMaxStackFrames + 16);
+
+    // The unwinder walks through the handler and the kernel's signal trampoline before
+    // reaching the interrupted code; start the trace at the faulting instruction.
+    int first = -1;
+    for (int i = 0; i < captured; i++) {
+        if (reinterpret_cast<uintptr_t>(raw[i]) == faultingPc) {
+            first = i;
+            break;
+        }
+    }
+
+    int count = 0;
+    if (first < 0) {
+        frames[count++] = faultingPc;
+        first = captured;  // Could not line the trace up with the fault, keep only the PC
+    }
+    for (int i = first; i < captured && count < maxFrames; i++) {
+        frames[count++] = reinterpret_cast<uintptr_t>(raw[i]);
+    }
+    return count;
+}
+
+uintptr_t ContextProgramCounter(const void* signalContext) {
+    if (!signalContext) {
+        return 0;
+    }
+    const ucontext_t* context = static_cast<const ucontext_t*>(signalContext);
+#if defined(__x86_64__)
+    return static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__i386__)
+    return static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__aarch64__)
+    return static_cast<uintptr_t>(context->uc_mcontext.pc);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// Upper bound on the frames any handler records (PrintStackTrace on Windows uses 100)
+constexpr int kMaxStackFrames = 128;
+
+// How stacks are walked (see unwinder.h)
+enum class UnwinderKind {
+    Auto,          // Frame pointers where the module is built with them, DWARF elsewhere, per frame
+    FramePointer,  // Frame pointer chain only; needs -fno-omit-frame-pointer
+    Dwarf,         // .eh_frame call frame information only
+    Backtrace,     // glibc backtrace(); takes the loader lock, so not async-signal-safe
+};
+
+// Selects the unwinder used by CaptureStack() and CaptureStackFromContext(). Auto by default.
+void SetStackUnwinder(UnwinderKind kind);
+UnwinderKind StackUnwinder();
+
+const char* UnwinderName(UnwinderKind kind);
+
+// Loads and warms up the unwinder. Must be called before a handler runs, so the first
+// capture inside a signal handler does not have to go through the dynamic loader.
+void PrepareStackCapture();
+
+// Captures the return addresses of the calling thread, dropping the innermost `skip` frames.
+// Returns the number of frames written.
+int CaptureStack(uintptr_t* frames, int maxFrames, int skip);
+
+// Captures the stack of a thread interrupted by a signal. Frame 0 is the faulting
+// instruction taken from the signal context; handler and trampoline frames are dropped.
+int CaptureStackFromContext(const void* signalContext, uintptr_t* frames, int maxFrames);
+
+// Program counter stored in a ucontext_t passed to an SA_SIGINFO handler
+uintptr_t ContextProgramCounter(const void* signalContext);
@@ -0,0 +1,168 @@
+#include "stack_formatter.h"
+
+#include "crash_report_format.h"
+#include "report_text.h"
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+void AppendJsonHex(SafeWriter& writer, uint64_t value) {
+    writer.AppendChar('"').AppendHex(value).AppendChar('"');
+}
+
+}  // namespace
+
+int ReportModules::IndexOf(const ModuleInfo* module) {
+    for (int i = 0; i < count; i++) {
+        if (modules[i] == module) {
+            return i;
+        }
+    }
+    if (count == kMaxReportModules) {
+        return -1;
+    }
+    modules[count] = module;
+    return count++;
+}
+
+void AppendJsonString(SafeWriter& writer, const char* text) {
+    writer.AppendChar('"');
+    if (!text) {
+        text = "";
+    }
+    // Runs of plain characters are copied in one piece
+    const char* run = text;
+    for (const char* p = text; *p; p++) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        writer.Append(run, static_cast<size_t>(p - run));
+        run = p + 1;
+        if (c == '"' || c == '\\') {
+            char escaped[2] = { '\\', static_cast<char>(c) };
+            writer.Append(escaped, 2);
+        }
+        else {
+            char escaped[6] = { '\\', 'u', '0', '0', kHexDigits[c >> 4], kHexDigits[c & 0xf] };
+            writer.Append(escaped, 6);
+        }
+    }
+    size_t rest = 0;
+    while (run[rest] != '\0') {
+        rest++;
+    }
+    writer.Append(run, rest).AppendChar('"');
+}
+
+StackFormatter::StackFormatter(SafeWriter& writer, StackLayout layout, const ModuleLookup& modules,
+    ReportModules& used, const SymbolLookup* symbols)
+    : writer_(writer), layout_(layout), modules_(modules), used_(used), symbols_(symbols) {
+}
+
+void StackFormatter::BeginStack(int32_t threadId, uint32_t flags) {
+    frameCount_ = 0;
+    if (layout_ == StackLayout::Text) {
+        writer_.Append("Stack trace:\n");
+        return;
+    }
+    writer_.Append(stackCount_ == 0 ? "{\"stacks\":[{" : ",{");
+    if (threadId != 0) {
+        writer_.Append("\"thread\":").AppendDec(static_cast<uint32_t>(threadId)).AppendChar(',');
+    }
+    if (flags & kThreadCrashed) {
+        writer_.Append("\"crashed\":true,");
+    }
+    if (flags & kThreadNoResponse) {
+        writer_.Append("\"responded\":false,");
+    }
+    if (flags & kThreadThrowSite) {
+        writer_.Append("\"throwSite\":true,");
+    }
+    writer_.Append("\"frames\":[");
+}
+
+void StackFormatter::AddFrame(uintptr_t address) {
+    ResolvedSymbol symbol;
+    // Frames past the first are return addresses; resolve the call instruction instead
+    bool resolved = symbols_ && symbols_->Resolve(frameCount_ > 0 ? address - 1 : address, symbol);
+    const ModuleInfo* module = modules_.Find(address);
+    int index = module ? used_.IndexOf(module) : -1;
+    if (layout_ == StackLayout::Text) {
+        AddTextFrame(address, resolved ? &symbol : nullptr, module, index);
+    }
+    else {
+        AddJsonFrame(address, resolved ? &symbol : nullptr, module, index);
+    }
+    frameCount_++;
+}
+
+void StackFormatter::AddFrames(const uintptr_t* frames, int count) {
+    for (int i = 0; i < count; i++) {
+        AddFrame(frames[i]);
+    }
+}
+
+void StackFormatter::EndStack() {
+    if (layout_ == StackLayout::Json) {
+        writer_.Append("]}");
+    }
+    stackCount_++;
+}
+
+void StackFormatter::Finish() {
+    if (layout_ == StackLayout::Text) {
+        WriteModuleList(writer_, used_);
+        return;
+    }
+
+    writer_.Append(stackCount_ == 0 ? "{\"stacks\":[],\"modules\":[" : "],\"modules\":[");
+    for (int i = 0; i < used_.count; i++) {
+        const ModuleInfo* module = used_.modules[i];
+        writer_.Append(i == 0 ? "{\"index\":" : ",{\"index\":").AppendDec(i).Append(",\"base\":");
+        AppendJsonHex(writer_, module->loadBias);
+        if (module->buildIdSize > 0) {
+            writer_.Append(",\"buildId\":\"").AppendHexBytes(module->buildId, module->buildIdSize).AppendChar('"');
+        }
+        writer_.Append(",\"path\":");
+        AppendJsonString(writer_, module->path);
+        writer_.AppendChar('}');
+    }
+    writer_.Append("]}");
+}
+
+void StackFormatter::AddTextFrame(uintptr_t address, const ResolvedSymbol* symbol, const ModuleInfo* module,
+    int index) {
+    writer_.Append("Frame ").AppendDec(static_cast<uint64_t>(frameCount_)).Append(": ");
+    if (symbol) {
+        writer_.Append(symbol->name).Append(" - ").AppendHex(symbol->address);
+    }
+    else {
+        writer_.AppendHex(address);
+    }
+    if (index >= 0) {
+        writer_.Append(" (module ").AppendDec(static_cast<uint64_t>(index)).Append(" + ")
+            .AppendHex(address - module->loadBias).Append(")\n");
+    }
+    else {
+        writer_.Append(" (unknown module)\n");
+    }
+}
+
+void StackFormatter::AddJsonFrame(uintptr_t address, const ResolvedSymbol* symbol, const ModuleInfo* module,
+    int index) {
+    writer_.Append(frameCount_ == 0 ? "{\"address\":" : ",{\"address\":");
+    AppendJsonHex(writer_, address);
+    if (symbol) {
+        writer_.Append(",\"symbol\":");
+        AppendJsonString(writer_, symbol->name);
+        writer_.Append(",\"symbolAddress\":");
+        AppendJsonHex(writer_, symbol->address);
+    }
+    if (index >= 0) {
+        writer_.Append(",\"module\":").AppendDec(static_cast<uint64_t>(index)).Append(",\"offset\":");
+        AppendJsonHex(writer_, address - module->loadBias);
+    }
+    writer_.AppendChar('}');
+}
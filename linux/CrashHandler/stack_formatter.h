@@ -0,0 +1,75 @@
+#pragma once
+
+#include "module_map.h"
+#include "safe_writer.h"
+#include "symbol_cache.h"
+
+#include <cstdint>
+
+// Streaming stack formatter with a text and a JSON layout.
+//
+// Frames are written one at a time straight into a SafeWriter, so output goes to the
+// caller's fixed buffer or file descriptor with no heap allocation and no iostreams. Each
+// frame costs one module lookup, one symbol lookup if symbols are given, and a bounded
+// amount of copying, however long the stack is: the formatter is fit for signal handlers
+// (without symbols) and for tools that format stacks continuously.
+//
+// Text layout (the one report_text.h documents):
+//
+//   Stack trace:
+//   Frame 0: main - 0x55d0c1a2b880 (module 0 + 0x18a4)
+//   Modules:
+//   Module 0: base 0x55d0c1a2a000 build-id 5e1f...c3 path /opt/app/server
+//
+// JSON layout, one document on one line (without a line break, so it can be embedded):
+//
+//   {"stacks":[{"thread":42,"crashed":true,"frames":[{"address":"0x55d0c1a2b8a4",
+//   "symbol":"main","symbolAddress":"0x55d0c1a2b880","module":0,"offset":"0x18a4"}]}],
+//   "modules":[{"index":0,"base":"0x55d0c1a2a000","buildId":"5e1f...c3","path":"/opt/app/server"}]}
+
+enum class StackLayout {
+    Text,
+    Json,
+};
+
+constexpr int kMaxReportModules = 64;
+
+// Report-local module numbers, assigned in order of first use by a frame. One table is
+// shared by all stacks of a report, so the module list is written once at the end.
+struct ReportModules {
+    const ModuleInfo* modules[kMaxReportModules];
+    int count = 0;
+
+    int IndexOf(const ModuleInfo* module);  // -1 once the table is full
+};
+
+class StackFormatter {
+public:
+    StackFormatter(SafeWriter& writer, StackLayout layout, const ModuleLookup& modules, ReportModules& used,
+        const SymbolLookup* symbols = nullptr);
+
+    // Starts a stack. The text layout leaves thread headers to the caller (WriteThreadHeader);
+    // the JSON layout puts the thread id and flags (kThreadCrashed, ...) into the stack object.
+    void BeginStack(int32_t threadId = 0, uint32_t flags = 0);
+    void AddFrame(uintptr_t address);
+    void AddFrames(const uintptr_t* frames, int count);
+    void EndStack();
+
+    // Lists the modules the frames fell in; closes the JSON document
+    void Finish();
+
+private:
+    void AddTextFrame(uintptr_t address, const ResolvedSymbol* symbol, const ModuleInfo* module, int index);
+    void AddJsonFrame(uintptr_t address, const ResolvedSymbol* symbol, const ModuleInfo* module, int index);
+
+    SafeWriter& writer_;
+    StackLayout layout_;
+    const ModuleLookup& modules_;
+    ReportModules& used_;
+    const SymbolLookup* symbols_;
+    int stackCount_ = 0;
+    int frameCount_ = 0;  // In the current stack
+};
+
+// A JSON string literal, quotes included, with quotes, backslashes and control characters escaped
+void AppendJsonString(SafeWriter& writer, const char* text);
@@ -0,0 +1,238 @@
+#include "stack_memory.h"
+
+#include "proc_reader.h"
+#include "safe_writer.h"
+#include "thread_dump.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kMaxStackWindows = kMaxDumpThreads + 1;
+constexpr uint64_t kReadPageSize = 4096;  // Smallest page size; larger pages just take more iovecs
+constexpr int kReadVectorSize = 64;       // Pages per process_vm_readv call
+
+struct WindowRequest {
+    uintptr_t stackPointer;
+    uint64_t wanted;  // What the stack mapping holds from the window start, capped at the window size
+    uint64_t granted;
+    uint32_t weight;
+};
+
+uint8_t* copyBuffer = nullptr;
+size_t copyBufferSize = 0;  // The window size
+size_t reportBudget = 0;
+StackWindow windows[kMaxStackWindows];
+WindowRequest requests[kMaxStackWindows];
+
+// Places each window at its stack pointer, within the readable mapping that holds it
+void PlaceWindows(pid_t processId, int count) {
+    char path[64];
+    SafeWriter pathWriter(path, sizeof(path) - 1, -1);
+    if (processId == getpid()) {
+        pathWriter.Append("/proc/self/maps");
+    }
+    else {
+        pathWriter.Append("/proc/").AppendDec(static_cast<uint64_t>(processId)).Append("/maps");
+    }
+    path[pathWriter.Size()] = '\0';
+
+    // "start-end perms offset dev inode    path"
+    ProcLineReader maps(path);
+    const char* line;
+    size_t length;
+    while (maps.NextLine(line, length)) {
+        const char* end = line + length;
+        uint64_t start = ParseNumber(line, end, 16);
+        if (line == end || *line != '-') {
+            continue;
+        }
+        line++;
+        uint64_t stop = ParseNumber(line, end, 16);
+        line = SkipSpaces(line, end);
+        if (line == end || *line != 'r') {
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            uint64_t stackPointer = requests[i].stackPointer;
+            if (stackPointer < start || stackPointer >= stop) {
+                continue;
+            }
+            uint64_t first = stackPointer - start > kStackRedZoneBytes ? stackPointer - kStackRedZoneBytes : start;
+            windows[i].address = first;
+            requests[i].wanted = stop - first < copyBufferSize ? stop - first : copyBufferSize;
+        }
+    }
+}
+
+// Shares the budget among the windows in proportion to their weights; a window that needs
+// less than its share gets what it needs, and the rest goes round again
+void SplitBudget(int count, uint64_t budget) {
+    for (;;) {
+        uint64_t totalWeight = 0;
+        for (int i = 0; i < count; i++) {
+            if (requests[i].granted < requests[i].wanted) {
+                totalWeight += requests[i].weight;
+            }
+        }
+        if (totalWeight == 0 || budget == 0) {
+            return;
+        }
+        uint64_t unit = budget / totalWeight > 0 ? budget / totalWeight : 1;
+        for (int i = 0; i < count && budget > 0; i++) {
+            WindowRequest& request = requests[i];
+            if (request.granted >= request.wanted) {
+                continue;
+            }
+            uint64_t grant = request.wanted - request.granted;
+            if (grant > unit * request.weight) {
+                grant = unit * request.weight;
+            }
+            if (grant > budget) {
+                grant = budget;
+            }
+            request.granted += grant;
+            budget -= grant;
+        }
+    }
+}
+
+// Copies the pages of our own process that mincore reports mapped, for when seccomp
+// refuses process_vm_readv, stopping at the end of the readable mapping
+size_t CopyMappedPages(uint64_t address, size_t size, uint8_t* buffer) {
+    uint64_t extent = ReadableExtent(address);
+    if (size > extent) {
+        size = static_cast<size_t>(extent);
+    }
+    size_t done = 0;
+    while (done < size) {
+        uint64_t cursor = address + done;
+        uint64_t page = cursor & ~(kReadPageSize - 1);
+        unsigned char residency = 0;
+        if (mincore(reinterpret_cast<void*>(page), kReadPageSize, &residency) != 0) {
+            break;
+        }
+        size_t chunk = static_cast<size_t>(page + kReadPageSize - cursor);
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        memcpy(buffer + done, reinterpret_cast<const void*>(cursor), chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+// Reads size bytes at address of processId into buffer. Every page is a separate iovec, and
+// process_vm_readv stops at the first element it cannot read, so the result is the readable
+// prefix of the window.
+size_t ReadStackBytes(pid_t processId, uint64_t address, size_t size, uint8_t* buffer) {
+    size_t done = 0;
+    while (done < size) {
+        iovec local[kReadVectorSize];
+        iovec remote[kReadVectorSize];
+        int count = 0;
+        size_t batch = 0;
+        while (count < kReadVectorSize && done + batch < size) {
+            uint64_t cursor = address + done + batch;
+            size_t chunk = static_cast<size_t>(kReadPageSize - cursor % kReadPageSize);
+            if (chunk > size - done - batch) {
+                chunk = size - done - batch;
+            }
+            local[count] = { buffer + done + batch, chunk };
+            remote[count] = { reinterpret_cast<void*>(cursor), chunk };
+            count++;
+            batch += chunk;
+        }
+        ssize_t read = process_vm_readv(processId, local, static_cast<unsigned long>(count), remote,
+            static_cast<unsigned long>(count), 0);
+        if (read < 0 && (errno == ENOSYS || errno == EPERM) && processId == getpid()) {
+            return done + CopyMappedPages(address + done, size - done, buffer + done);
+        }
+        if (read <= 0) {
+            break;
+        }
+        done += static_cast<size_t>(read);
+        if (static_cast<size_t>(read) < batch) {
+            break;
+        }
+    }
+    return done;
+}
+
+}  // namespace
+
+bool PrepareStackMemory(size_t windowBytes, size_t budgetBytes) {
+    if (windowBytes == 0 || copyBuffer) {
+        return true;
+    }
+    void* memory = mmap(nullptr, windowBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    copyBuffer = static_cast<uint8_t*>(memory);
+    copyBufferSize = windowBytes;
+    reportBudget = budgetBytes;
+    return true;
+}
+
+void ReleaseStackMemory() {
+    if (!copyBuffer) {
+        return;
+    }
+    munmap(copyBuffer, copyBufferSize);
+    copyBuffer = nullptr;
+    copyBufferSize = 0;
+}
+
+bool PlanStackWindows(pid_t processId, const ThreadCapture* threads, int threadCount, StackMemoryPlan& plan) {
+    plan.processId = processId;
+    plan.windows = windows;
+    plan.windowCount = 0;
+    if (!copyBuffer) {
+        return false;
+    }
+    int count = 0;
+    for (int i = 0; i < threadCount && count < kMaxStackWindows; i++) {
+        if (threads[i].stackPointer == 0) {
+            continue;  // Did not answer the dump request, or no registers
+        }
+        windows[count] = { threads[i].threadId, 0, 0 };
+        requests[count] = { threads[i].stackPointer, 0, 0,
+            (threads[i].flags & kThreadCrashed) ? kCrashedThreadWeight : 1 };
+        count++;
+    }
+    PlaceWindows(processId, count);
+    SplitBudget(count, reportBudget);
+
+    for (int i = 0; i < count; i++) {
+        if (requests[i].granted > 0) {
+            windows[plan.windowCount] = windows[i];
+            windows[plan.windowCount].size = requests[i].granted;
+            plan.windowCount++;
+        }
+    }
+    return plan.windowCount > 0;
+}
+
+void WriteStackMemory(ReportWriter& writer, const StackMemoryPlan& plan) {
+    for (int i = 0; i < plan.windowCount; i++) {
+        const StackWindow& window = plan.windows[i];
+        size_t wanted = window.size < copyBufferSize ? static_cast<size_t>(window.size) : copyBufferSize;
+        size_t size = copyBuffer ? ReadStackBytes(plan.processId, window.address, wanted, copyBuffer) : 0;
+        if (size == 0) {
+            continue;
+        }
+        StackMemoryRecord record = {};
+        record.threadId = window.threadId;
+        record.address = window.address;
+        record.size = size;
+        writer.BeginSection(SectionType::StackMemory, 1);
+        writer.Append(&record, sizeof(record));
+        writer.Append(copyBuffer, size);
+        writer.EndSection();
+    }
+}
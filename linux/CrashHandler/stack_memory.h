@@ -0,0 +1,51 @@
+#pragma once
+
+#include "crash_report_writer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+// Stack memory windows for binary reports.
+//
+// A report can carry a copy of each captured thread's stack, from just below its stack
+// pointer upwards, so frames the unwinder could not step through can be unwound and locals
+// inspected offline. Each window is clamped to the readable mapping that holds the stack
+// pointer in /proc/<pid>/maps. One byte budget per report is split across the threads by
+// priority: the crashing thread weighs kCrashedThreadWeight times as much as the others,
+// and what a short stack leaves over goes to the rest. Memory is read with process_vm_readv,
+// so a page unmapped in the meantime ends a window instead of faulting the handler.
+//
+// The copy buffer and the window table are allocated by PrepareStackMemory(); planning and
+// writing only read /proc with a fixed buffer, so both are async-signal-safe. Only one
+// report may use them at a time.
+
+constexpr uint32_t kCrashedThreadWeight = 4;
+constexpr size_t kStackRedZoneBytes = 128;  // Below the stack pointer; leaf functions keep locals there on x86-64
+
+// A stretch of one thread's stack
+struct StackWindow {
+    int32_t threadId;
+    uint64_t address;
+    uint64_t size;
+};
+
+// Windows planned for one report, read from processId
+struct StackMemoryPlan {
+    pid_t processId;
+    const StackWindow* windows;
+    int windowCount;
+};
+
+// Maps the copy buffer for windows of up to windowBytes; 0 disables stack memory. Not
+// async-signal-safe; call at install time.
+bool PrepareStackMemory(size_t windowBytes, size_t budgetBytes);
+void ReleaseStackMemory();
+
+// Plans a window for every thread with a known stack pointer. False if stack memory is
+// disabled or no window could be placed.
+bool PlanStackWindows(pid_t processId, const ThreadCapture* threads, int threadCount, StackMemoryPlan& plan);
+
+// Copies the planned windows into the report, one StackMemory section each. A window that
+// cannot be read in full is cut at the first unreadable page.
+void WriteStackMemory(ReportWriter& writer, const StackMemoryPlan& plan);
@@ -0,0 +1,181 @@
+#include "symbol_cache.h"
+
+#include "elf_symbols.h"
+#include "module_map.h"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Symbols of one module, searchable by ELF virtual address
+class ModuleSymbolIndex {
+public:
+    explicit ModuleSymbolIndex(const ElfSymbolTable& table) {
+        const std::vector<ElfSymbol>& symbols = table.Symbols();
+        count_ = symbols.size();
+        starts_.reserve(count_);
+        ends_.reserve(count_);
+        nameOffsets_.reserve(count_);
+        for (size_t i = 0; i < count_; i++) {
+            starts_.push_back(symbols[i].address);
+            // Symbols without a size extend up to the next symbol
+            uint64_t end = symbols[i].size != 0 ? symbols[i].address + symbols[i].size
+                : (i + 1 < count_ ? symbols[i + 1].address : symbols[i].address + 1);
+            ends_.push_back(end);
+            nameOffsets_.push_back(static_cast<uint32_t>(names_.size()));
+            names_.append(symbols[i].name).push_back('\0');
+        }
+        demangled_.resize(count_);
+
+        layout_.resize(count_ + 1);
+        rank_.resize(count_ + 1);
+        size_t next = 0;
+        FillLayout(next, 1);
+    }
+
+    // Sorted position of the symbol containing the address, or -1
+    long Find(uint64_t address) const {
+        // Eytzinger upper bound: descend left/right, then strip the trailing right turns
+        size_t k = 1;
+        while (k <= count_) {
+            if (8 * k <= count_) {
+                __builtin_prefetch(&layout_[8 * k]);  // Eight 8-byte keys per cache line
+            }
+            k = 2 * k + (layout_[k] <= address);
+        }
+        k >>= __builtin_ffsll(~static_cast<long long>(k));
+        size_t upper = k ? rank_[k] : count_;  // First symbol starting after the address
+        if (upper == 0) {
+            return -1;
+        }
+        size_t index = upper - 1;
+        return address < ends_[index] ? static_cast<long>(index) : -1;
+    }
+
+    uint64_t Start(long index) const { return starts_[index]; }
+
+    // Demangled lazily: most symbols of a library are never looked up
+    const char* Name(long index) {
+        std::unique_ptr<std::string>& demangled = demangled_[index];
+        if (!demangled) {
+            demangled.reset(new std::string(DemangleSymbol(names_.c_str() + nameOffsets_[index])));
+        }
+        return demangled->c_str();
+    }
+
+private:
+    // In-order walk of the implicit tree assigns the sorted keys to BFS positions
+    void FillLayout(size_t& next, size_t k) {
+        if (k > count_) {
+            return;
+        }
+        FillLayout(next, 2 * k);
+        layout_[k] = starts_[next];
+        rank_[k] = static_cast<uint32_t>(next);
+        next++;
+        FillLayout(next, 2 * k + 1);
+    }
+
+    size_t count_ = 0;
+    std::vector<uint64_t> layout_;  // 1-based Eytzinger order of starts_
+    std::vector<uint32_t> rank_;    // Sorted position of each layout_ slot
+    std::vector<uint64_t> starts_;
+    std::vector<uint64_t> ends_;
+    std::vector<uint32_t> nameOffsets_;
+    std::string names_;
+    std::vector<std::unique_ptr<std::string>> demangled_;
+};
+
+// A module is known by where it was loaded and by what it is: a library unloaded and another
+// loaded at the same address must not inherit its symbols. Entries of unloaded modules are kept,
+// because the names they handed out stay valid for the life of the process.
+struct CachedModule {
+    uintptr_t loadBias;
+    uintptr_t start;
+    uint8_t buildId[kMaxBuildIdSize];
+    uint32_t buildIdSize;
+    std::string path;  // Compared only when the module has no build id
+    std::unique_ptr<ModuleSymbolIndex> index;  // nullptr if the module has no readable symbols
+};
+
+std::mutex cacheMutex;
+std::vector<CachedModule>* cachedModules = nullptr;  // Leaked on purpose: lives as long as the process
+thread_local bool insideSymbolCache = false;
+
+class ProcessSymbols final : public SymbolLookup {
+public:
+    bool Resolve(uintptr_t address, ResolvedSymbol& symbol) const override {
+        return ResolveSymbol(address, symbol);
+    }
+};
+
+bool SameModule(const CachedModule& cached, const ModuleInfo& module) {
+    if (cached.loadBias != module.loadBias || cached.start != module.start ||
+        cached.buildIdSize != module.buildIdSize) {
+        return false;
+    }
+    return module.buildIdSize != 0 ? memcmp(cached.buildId, module.buildId, module.buildIdSize) == 0
+        : cached.path == module.path;
+}
+
+ModuleSymbolIndex* IndexForModule(const ModuleInfo& module) {
+    if (!cachedModules) {
+        cachedModules = new std::vector<CachedModule>();
+    }
+    for (CachedModule& cached : *cachedModules) {
+        if (SameModule(cached, module)) {
+            return cached.index.get();
+        }
+    }
+
+    CachedModule cached{ module.loadBias, module.start, {}, module.buildIdSize, module.path, nullptr };
+    memcpy(cached.buildId, module.buildId, module.buildIdSize);
+    ElfSymbolTable table;
+    if (table.Load(module.path) && !table.Symbols().empty()) {
+        cached.index.reset(new ModuleSymbolIndex(table));
+    }
+    cachedModules->push_back(std::move(cached));
+    return cachedModules->back().index.get();
+}
+
+}  // namespace
+
+bool ResolveSymbol(uintptr_t address, ResolvedSymbol& symbol) {
+    if (insideSymbolCache) {
+        return false;
+    }
+    ModuleMapView moduleMap;
+    const ModuleInfo* module = moduleMap.Find(address);
+    if (!module || module->path[0] == '\0') {
+        return false;
+    }
+
+    insideSymbolCache = true;
+    bool found = false;
+    try {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (ModuleSymbolIndex* index = IndexForModule(*module)) {
+            long position = index->Find(address - module->loadBias);
+            if (position >= 0) {
+                symbol.name = index->Name(position);
+                symbol.address = module->loadBias + index->Start(position);
+                found = true;
+            }
+        }
+    }
+    catch (const std::bad_alloc&) {
+        // Out of memory while loading: report the frame unsymbolized and retry next time
+    }
+    insideSymbolCache = false;
+    return found;
+}
+
+const SymbolLookup& ProcessSymbolCache() {
+    static const ProcessSymbols symbols;
+    return symbols;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// Process-lifetime address -> symbol cache for in-process symbolization.
+//
+// The first lookup that lands in a module reads that module's ELF symbols once and builds a
+// flat index over them; the index is never freed, so later lookups never re-parse anything.
+// Function start addresses are stored in Eytzinger (BFS) order, which keeps the first levels
+// of every binary search in the same few cache lines.
+//
+// Not async-signal-safe (the first lookup per module allocates and takes a lock): use it from
+// non-fatal handlers such as the new handler, never from a fatal signal handler.
+
+struct ResolvedSymbol {
+    const char* name;   // Demangled when possible; valid for the life of the process
+    uintptr_t address;  // Runtime address of the start of the function
+};
+
+// Resolves the function containing a runtime address. Returns false if the address is not in
+// a known module, the module has no symbols, or the lookup re-entered itself (for example from
+// a new handler triggered while the cache was allocating).
+bool ResolveSymbol(uintptr_t address, ResolvedSymbol& symbol);
+
+// Source of symbols for WriteStackTrace: this cache, or one reading another process's modules
+class SymbolLookup {
+public:
+    virtual bool Resolve(uintptr_t address, ResolvedSymbol& symbol) const = 0;
+
+protected:
+    ~SymbolLookup() = default;
+};
+
+// ResolveSymbol() behind the SymbolLookup interface
+const SymbolLookup& ProcessSymbolCache();
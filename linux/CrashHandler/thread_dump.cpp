@@ -0,0 +1,297 @@
+#include "thread_dump.h"
+
+#include "stack_capture.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kDefaultSignalOffset = 4;  // Past the real-time signals glibc and common runtimes take
+constexpr size_t kDirectoryBufferSize = 4096;
+constexpr long kPollIntervalNanos = 50 * 1000;
+constexpr int kDumpUsers = 2;
+constexpr int kTotalSlots = kMaxDumpThreads * kDumpUsers;
+
+enum SlotState : int {
+    kSlotFree = 0,
+    kSlotRequested,  // Signal sent, waiting for the thread
+    kSlotCapturing,  // The thread is unwinding itself
+    kSlotDone,
+    kSlotAbandoned,  // Timed out before the thread answered; a late answer finds nothing to claim
+    kSlotStale,      // Timed out while the thread was unwinding; it frees the slot when done
+};
+
+struct ThreadSlot {
+    std::atomic<int> state;
+    pid_t threadId;
+    int frameCount;
+    uintptr_t frames[kMaxStackFrames];
+    RegisterRecord registers;
+};
+
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// The slots of one dump user and the dump in progress on them
+struct DumpSet {
+    std::atomic<bool> busy;  // From the start of a dump until ReleaseThreadCaptures()
+    ThreadSlot* slots;       // kMaxDumpThreads, part of allSlots
+    int used[kMaxDumpThreads];  // Slots of the current dump, in request order
+    char directoryBuffer[kDirectoryBufferSize];
+};
+
+ThreadSlot* allSlots = nullptr;
+DumpSet dumpSets[kDumpUsers];
+int dumpSignal = 0;
+struct sigaction previousDumpAction;
+
+pid_t CurrentThreadId() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+uint64_t MonotonicMicros() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + static_cast<uint64_t>(now.tv_nsec) / 1000;
+}
+
+// Runs on every thread that receives the dump signal. The thread may be requested by both
+// users at once; it unwinds once and answers every request.
+void DumpSignalHandler(int, siginfo_t*, void* context) {
+    int savedErrno = errno;
+    pid_t threadId = CurrentThreadId();
+    const ThreadSlot* first = nullptr;
+    for (int i = 0; i < kTotalSlots; i++) {
+        ThreadSlot& slot = allSlots[i];
+        int expected = kSlotRequested;
+        if (slot.threadId != threadId || !slot.state.compare_exchange_strong(expected, kSlotCapturing)) {
+            continue;
+        }
+        if (!first) {
+            slot.frameCount = CaptureStackFromContext(context, slot.frames, kMaxStackFrames);
+            FillRegisterRecord(context, threadId, slot.registers);
+            first = &slot;
+        }
+        else {
+            slot.frameCount = first->frameCount;
+            memcpy(slot.frames, first->frames, sizeof(uintptr_t) * static_cast<size_t>(first->frameCount));
+            slot.registers = first->registers;
+        }
+        expected = kSlotCapturing;
+        if (!slot.state.compare_exchange_strong(expected, kSlotDone) && expected == kSlotStale) {
+            slot.state.store(kSlotFree);  // The dump gave up on us; the slot is free again
+        }
+    }
+    errno = savedErrno;
+}
+
+// Parses a /proc/self/task entry name; returns 0 for "." and ".."
+pid_t ParseThreadId(const char* name) {
+    pid_t value = 0;
+    for (; *name; name++) {
+        if (*name < '0' || *name > '9') {
+            return 0;
+        }
+        value = value * 10 + (*name - '0');
+    }
+    return value;
+}
+
+// Takes the next slot no late answer is still writing to, from index on; -1 if none is left
+int NextUsableSlot(const DumpSet& set, int index) {
+    for (; index < kMaxDumpThreads; index++) {
+        int state = set.slots[index].state.load();
+        if (state != kSlotStale && state != kSlotCapturing) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+// Sets up the next usable slot from next on for threadId, records it as the count-th of the
+// dump and signals the thread. False if the thread has exited or no slot is left.
+bool RequestDump(DumpSet& set, int& next, int count, pid_t processId, pid_t threadId) {
+    int index = NextUsableSlot(set, next);
+    if (index < 0) {
+        next = kMaxDumpThreads;
+        return false;
+    }
+    ThreadSlot& slot = set.slots[index];
+    slot.threadId = threadId;
+    slot.frameCount = 0;
+    slot.state.store(kSlotRequested);
+    if (syscall(SYS_tgkill, processId, threadId, dumpSignal) != 0) {
+        slot.state.store(kSlotFree);
+        return false;
+    }
+    set.used[count] = index;
+    next = index + 1;
+    return true;
+}
+
+// Lists the process's threads into the slots and signals each one; returns the slot count
+int RequestDumps(DumpSet& set, pid_t self) {
+    int fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    pid_t processId = getpid();
+    int count = 0;
+    int next = 0;
+    for (;;) {
+        long length = syscall(SYS_getdents64, fd, set.directoryBuffer, sizeof(set.directoryBuffer));
+        if (length <= 0) {
+            break;
+        }
+        for (long offset = 0; offset < length && next < kMaxDumpThreads;) {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(set.directoryBuffer + offset);
+            offset += entry->d_reclen;
+            pid_t threadId = ParseThreadId(entry->d_name);
+            if (threadId == 0 || threadId == self) {
+                continue;
+            }
+            if (RequestDump(set, next, count, processId, threadId)) {  // Else exited since the listing
+                count++;
+            }
+        }
+    }
+    close(fd);
+    return count;
+}
+
+// Waits until no other dump of the user runs, or until the deadline
+bool AcquireDump(DumpSet& set, uint64_t deadline) {
+    for (;;) {
+        bool expected = false;
+        if (set.busy.compare_exchange_strong(expected, true)) {
+            return true;
+        }
+        if (MonotonicMicros() >= deadline) {
+            return false;
+        }
+        timespec pause = { 0, kPollIntervalNanos };
+        nanosleep(&pause, nullptr);
+    }
+}
+
+// Waits for the requested slots to be answered and hands them out as captures
+int CollectDumps(DumpSet& set, int requested, ThreadCapture* captures, int maxCaptures, uint64_t deadline) {
+    for (;;) {
+        int pending = 0;
+        for (int i = 0; i < requested; i++) {
+            int state = set.slots[set.used[i]].state.load();
+            if (state == kSlotRequested || state == kSlotCapturing) {
+                pending++;
+            }
+        }
+        if (pending == 0 || MonotonicMicros() >= deadline) {
+            break;
+        }
+        timespec pause = { 0, kPollIntervalNanos };
+        nanosleep(&pause, nullptr);
+    }
+
+    int count = 0;
+    for (int i = 0; i < requested && count < maxCaptures; i++) {
+        ThreadSlot& slot = set.slots[set.used[i]];
+        int expected = kSlotRequested;
+        bool answered = false;
+        if (!slot.state.compare_exchange_strong(expected, kSlotAbandoned)) {
+            // Still unwinding: leave the slot to the thread, which frees it when done
+            answered = !(expected == kSlotCapturing && slot.state.compare_exchange_strong(expected, kSlotStale)) &&
+                expected == kSlotDone;
+        }
+        ThreadCapture& capture = captures[count++];
+        capture.threadId = slot.threadId;
+        capture.flags = answered ? 0 : kThreadNoResponse;
+        capture.frames = slot.frames;
+        capture.frameCount = answered ? slot.frameCount : 0;
+        capture.registers = answered ? &slot.registers : nullptr;
+        capture.stackPointer = answered ? RegisterStackPointer(slot.registers) : 0;
+    }
+    return count;
+}
+
+}  // namespace
+
+bool PrepareThreadDump(int signalNumber) {
+    if (allSlots) {
+        return true;
+    }
+    void* memory = mmap(nullptr, sizeof(ThreadSlot) * kTotalSlots, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    allSlots = static_cast<ThreadSlot*>(memory);  // Zero-filled, so every slot starts free
+    for (int i = 0; i < kDumpUsers; i++) {
+        dumpSets[i].slots = allSlots + i * kMaxDumpThreads;
+        dumpSets[i].busy.store(false);
+    }
+    dumpSignal = signalNumber != 0 ? signalNumber : SIGRTMIN + kDefaultSignalOffset;
+
+    struct sigaction action = {};
+    action.sa_sigaction = DumpSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(dumpSignal, &action, &previousDumpAction) != 0) {
+        munmap(memory, sizeof(ThreadSlot) * kTotalSlots);
+        allSlots = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void ReleaseThreadDump() {
+    if (!allSlots) {
+        return;
+    }
+    sigaction(dumpSignal, &previousDumpAction, nullptr);
+    munmap(allSlots, sizeof(ThreadSlot) * kTotalSlots);
+    allSlots = nullptr;
+}
+
+int DumpOtherThreads(ThreadCapture* captures, int maxCaptures, int timeoutMillis, ThreadDumpUser user) {
+    uint64_t deadline = MonotonicMicros() + static_cast<uint64_t>(timeoutMillis) * 1000;
+    DumpSet& set = dumpSets[static_cast<int>(user)];
+    if (!allSlots || !AcquireDump(set, deadline)) {
+        return 0;
+    }
+    int requested = RequestDumps(set, CurrentThreadId());
+    return CollectDumps(set, requested, captures, maxCaptures, deadline);
+}
+
+int DumpThreads(const pid_t* threadIds, int threadCount, ThreadCapture* captures, int maxCaptures,
+    int timeoutMillis, ThreadDumpUser user) {
+    uint64_t deadline = MonotonicMicros() + static_cast<uint64_t>(timeoutMillis) * 1000;
+    DumpSet& set = dumpSets[static_cast<int>(user)];
+    if (!allSlots || !AcquireDump(set, deadline)) {
+        return 0;
+    }
+    pid_t processId = getpid();
+    int requested = 0;
+    int next = 0;
+    for (int i = 0; i < threadCount && next < kMaxDumpThreads; i++) {
+        if (RequestDump(set, next, requested, processId, threadIds[i])) {
+            requested++;
+        }
+    }
+    return CollectDumps(set, requested, captures, maxCaptures, deadline);
+}
+
+void ReleaseThreadCaptures(ThreadDumpUser user) {
+    dumpSets[static_cast<int>(user)].busy.store(false);
+}
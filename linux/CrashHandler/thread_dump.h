@@ -0,0 +1,48 @@
+#pragma once
+
+#include "crash_report_writer.h"
+
+#include <sys/types.h>
+
+// Stacks of every thread of the process, captured in parallel.
+//
+// The crashing thread lists /proc/self/task with getdents64 and sends each other thread a
+// dedicated real-time signal with tgkill. Every thread unwinds itself from its own signal
+// context into a slot preallocated by PrepareThreadDump(), and the crashing thread collects
+// the slots until all have answered or the timeout expires. Threads unwind concurrently, so
+// the total time follows the deepest stack rather than thread count times depth. Threads
+// that block the signal or hang (for example on a loader lock held by the crashed thread)
+// are reported without frames.
+//
+// The hang detector (hang_detector.h) dumps threads of a running process the same way. Each
+// user has slots of its own, so a crash never waits for a hang dump or overwrites one, and
+// a user keeps its slots until it has read the captures and calls ReleaseThreadCaptures().
+// A thread that answers after the timeout, while still unwinding, keeps its slot out of the
+// next dumps until it is done with it.
+
+constexpr int kMaxDumpThreads = 256;
+
+enum class ThreadDumpUser {
+    Fatal,     // The fatal handlers
+    Watchdog,  // The hang detector
+};
+
+// Installs the handler for signalNumber (0 picks SIGRTMIN + 4) and allocates the slots.
+// Not async-signal-safe; call at install time.
+bool PrepareThreadDump(int signalNumber);
+
+void ReleaseThreadDump();
+
+// Captures every thread except the caller into captures (pointing into user's slots) and
+// returns how many were written. Waits at most timeoutMillis for the other threads. The
+// captures stay valid until ReleaseThreadCaptures(user); one dump per user at a time.
+// Async-signal-safe.
+int DumpOtherThreads(ThreadCapture* captures, int maxCaptures, int timeoutMillis,
+    ThreadDumpUser user = ThreadDumpUser::Fatal);
+
+// Like DumpOtherThreads, for the given threads only; threads that have exited are left out
+int DumpThreads(const pid_t* threadIds, int threadCount, ThreadCapture* captures, int maxCaptures,
+    int timeoutMillis, ThreadDumpUser user);
+
+// Hands user's slots back after a dump, whatever it returned
+void ReleaseThreadCaptures(ThreadDumpUser user);
@@ -0,0 +1,251 @@
+#include "throw_profiler.h"
+
+#include "module_map.h"
+#include "report_text.h"
+#include "safe_writer.h"
+#include "stack_capture.h"
+#include "symbol_cache.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sys/mman.h>
+#include <system_error>
+#include <thread>
+#include <time.h>
+
+std::atomic<bool> throwProfilingActive{ false };
+
+namespace {
+
+constexpr uint64_t kHashMultiplier = 0x9e3779b97f4a7c15ull;
+constexpr size_t kDumpBufferSize = 16 * 1024;
+constexpr int kMaxDumpedThrowSites = 32;
+constexpr int kSnapshotUsers = 2;
+
+struct ThrowSiteCounter {
+    std::atomic<uint64_t> key;    // Hash of throw address and type; 0: free
+    std::atomic<uint32_t> ready;  // Set once type and location are written
+    const std::type_info* type;
+    uintptr_t location[2];  // __cxa_throw and the throw address, as frames
+    std::atomic<uint64_t> throws;
+    std::atomic<uint64_t> snapshotThrows[kSnapshotUsers];  // throws at each user's previous snapshot
+    std::atomic<uint32_t> stackState;      // 0: none, 1: being written, 2: frames valid
+    int32_t frameCount;
+    uintptr_t frames[kMaxThrowSiteFrames];
+};
+
+ThrowSiteCounter* counters = nullptr;
+std::atomic<uint32_t> stackSampleInterval{ 0 };
+std::atomic<uint64_t> untrackedThrows{ 0 };
+std::atomic<uint64_t> lastSnapshotNanos[kSnapshotUsers];
+struct SamplerState {
+    uint32_t throwsUntilSample;
+    uint64_t random;  // xorshift64* state, 0 until seeded
+};
+
+thread_local SamplerState sampler;
+
+std::mutex dumpMutex;
+std::condition_variable dumpWakeup;
+std::thread dumpThread;
+bool dumpStopping = false;
+
+uint64_t MonotonicNanos() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+// Throws to the next stack sample: uniform around the interval, so a loop whose sites
+// alternate with a period dividing the interval cannot keep some of them from being sampled
+uint32_t NextSampleGap(SamplerState& state, uint32_t interval) {
+    if (state.random == 0) {
+        state.random = (reinterpret_cast<uintptr_t>(&state) ^ MonotonicNanos()) | 1;
+    }
+    state.random ^= state.random >> 12;
+    state.random ^= state.random << 25;
+    state.random ^= state.random >> 27;
+    uint64_t random = state.random * 0x2545f4914f6cdd1dull;
+    return 1 + static_cast<uint32_t>((random >> 32) % (2 * static_cast<uint64_t>(interval)));
+}
+
+uint64_t SiteKey(const std::type_info* type, uintptr_t throwAddress) {
+    uint64_t key = (throwAddress ^ (reinterpret_cast<uintptr_t>(type) << 1)) * kHashMultiplier;
+    key ^= key >> 29;
+    return key != 0 ? key : 1;
+}
+
+// Counter for the site, claiming a free one for a new site; nullptr when the table is full
+ThrowSiteCounter* FindCounter(const std::type_info* type, uintptr_t throwFunction, uintptr_t throwAddress) {
+    uint64_t key = SiteKey(type, throwAddress);
+    int index = static_cast<int>(key >> 54) & (kMaxThrowSites - 1);
+    for (int probe = 0; probe < kMaxThrowSites; probe++, index = (index + 1) & (kMaxThrowSites - 1)) {
+        ThrowSiteCounter& counter = counters[index];
+        uint64_t current = counter.key.load(std::memory_order_acquire);
+        if (current == 0 && counter.key.compare_exchange_strong(current, key)) {
+            counter.type = type;
+            counter.location[0] = throwFunction;
+            counter.location[1] = throwAddress;
+            counter.ready.store(1, std::memory_order_release);
+            return &counter;
+        }
+        if (current == key) {
+            return &counter;
+        }
+    }
+    return nullptr;
+}
+
+void DumpLoop(int fd, int intervalMillis, int topSites, bool symbolize) {
+    ThrowSiteSummary sites[kMaxDumpedThrowSites];
+    char buffer[kDumpBufferSize];
+    std::atomic<uint64_t>& lastDumpNanos = lastSnapshotNanos[static_cast<int>(ThrowSnapshotUser::Dump)];
+    SnapshotThrowSites(sites, 0, ThrowSnapshotUser::Dump);  // The first interval starts now
+    std::unique_lock<std::mutex> lock(dumpMutex);
+    while (!dumpWakeup.wait_for(lock, std::chrono::milliseconds(intervalMillis), [] { return dumpStopping; })) {
+        uint64_t startNanos = lastDumpNanos.load(std::memory_order_relaxed);
+        int count = SnapshotThrowSites(sites, topSites, ThrowSnapshotUser::Dump);
+        if (count == 0) {
+            continue;
+        }
+        uint64_t elapsedMillis = (lastDumpNanos.load(std::memory_order_relaxed) - startNanos) / 1000000;
+        SafeWriter writer(buffer, sizeof(buffer), fd);
+        writer.Append("Throw sites in the last ").AppendDec(elapsedMillis).Append(" ms:\n");
+        ModuleMapView moduleMap;
+        ReportModules used;
+        const SymbolLookup* symbols = symbolize ? &ProcessSymbolCache() : nullptr;
+        for (int i = 0; i < count; i++) {
+            WriteThrowSiteHeader(writer, i, sites[i]);
+            WriteFrames(writer, sites[i].frames, sites[i].frameCount, moduleMap, used, symbols);
+        }
+        WriteModuleList(writer, used);
+        writer.Flush();
+    }
+}
+
+}  // namespace
+
+bool StartThrowProfiler(uint32_t sampleInterval) {
+    if (!counters) {
+        void* memory = mmap(nullptr, sizeof(ThrowSiteCounter) * kMaxThrowSites, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+        // Never unmapped: a throw may still be counting when the profiler stops
+        counters = static_cast<ThrowSiteCounter*>(memory);
+    }
+    stackSampleInterval.store(sampleInterval);
+    for (std::atomic<uint64_t>& last : lastSnapshotNanos) {
+        last.store(MonotonicNanos());
+    }
+    throwProfilingActive.store(true);
+    return true;
+}
+
+void StopThrowProfiler() {
+    throwProfilingActive.store(false);
+}
+
+void CountThrowSlow(const std::type_info* type, uintptr_t throwFunction, uintptr_t throwAddress) {
+    ThrowSiteCounter* counter = FindCounter(type, throwFunction, throwAddress);
+    if (!counter) {
+        untrackedThrows.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    counter->throws.fetch_add(1, std::memory_order_relaxed);
+    uint32_t interval = stackSampleInterval.load(std::memory_order_relaxed);
+    if (interval == 0) {
+        return;
+    }
+    // The first throw of each thread is sampled, then one in interval on average
+    SamplerState& state = sampler;
+    if (state.throwsUntilSample > 1) {
+        state.throwsUntilSample--;
+        return;
+    }
+    state.throwsUntilSample = NextSampleGap(state, interval);
+    // Only the first sampled stack of a site is kept
+    uint32_t expected = 0;
+    if (counter->stackState.load(std::memory_order_relaxed) != 0 ||
+        !counter->stackState.compare_exchange_strong(expected, 1)) {
+        return;
+    }
+    // Drops this function, so frame 0 is in __cxa_throw
+    counter->frameCount = CaptureStack(counter->frames, kMaxThrowSiteFrames, 1);
+    counter->stackState.store(2, std::memory_order_release);
+}
+
+int SnapshotThrowSites(ThrowSiteSummary* top, int maxSites, ThrowSnapshotUser user) {
+    if (!counters) {
+        return 0;
+    }
+    int baseline = static_cast<int>(user);
+    uint64_t now = MonotonicNanos();
+    uint64_t elapsed = now - lastSnapshotNanos[baseline].exchange(now);
+    int count = 0;
+    for (int i = 0; i < kMaxThrowSites; i++) {
+        ThrowSiteCounter& counter = counters[i];
+        if (counter.ready.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+        uint64_t throws = counter.throws.load(std::memory_order_relaxed);
+        uint64_t recent = throws - counter.snapshotThrows[baseline].exchange(throws, std::memory_order_relaxed);
+        if (recent == 0) {
+            continue;
+        }
+        int position = count;
+        while (position > 0 && top[position - 1].recentThrows < recent) {
+            position--;
+        }
+        if (position >= maxSites) {
+            continue;
+        }
+        int last = count < maxSites ? count : maxSites - 1;
+        for (int j = last; j > position; j--) {
+            top[j] = top[j - 1];
+        }
+        bool sampled = counter.stackState.load(std::memory_order_acquire) == 2;
+        top[position] = { counter.type, counter.location[1], throws, recent,
+            elapsed > 0 ? static_cast<uint64_t>(static_cast<double>(recent) * 1e9 / static_cast<double>(elapsed)) : 0,
+            sampled ? counter.frames : counter.location, sampled ? counter.frameCount : 2 };
+        if (count < maxSites) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint64_t UntrackedThrows() {
+    return untrackedThrows.load(std::memory_order_relaxed);
+}
+
+bool StartThrowSiteDump(int fd, int intervalMillis, int topSites, bool symbolize) {
+    if (intervalMillis <= 0 || dumpThread.joinable()) {
+        return true;
+    }
+    if (topSites > kMaxDumpedThrowSites) {
+        topSites = kMaxDumpedThrowSites;
+    }
+    dumpStopping = false;
+    try {
+        dumpThread = std::thread(DumpLoop, fd, intervalMillis, topSites, symbolize);
+    }
+    catch (const std::system_error&) {
+        return false;
+    }
+    return true;
+}
+
+void StopThrowSiteDump() {
+    if (!dumpThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex);
+        dumpStopping = true;
+    }
+    dumpWakeup.notify_all();
+    dumpThread.join();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "throw_site.h"
+
+#include <atomic>
+#include <cstdint>
+#include <typeinfo>
+
+// Per-throw-site exception counters, for finding "exception storms": hot paths that throw
+// and catch so often that throughput suffers long before anything crashes.
+//
+// The __cxa_throw of throw_site.h counts every throw under its site, the throw expression's
+// address together with the exception type, in a fixed-size lock-free table: a lookup of a
+// known site is a hash, a compare and an atomic increment. One in stackSampleInterval throws
+// of a thread, at random, also unwinds its full stack, and the first such stack of a site is
+// kept with it, so the callers of a throw site show. The table is mapped once and kept for
+// the life of the process; nothing is allocated while counting.
+//
+// SnapshotThrowSites() ranks the sites by the throws since the previous snapshot, which is
+// their rate over the snapshot interval. StartThrowSiteDump() takes a snapshot periodically
+// on a thread of its own and writes the busiest sites, with their stacks, to a descriptor.
+// The dump thread and on-demand callers keep separate baselines, so asking for a snapshot
+// does not shorten the interval the next periodic dump covers.
+
+constexpr int kMaxThrowSites = 1024;
+
+// Who takes a snapshot; each has its own previous snapshot to count from
+enum class ThrowSnapshotUser {
+    OnDemand,  // SnapshotThrowSites() callers, which share one baseline
+    Dump,      // The StartThrowSiteDump() thread
+};
+
+struct ThrowSiteSummary {
+    const std::type_info* type;
+    uintptr_t throwAddress;    // Return address of the throw expression's call to __cxa_throw
+    uint64_t totalThrows;      // Since the profiler started
+    uint64_t recentThrows;     // Since the previous snapshot
+    uint64_t throwsPerSecond;  // recentThrows over the time since the previous snapshot
+    // The sampled stack (frame 0 in __cxa_throw), or __cxa_throw and throwAddress when none
+    // was sampled yet
+    const uintptr_t* frames;
+    int frameCount;
+};
+
+// Maps the table on first use and starts counting; stackSampleInterval 0 counts without
+// stacks. Not async-signal-safe; call at install time.
+bool StartThrowProfiler(uint32_t stackSampleInterval);
+void StopThrowProfiler();
+
+// Fills sites with up to maxSites sites ordered by throws since user's previous snapshot,
+// most first, and returns how many were written; sites that did not throw since are left
+// out. Starts user's next interval. Does not allocate.
+int SnapshotThrowSites(ThrowSiteSummary* sites, int maxSites, ThrowSnapshotUser user = ThrowSnapshotUser::OnDemand);
+
+// Throws not counted because the table was full
+uint64_t UntrackedThrows();
+
+// Every intervalMillis, writes the topSites (at most 32) busiest sites of the interval to fd,
+// symbolized through the symbol cache if symbolize is set. Intervals without throws are
+// skipped. intervalMillis 0 starts nothing. Not async-signal-safe.
+bool StartThrowSiteDump(int fd, int intervalMillis, int topSites, bool symbolize);
+void StopThrowSiteDump();
+
+// Hook for __cxa_throw (throw_site.cpp); one load while the profiler is off
+extern std::atomic<bool> throwProfilingActive;
+void CountThrowSlow(const std::type_info* type, uintptr_t throwFunction, uintptr_t throwAddress);
+
+inline void CountThrow(const std::type_info* type, uintptr_t throwFunction, uintptr_t throwAddress) {
+    if (throwProfilingActive.load(std::memory_order_acquire)) {
+        CountThrowSlow(type, throwFunction, throwAddress);
+    }
+}
@@ -0,0 +1,143 @@
+#include "throw_site.h"
+
+#include "proc_reader.h"
+#include "throw_profiler.h"
+#include "unwinder.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <dlfcn.h>
+
+std::atomic<bool> throwSiteRecording{ false };
+
+namespace {
+
+using CxaThrowFunction = void (*)(void*, std::type_info*, void (*)(void*));
+
+std::atomic<CxaThrowFunction> realCxaThrow{ nullptr };
+
+// The mapping the thread's stack lives in, or the range a failed lookup covered; refreshed
+// when a throw happens outside it (on a signal or coroutine stack)
+struct StackBounds {
+    uintptr_t low;
+    uintptr_t high;
+    bool readable;  // False: the walk stops at the caller of __cxa_throw
+};
+
+thread_local ThrowSite lastThrowSite;
+thread_local StackBounds stackBounds;
+
+CxaThrowFunction RealCxaThrow() {
+    CxaThrowFunction function = realCxaThrow.load(std::memory_order_acquire);
+    if (!function) {
+        // A throw before StartThrowSiteRecording(), from a static constructor say
+        function = reinterpret_cast<CxaThrowFunction>(dlsym(RTLD_NEXT, "__cxa_throw"));
+        realCxaThrow.store(function, std::memory_order_release);
+    }
+    return function;
+}
+
+// Looks up the mapping that holds address in /proc/self/maps. Where there is none (or the
+// file cannot be read), bounds get the gap around address, so the failure is remembered for
+// every address in it.
+void FindStackMapping(uintptr_t address, StackBounds& bounds) {
+    bounds = { 0, UINTPTR_MAX, false };
+    ProcLineReader maps("/proc/self/maps");
+    const char* line;
+    size_t length;
+    while (maps.NextLine(line, length)) {
+        const char* end = line + length;
+        uint64_t start = ParseNumber(line, end, 16);
+        if (line == end || *line != '-') {
+            continue;
+        }
+        line++;
+        uint64_t stop = ParseNumber(line, end, 16);
+        line = SkipSpaces(line, end);
+        if (address < start) {
+            bounds.high = static_cast<uintptr_t>(start);
+            return;
+        }
+        if (address < stop) {
+            bounds = { static_cast<uintptr_t>(start), static_cast<uintptr_t>(stop), line != end && *line == 'r' };
+            return;
+        }
+        bounds.low = static_cast<uintptr_t>(stop);
+    }
+}
+
+// Walks the { previous frame pointer, return address } records from the frame of
+// __cxa_throw. Every record must lie in the stack mapping and above the one before. Without
+// a readable mapping only the caller of __cxa_throw is recorded, from its own frame.
+void RecordThrowSite(std::type_info* type, uintptr_t framePointer, uintptr_t throwFunction) {
+    ThrowSite& site = lastThrowSite;
+    site.type = type;
+    site.frames[0] = throwFunction;
+    int count = 1;
+    StackBounds& bounds = stackBounds;
+    if (framePointer < bounds.low || framePointer >= bounds.high) {
+        FindStackMapping(framePointer, bounds);
+    }
+    if (!bounds.readable) {
+        uintptr_t returnAddress = reinterpret_cast<const uintptr_t*>(framePointer)[1];
+        if (returnAddress != 0) {
+            site.frames[count++] = returnAddress;
+        }
+        site.frameCount = count;
+        return;
+    }
+    uintptr_t fp = framePointer;
+    while (count < kMaxThrowSiteFrames && fp % sizeof(uintptr_t) == 0 && fp >= bounds.low &&
+        bounds.high - fp >= 2 * sizeof(uintptr_t)) {
+        const uintptr_t* record = reinterpret_cast<const uintptr_t*>(fp);
+        uintptr_t returnAddress = record[1];
+        if (returnAddress == 0) {
+            break;
+        }
+        site.frames[count++] = returnAddress;
+        uintptr_t previous = record[0];
+        if (previous <= fp || previous - fp > kMaxFrameSize) {
+            break;
+        }
+        fp = previous;
+    }
+    site.frameCount = count;
+}
+
+}  // namespace
+
+bool StartThrowSiteRecording() {
+    if (!RealCxaThrow()) {
+        return false;
+    }
+    throwSiteRecording.store(true, std::memory_order_release);
+    return true;
+}
+
+void StopThrowSiteRecording() {
+    throwSiteRecording.store(false, std::memory_order_release);
+}
+
+const ThrowSite* LastThrowSite(const std::type_info* type) {
+    const ThrowSite& site = lastThrowSite;
+    if (!type || !site.type || site.frameCount == 0 || *site.type != *type) {
+        return nullptr;
+    }
+    return &site;
+}
+
+// Interposes the C++ runtime's throw. __builtin_frame_address makes the compiler keep a
+// frame pointer here even where the file is built without -fno-omit-frame-pointer.
+extern "C" [[noreturn]] void __cxa_throw(void* thrown, std::type_info* type, void (*destructor)(void*)) {
+    uintptr_t throwFunction = reinterpret_cast<uintptr_t>(&__cxa_throw);
+    if (throwSiteRecording.load(std::memory_order_relaxed)) {
+        RecordThrowSite(type, reinterpret_cast<uintptr_t>(__builtin_frame_address(0)), throwFunction);
+    }
+    CountThrow(type, throwFunction, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+    CxaThrowFunction real = RealCxaThrow();
+    if (!real) {
+        abort();
+    }
+    real(thrown, type, destructor);
+    __builtin_unreachable();
+}
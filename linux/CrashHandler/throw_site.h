@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <typeinfo>
+
+// Throw-site recording for terminate reports.
+//
+// By the time std::terminate runs, the stack that threw may be gone: the exception was
+// caught and rethrown, escaped a noexcept function after unwinding started, or ended in a
+// catch block that terminates. This module defines __cxa_throw, which the executable's
+// throw expressions resolve to ahead of libstdc++'s, records where the throw came from and
+// hands the exception on to the real __cxa_throw (found with dlsym(RTLD_NEXT)). The same
+// hook feeds the per-site counters of throw_profiler.h.
+//
+// The record is a raw frame pointer walk into a thread_local slot: the walk is bounded by
+// the stack mapping the thread runs on, looked up once per thread in /proc/self/maps with a
+// fixed buffer, so a broken chain ends it instead of faulting, and a throw pays a few
+// dozen loads. Code built without frame pointers cuts the walk short after its caller.
+// Nothing is allocated. Only the last throw of each thread is kept; the terminate handler
+// uses it when its type matches the exception in flight. Rethrows (throw;) keep the
+// original site. Exceptions thrown on another thread and rethrown from an exception_ptr
+// are not matched.
+
+constexpr int kMaxThrowSiteFrames = 32;
+
+struct ThrowSite {
+    const std::type_info* type;
+    uintptr_t frames[kMaxThrowSiteFrames];  // Frame 0 is __cxa_throw, frame 1 the throw expression
+    int frameCount;
+};
+
+// Resolves the real __cxa_throw and starts recording. Not async-signal-safe; call at
+// install time. False if __cxa_throw cannot be found.
+bool StartThrowSiteRecording();
+void StopThrowSiteRecording();
+
+// The calling thread's last recorded throw if it threw an exception of the given type,
+// otherwise nullptr. Async-signal-safe.
+const ThrowSite* LastThrowSite(const std::type_info* type);
+
+// Checked by __cxa_throw on every throw; one load while recording is off
+extern std::atomic<bool> throwSiteRecording;
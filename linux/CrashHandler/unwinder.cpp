@@ -0,0 +1,191 @@
+#include "unwinder.h"
+
+#include "dwarf_unwinder.h"
+#include "proc_reader.h"
+
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uintptr_t kCheckPageSize = 4096;  // Smallest page size; larger pages just take more checks
+
+const FramePointerUnwinder framePointerUnwinder;
+const DwarfUnwinder dwarfUnwinder;
+const AutoUnwinder autoUnwinder;
+
+bool ReadProcessWord(pid_t processId, uintptr_t address, uintptr_t& value) {
+    iovec local = { &value, sizeof(value) };
+    iovec remote = { reinterpret_cast<void*>(address), sizeof(value) };
+    return process_vm_readv(processId, &local, 1, &remote, 1, 0) == static_cast<ssize_t>(sizeof(value));
+}
+
+}  // namespace
+
+LocalUnwindMemory::LocalUnwindMemory() : processId_(getpid()) {}
+
+bool LocalUnwindMemory::ReadWord(uintptr_t address, uintptr_t& value) {
+    if (address % sizeof(uintptr_t) != 0) {
+        return false;
+    }
+    uintptr_t page = address & ~(kCheckPageSize - 1);
+    for (uintptr_t checked : checkedPages_) {
+        if (checked == page && page != 0) {
+            value = *reinterpret_cast<const uintptr_t*>(address);
+            return true;
+        }
+    }
+    if (!ReadProcessWord(processId_, address, value)) {
+        // Seccomp filters may refuse process_vm_readv; mincore still tells mapped from unmapped,
+        // and the maps tell readable from guard pages
+        unsigned char residency = 0;
+        if ((errno != ENOSYS && errno != EPERM) ||
+            mincore(reinterpret_cast<void*>(page), kCheckPageSize, &residency) != 0 ||
+            ReadableExtent(address) < sizeof(uintptr_t)) {
+            return false;
+        }
+        value = *reinterpret_cast<const uintptr_t*>(address);
+    }
+    checkedPages_[nextPage_] = page;
+    nextPage_ = (nextPage_ + 1) % kCheckedPages;
+    return true;
+}
+
+bool RemoteUnwindMemory::ReadWord(uintptr_t address, uintptr_t& value) {
+    return address % sizeof(uintptr_t) == 0 && ReadProcessWord(processId_, address, value);
+}
+
+bool FramePointerUnwinder::Step(UnwindState& state, UnwindMemory& memory, const ModuleLookup&) const {
+    uintptr_t fp = 0;
+    if (!state.Get(kDwarfFramePointer, fp) || fp == 0 || fp % sizeof(uintptr_t) != 0) {
+        return false;
+    }
+    uintptr_t low = state.stackLimit;
+    uintptr_t sp = 0;
+    if (state.Get(kDwarfStackPointer, sp) && sp > low) {
+        low = sp;
+    }
+    if (fp < low || (low != 0 && fp - low > kMaxFrameSize)) {
+        return false;
+    }
+    // Frame records are { previous frame pointer, return address } on both architectures
+    uintptr_t previousFp = 0;
+    uintptr_t returnAddress = 0;
+    if (!memory.ReadWord(fp, previousFp) || !memory.ReadWord(fp + sizeof(uintptr_t), returnAddress) ||
+        returnAddress == 0) {
+        return false;
+    }
+    // Only the frame pointer and stack bounds are known in the caller
+    state.validRegisters = 0;
+    state.Set(kDwarfFramePointer, previousFp);
+#if defined(__x86_64__)
+    state.Set(kDwarfStackPointer, fp + 2 * sizeof(uintptr_t));  // Exact: push rbp; mov rbp, rsp
+#endif
+    state.pc = returnAddress;
+    state.exactPc = false;
+    state.stackLimit = fp + 2 * sizeof(uintptr_t);
+    return true;
+}
+
+bool AutoUnwinder::Step(UnwindState& state, UnwindMemory& memory, const ModuleLookup& modules) const {
+    // The interrupted frame may be anywhere in a prologue or a leaf, where the frame pointer
+    // does not describe it yet; only the unwind tables are right there
+    const ModuleInfo* module = modules.Find(state.exactPc ? state.pc : state.pc - 1);
+    if (!state.exactPc && module && module->framePointers) {
+        return framePointerUnwinder.Step(state, memory, modules) || dwarfUnwinder.Step(state, memory, modules);
+    }
+    return dwarfUnwinder.Step(state, memory, modules) || framePointerUnwinder.Step(state, memory, modules);
+}
+
+const Unwinder* GetUnwinder(UnwinderKind kind) {
+    switch (kind) {
+    case UnwinderKind::Auto: return &autoUnwinder;
+    case UnwinderKind::FramePointer: return &framePointerUnwinder;
+    case UnwinderKind::Dwarf: return &dwarfUnwinder;
+    default: return nullptr;
+    }
+}
+
+int UnwindStack(const Unwinder& unwinder, UnwindState& state, UnwindMemory& memory,
+    const ModuleLookup& modules, uintptr_t* frames, int maxFrames) {
+    if (maxFrames <= 0 || state.pc == 0) {
+        return 0;
+    }
+    int count = 0;
+    frames[count++] = state.pc;
+    while (count < maxFrames && unwinder.Step(state, memory, modules)) {
+        frames[count++] = state.pc;
+    }
+    return count;
+}
+
+bool UnwindStateFromContext(const void* signalContext, UnwindState& state) {
+    state.validRegisters = 0;
+    state.stackLimit = 0;
+    state.exactPc = true;
+    state.pc = 0;
+    if (!signalContext) {
+        return false;
+    }
+    const ucontext_t* context = static_cast<const ucontext_t*>(signalContext);
+#if defined(__x86_64__)
+    // DWARF numbering: rax, rdx, rcx, rbx, rsi, rdi, rbp, rsp, r8..r15
+    static const int kGregs[] = {
+        REG_RAX, REG_RDX, REG_RCX, REG_RBX, REG_RSI, REG_RDI, REG_RBP, REG_RSP,
+        REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+    };
+    for (int i = 0; i < static_cast<int>(sizeof(kGregs) / sizeof(kGregs[0])); i++) {
+        state.Set(i, static_cast<uintptr_t>(context->uc_mcontext.gregs[kGregs[i]]));
+    }
+    state.pc = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+    return true;
+#elif defined(__aarch64__)
+    for (int i = 0; i < 31; i++) {
+        state.Set(i, static_cast<uintptr_t>(context->uc_mcontext.regs[i]));
+    }
+    state.Set(kDwarfStackPointer, static_cast<uintptr_t>(context->uc_mcontext.sp));
+    state.pc = static_cast<uintptr_t>(context->uc_mcontext.pc);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool UnwindStateFromRegisters(const RegisterRecord& registers, UnwindState& state) {
+    state.validRegisters = 0;
+    state.stackLimit = 0;
+    state.exactPc = true;
+    state.pc = 0;
+    switch (static_cast<RegisterArch>(registers.arch)) {
+#if defined(__x86_64__)
+    case RegisterArch::X86_64: {
+        // Record order (RegisterName): r8..r15, rdi, rsi, rbp, rbx, rdx, rax, rcx, rsp, rip
+        static const int kDwarfNumbers[] = { 8, 9, 10, 11, 12, 13, 14, 15, 5, 4, 6, 3, 1, 0, 2, 7 };
+        if (registers.count < 17) {
+            return false;
+        }
+        for (int i = 0; i < static_cast<int>(sizeof(kDwarfNumbers) / sizeof(kDwarfNumbers[0])); i++) {
+            state.Set(kDwarfNumbers[i], static_cast<uintptr_t>(registers.values[i]));
+        }
+        state.pc = static_cast<uintptr_t>(registers.values[16]);
+        return true;
+    }
+#elif defined(__aarch64__)
+    case RegisterArch::Aarch64:
+        // Record order: x0..x28, fp, lr, sp, pc
+        if (registers.count < 33) {
+            return false;
+        }
+        for (int i = 0; i < 32; i++) {
+            state.Set(i, static_cast<uintptr_t>(registers.values[i]));
+        }
+        state.pc = static_cast<uintptr_t>(registers.values[32]);
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
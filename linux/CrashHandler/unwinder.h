@@ -0,0 +1,161 @@
+#pragma once
+
+#include "crash_report_format.h"
+#include "module_map.h"
+#include "stack_capture.h"
+
+#include <cstdint>
+#include <sys/types.h>
+
+// Pluggable stack unwinders.
+//
+// An unwinder moves an UnwindState (program counter plus the registers it knows, by DWARF
+// register number) one frame towards the caller. The frame pointer walker follows the
+// { previous frame pointer, return address } records that -fno-omit-frame-pointer code keeps;
+// it costs two loads per frame. The DWARF walker (dwarf_unwinder.h) evaluates the .eh_frame
+// rules of the function, which every module has, frame pointers or not. The auto walker
+// chooses per frame: frame pointers inside modules built with them, DWARF elsewhere and for
+// the interrupted frame of a signal, each falling back to the other when it fails.
+//
+// Stack memory is read through an UnwindMemory, so a corrupt frame pointer ends the walk
+// instead of faulting inside a crash handler, and so the same walkers can read another
+// process. All walkers are async-signal-safe and allocation-free.
+
+#if defined(__x86_64__)
+constexpr int kDwarfFramePointer = 6;     // rbp
+constexpr int kDwarfStackPointer = 7;     // rsp
+constexpr int kDwarfReturnAddress = 16;   // Return address column
+#elif defined(__aarch64__)
+constexpr int kDwarfFramePointer = 29;    // x29
+constexpr int kDwarfStackPointer = 31;    // sp
+constexpr int kDwarfReturnAddress = 30;   // x30 (lr)
+#else
+constexpr int kDwarfFramePointer = -1;
+constexpr int kDwarfStackPointer = -1;
+constexpr int kDwarfReturnAddress = -1;
+#endif
+
+constexpr int kUnwindRegisterCount = 33;
+constexpr uintptr_t kMaxFrameSize = 1024 * 1024;  // A larger step means the chain is broken
+
+struct UnwindState {
+    uintptr_t pc;
+    uintptr_t registers[kUnwindRegisterCount];  // By DWARF register number
+    uint64_t validRegisters;  // Bit per register
+    uintptr_t stackLimit;     // The caller's frame lies at or above this address
+    bool exactPc;  // pc is the interrupted instruction itself, not a return address
+
+    bool Get(int reg, uintptr_t& value) const {
+        if (reg < 0 || reg >= kUnwindRegisterCount || !(validRegisters & (1ull << reg))) {
+            return false;
+        }
+        value = registers[reg];
+        return true;
+    }
+    void Set(int reg, uintptr_t value) {
+        if (reg >= 0 && reg < kUnwindRegisterCount) {
+            registers[reg] = value;
+            validRegisters |= 1ull << reg;
+        }
+    }
+    void Clear(int reg) {
+        if (reg >= 0 && reg < kUnwindRegisterCount) {
+            validRegisters &= ~(1ull << reg);
+        }
+    }
+};
+
+// Word-sized reads of the unwound thread's memory. A failed read ends the walk.
+class UnwindMemory {
+public:
+    virtual bool ReadWord(uintptr_t address, uintptr_t& value) = 0;
+
+protected:
+    ~UnwindMemory() = default;
+};
+
+// Memory of the calling process. Each page is checked once per walk with process_vm_readv,
+// which fails with EFAULT instead of faulting; later reads from it are plain loads.
+class LocalUnwindMemory final : public UnwindMemory {
+public:
+    LocalUnwindMemory();
+    bool ReadWord(uintptr_t address, uintptr_t& value) override;
+
+private:
+    static constexpr int kCheckedPages = 8;
+
+    pid_t processId_;
+    uintptr_t checkedPages_[kCheckedPages] = {};
+    int nextPage_ = 0;
+};
+
+// Memory of another process, read with process_vm_readv
+class RemoteUnwindMemory final : public UnwindMemory {
+public:
+    explicit RemoteUnwindMemory(pid_t processId) : processId_(processId) {}
+    bool ReadWord(uintptr_t address, uintptr_t& value) override;
+
+private:
+    pid_t processId_;
+};
+
+class Unwinder {
+public:
+    // Moves state to the calling frame. Returns false, leaving state untouched, at the end of
+    // the stack or when this unwinder cannot step out of the frame.
+    virtual bool Step(UnwindState& state, UnwindMemory& memory, const ModuleLookup& modules) const = 0;
+
+protected:
+    ~Unwinder() = default;
+};
+
+// Follows the frame pointer chain. Every record must lie above the previous frame, within
+// kMaxFrameSize of it, aligned and readable, so the walk cannot leave the thread's stack.
+class FramePointerUnwinder final : public Unwinder {
+public:
+    bool Step(UnwindState& state, UnwindMemory& memory, const ModuleLookup& modules) const override;
+};
+
+class AutoUnwinder final : public Unwinder {
+public:
+    bool Step(UnwindState& state, UnwindMemory& memory, const ModuleLookup& modules) const override;
+};
+
+// Walker for a kind; nullptr for UnwinderKind::Backtrace
+const Unwinder* GetUnwinder(UnwinderKind kind);
+
+// Writes state.pc and then the program counter of every caller, up to maxFrames.
+int UnwindStack(const Unwinder& unwinder, UnwindState& state, UnwindMemory& memory,
+    const ModuleLookup& modules, uintptr_t* frames, int maxFrames);
+
+// Register state of a thread from a ucontext_t or a report's RegisterRecord. Returns false
+// on architectures without unwinding support.
+bool UnwindStateFromContext(const void* signalContext, UnwindState& state);
+bool UnwindStateFromRegisters(const RegisterRecord& registers, UnwindState& state);
+
+// Register state of the calling function at the point of use. Inlined into the caller, so
+// frame 0 of the walk is the caller itself.
+__attribute__((always_inline)) inline bool UnwindStateHere(UnwindState& state) {
+    state.validRegisters = 0;
+    state.stackLimit = 0;
+    state.exactPc = true;
+#if defined(__x86_64__)
+    uintptr_t pc, sp, fp;
+    __asm__ volatile("lea 0(%%rip), %0\n\tmov %%rsp, %1\n\tmov %%rbp, %2" : "=r"(pc), "=r"(sp), "=r"(fp));
+    state.pc = pc;
+    state.Set(kDwarfStackPointer, sp);
+    state.Set(kDwarfFramePointer, fp);
+    return true;
+#elif defined(__aarch64__)
+    uintptr_t pc, sp, fp, lr;
+    __asm__ volatile("adr %0, .\n\tmov %1, sp\n\tmov %2, x29\n\tmov %3, x30" : "=r"(pc), "=r"(sp), "=r"(fp), "=r"(lr));
+    state.pc = pc;
+    state.Set(kDwarfStackPointer, sp);
+    state.Set(kDwarfFramePointer, fp);
+    state.Set(kDwarfReturnAddress, lr);
+    return true;
+#else
+    state.pc = 0;
+    return false;
+#endif
+}
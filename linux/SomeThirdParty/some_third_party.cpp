@@ -0,0 +1,11 @@
+// Linux counterpart of windows/.../SomeThirdParty: a shared library the demo loads with dlopen
+// and that crashes on a null pointer write, so reports can be checked for frames attributed
+// to a module loaded after InstallCrashHandlers().
+//
+// Build: g++ -std=c++17 -O2 -g -shared -fPIC some_third_party.cpp -o libSomeThirdParty.so
+
+extern "C" __attribute__((visibility("default"))) void CrashFunction() {
+    // Cause an intentional segmentation fault
+    volatile int* ptr = nullptr;
+    *ptr = 42;
+}
@@ -22,6 +22,14 @@
 // see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
 // <http://www.gnu.org/licenses/>.
 
+// This project's copy of libstdc++'s <stacktrace>, changed where the
+// handlers need it. The additions are marked "Extension:" where they are
+// defined, so the file can still be compared with upstream:
+//   __resolve_stacktrace        one lookup per distinct PC for all fields
+//   __inplace_stacktrace<N>     capture into inline storage, no heap
+//   pmr::__stacktrace_arena<N>  inline arena for pmr::stacktrace::current
+//   __format_stacktrace         text or JSON into a caller buffer, no heap
+
 #ifndef _GLIBCXX_STACKTRACE
 #define _GLIBCXX_STACKTRACE 1
 
@@ -43,7 +51,9 @@
 #include <new>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <bits/memory_resource.h>
+#include <memory_resource> // monotonic_buffer_resource
 #include <bits/stl_algobase.h>
 #include <bits/stl_algo.h>
 #include <bits/stl_iterator.h>
@@ -55,6 +65,25 @@ namespace std _GLIBCXX_VISIBILITY(default)
 {
 	_GLIBCXX_BEGIN_NAMESPACE_VERSION
 
+	template<typename _Allocator> class basic_stacktrace;
+
+	// Extension: the results of description(), source_file() and source_line()
+	// for one frame, as filled in by __resolve_stacktrace.
+	struct __stacktrace_entry_info
+	{
+		string description;
+		string source_file;
+		__UINT_LEAST32_TYPE__ source_line = 0;
+		bool resolved = false; // false if no information was found
+	};
+
+	// Extension: the layouts of __format_stacktrace.
+	enum class __stacktrace_layout
+	{
+		__text, // as operator<<
+		__json  // one line, for log pipelines
+	};
+
 		// [stacktrace.entry], class stacktrace_entry
 		class stacktrace_entry
 	{
@@ -137,10 +166,20 @@ namespace std _GLIBCXX_VISIBILITY(default)
 		native_handle_type _M_pc = -1;
 
 		template<typename _Allocator> friend class basic_stacktrace;
+		template<size_t _Capacity> friend class __inplace_stacktrace;
 
 		friend ostream&
 			operator<<(ostream&, const stacktrace_entry&);
 
+		template<typename _Stacktrace>
+		friend vector<__stacktrace_entry_info>
+			__resolve_stacktrace(const _Stacktrace&);
+
+		template<typename _Stacktrace>
+		friend char*
+			__format_stacktrace(char*, char*, const _Stacktrace&,
+				__stacktrace_layout);
+
 		// Type-erased wrapper for the fields of a stacktrace entry.
 		// This type is independent of which std::string ABI is in use.
 		struct _Info
@@ -176,6 +215,39 @@ namespace std _GLIBCXX_VISIBILITY(default)
 				return false;
 			return _Info(__desc, __file, __line)._M_populate(_M_pc);
 		}
+
+		// Extension: a caller buffer _M_get_info_fixed copies a field into.
+		struct _Fixed_string
+		{
+			char* _M_buf;
+			size_t _M_size; // including the terminating null
+		};
+
+		static void
+			_S_set_fixed(void* __dest, const char* __str)
+		{
+			auto* __s = static_cast<_Fixed_string*>(__dest);
+			size_t __n = 0;
+			for (; __str[__n] != '\0' && __n + 1 < __s->_M_size; ++__n)
+				__s->_M_buf[__n] = __str[__n];
+			__s->_M_buf[__n] = '\0';
+		}
+
+		// Extension: like _M_get_info, but the strings are cut to fit into
+		// fixed buffers instead of being assigned to std::string, so nothing
+		// is allocated on this side of _M_populate.
+		bool
+			_M_get_info_fixed(_Fixed_string* __desc, _Fixed_string* __file,
+				int* __line) const
+		{
+			if (!*this)
+				return false;
+			_Info __info(nullptr, nullptr, __line);
+			__info._M_desc = __desc;
+			__info._M_file = __file;
+			__info._M_set = _S_set_fixed;
+			return __info._M_populate(_M_pc);
+		}
 	};
 
 	class __stacktrace_impl
@@ -694,6 +766,247 @@ namespace std _GLIBCXX_VISIBILITY(default)
 		__a.swap(__b);
 	}
 
+	// Extension: a stacktrace that keeps up to _Capacity frames inside the
+	// object itself. Capturing never touches the heap, so current() is usable
+	// from signal handlers and from a new-handler when memory is exhausted.
+	// Frames beyond the capacity are dropped.
+	template<size_t _Capacity>
+	class __inplace_stacktrace
+		: private __stacktrace_impl
+	{
+		static_assert(_Capacity > 0
+			&& _Capacity <= __gnu_cxx::__int_traits<unsigned short>::__max);
+
+		using uintptr_t = __UINTPTR_TYPE__;
+
+	public:
+		using value_type = stacktrace_entry;
+		using const_reference = const value_type&;
+		using reference = value_type&;
+		using const_iterator
+			= __gnu_cxx::__normal_iterator<const value_type*,
+			__inplace_stacktrace>;
+		using iterator = const_iterator;
+		using reverse_iterator = std::reverse_iterator<iterator>;
+		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+		using difference_type = ptrdiff_t;
+		using size_type = unsigned short;
+
+		// creation, same overloads as basic_stacktrace minus the allocator
+
+		[[__gnu__::__noinline__]]
+		static __inplace_stacktrace
+			current() noexcept
+		{
+			__inplace_stacktrace __ret;
+			_Capture __c{ std::__addressof(__ret), _Capacity };
+			if (_S_current(_S_push_back, std::__addressof(__c)) < 0)
+				__ret._M_size = 0;
+			return __ret;
+		}
+
+		[[__gnu__::__noinline__]]
+		static __inplace_stacktrace
+			current(size_type __skip) noexcept
+		{
+			__inplace_stacktrace __ret;
+			if (__skip >= __INT_MAX__) [[unlikely]]
+				return __ret;
+			_Capture __c{ std::__addressof(__ret), _Capacity };
+			if (_S_current(_S_push_back, std::__addressof(__c), __skip) < 0)
+				__ret._M_size = 0;
+			return __ret;
+		}
+
+		[[__gnu__::__noinline__]]
+		static __inplace_stacktrace
+			current(size_type __skip, size_type __max_depth) noexcept
+		{
+			__glibcxx_assert(__skip <= (size_type(-1) - __max_depth));
+
+			__inplace_stacktrace __ret;
+			if (__max_depth == 0 || __skip >= __INT_MAX__) [[unlikely]]
+				return __ret;
+			_Capture __c{ std::__addressof(__ret),
+				std::min<size_type>(__max_depth, _Capacity) };
+			if (_S_current(_S_push_back, std::__addressof(__c), __skip) < 0)
+				__ret._M_size = 0;
+			return __ret;
+		}
+
+		constexpr __inplace_stacktrace() noexcept = default;
+
+		// observers
+
+		[[nodiscard]]
+		const_iterator
+			begin() const noexcept
+		{
+			return const_iterator{ _M_frames };
+		}
+
+		[[nodiscard]]
+		const_iterator
+			end() const noexcept
+		{
+			return begin() + size();
+		}
+
+		[[nodiscard]]
+		const_reverse_iterator
+			rbegin() const noexcept
+		{
+			return std::make_reverse_iterator(end());
+		}
+
+		[[nodiscard]]
+		const_reverse_iterator
+			rend() const noexcept
+		{
+			return std::make_reverse_iterator(begin());
+		}
+
+		[[nodiscard]] const_iterator cbegin() const noexcept { return begin(); }
+		[[nodiscard]] const_iterator cend() const noexcept { return end(); }
+
+		[[nodiscard]]
+		const_reverse_iterator
+			crbegin() const noexcept { return rbegin(); };
+
+		[[nodiscard]]
+		const_reverse_iterator
+			crend() const noexcept { return rend(); };
+
+		[[nodiscard]] bool empty() const noexcept { return size() == 0; }
+		[[nodiscard]] size_type size() const noexcept { return _M_size; }
+		[[nodiscard]] size_type max_size() const noexcept { return _Capacity; }
+
+		[[nodiscard]]
+		const_reference
+			operator[](size_type __n) const noexcept
+		{
+			__glibcxx_assert(__n < size());
+			return begin()[__n];
+		}
+
+		[[nodiscard]]
+		const_reference
+			at(size_type __n) const
+		{
+			if (__n >= size())
+				__throw_out_of_range("__inplace_stacktrace::at: bad frame number");
+			return begin()[__n];
+		}
+
+		// comparisons
+
+		template<size_t _Capacity2>
+		[[nodiscard]]
+		friend bool
+			operator==(const __inplace_stacktrace& __x,
+				const __inplace_stacktrace<_Capacity2>& __y) noexcept
+		{
+			return std::equal(__x.begin(), __x.end(), __y.begin(), __y.end());
+		}
+
+		template<size_t _Capacity2>
+		[[nodiscard]]
+		friend strong_ordering
+			operator<=>(const __inplace_stacktrace& __x,
+				const __inplace_stacktrace<_Capacity2>& __y) noexcept
+		{
+			if (auto __s = __x.size() <=> __y.size(); __s != 0)
+				return __s;
+			return std::lexicographical_compare_three_way(__x.begin(), __x.end(),
+				__y.begin(), __y.end());
+		}
+
+		// modifiers
+		void
+			swap(__inplace_stacktrace& __other) noexcept
+		{
+			std::swap(_M_frames, __other._M_frames);
+			std::swap(_M_size, __other._M_size);
+		}
+
+	private:
+		struct _Capture
+		{
+			__inplace_stacktrace* _M_trace;
+			size_type _M_limit;
+		};
+
+		static int
+			_S_push_back(void* __data, uintptr_t __pc) noexcept
+		{
+			auto& __c = *static_cast<_Capture*>(__data);
+			auto& __s = *__c._M_trace;
+			if (__s._M_size == __c._M_limit) [[unlikely]]
+				return 1; // stop tracing due to reaching max depth
+			__s._M_frames[__s._M_size++]._M_pc = __pc;
+			return 0; // continue tracing
+		}
+
+		stacktrace_entry _M_frames[_Capacity];
+		size_type _M_size = 0;
+	};
+
+	template<size_t _Capacity>
+	inline void
+		swap(__inplace_stacktrace<_Capacity>&__a, __inplace_stacktrace<_Capacity>&__b)
+		noexcept
+	{
+		__a.swap(__b);
+	}
+
+	// Extension: resolves every frame of __st, looking each distinct PC up
+	// once for all three fields instead of once per query. The frames are
+	// sorted by PC only to find repeats, e.g. from recursion, which reuse the
+	// first result. Each lookup is still one _M_populate() call: the library
+	// has no call that resolves several PCs at once.
+	template<typename _Stacktrace>
+	vector<__stacktrace_entry_info>
+		__resolve_stacktrace(const _Stacktrace&__st)
+	{
+		using size_type = typename _Stacktrace::size_type;
+		const size_type __n = __st.size();
+		vector<__stacktrace_entry_info> __infos(__n);
+		vector<size_type> __order(__n);
+		for (size_type __i = 0; __i < __n; ++__i)
+			__order[__i] = __i;
+		std::sort(__order.begin(), __order.end(),
+			[&__st](size_type __a, size_type __b) { return __st[__a] < __st[__b]; });
+
+		for (size_type __k = 0; __k < __n; ++__k)
+		{
+			const size_type __i = __order[__k];
+			if (__k != 0 && __st[__order[__k - 1]] == __st[__i])
+			{
+				__infos[__i] = __infos[__order[__k - 1]];
+				continue;
+			}
+			auto& __info = __infos[__i];
+			int __line = 0;
+			__info.resolved = __st[__i]._M_get_info(&__info.description,
+				&__info.source_file, &__line);
+			__info.source_line = __line;
+		}
+		return __infos;
+	}
+
+	// Same layout as operator<<(ostream&, const stacktrace_entry&)
+	inline ostream&
+		__write_stacktrace_entry(ostream & __os, const __stacktrace_entry_info & __info)
+	{
+		if (__info.resolved)
+		{
+			__os.width(4);
+			__os << __info.description << " at " << __info.source_file << ':'
+				<< __info.source_line;
+		}
+		return __os;
+	}
+
 	inline ostream&
 		operator<<(ostream & __os, const stacktrace_entry & __f)
 	{
@@ -707,18 +1020,182 @@ namespace std _GLIBCXX_VISIBILITY(default)
 		return __os;
 	}
 
-	template<typename _Allocator>
+	// Shared by the operator<< overloads of all stacktrace types
+	template<typename _Stacktrace>
 	inline ostream&
-		operator<<(ostream & __os, const basic_stacktrace<_Allocator>&__st)
+		__write_stacktrace(ostream & __os, const _Stacktrace & __st)
 	{
+		const auto __infos = std::__resolve_stacktrace(__st);
 		for (stacktrace::size_type __i = 0; __i < __st.size(); ++__i)
 		{
 			__os.width(4);
-			__os << __i << "# " << __st[__i] << '\n';
+			__os << __i << "# ";
+			std::__write_stacktrace_entry(__os, __infos[__i]) << '\n';
 		}
 		return __os;
 	}
 
+	// Extension: bounded output for __format_stacktrace. Everything past
+	// _M_last is dropped.
+	struct __stacktrace_output
+	{
+		char* _M_cur;
+		char* _M_last;
+
+		void
+			_M_put(char __c) noexcept
+		{
+			if (_M_cur != _M_last)
+				*_M_cur++ = __c;
+		}
+
+		void
+			_M_put(const char* __str) noexcept
+		{
+			for (; *__str != '\0'; ++__str)
+				_M_put(*__str);
+		}
+
+		// Right-aligned in __width characters, as ostream::width does
+		void
+			_M_put_padded(const char* __str, size_t __width) noexcept
+		{
+			size_t __len = 0;
+			while (__str[__len] != '\0')
+				++__len;
+			for (; __len < __width; ++__len)
+				_M_put(' ');
+			_M_put(__str);
+		}
+
+		void
+			_M_put_dec(unsigned long long __val, size_t __width = 0) noexcept
+		{
+			char __digits[24];
+			char* __p = __digits + sizeof(__digits);
+			*--__p = '\0';
+			do
+				*--__p = char('0' + __val % 10);
+			while ((__val /= 10) != 0);
+			_M_put_padded(__p, __width);
+		}
+
+		void
+			_M_put_hex(__UINTPTR_TYPE__ __val) noexcept
+		{
+			char __digits[2 * sizeof(__val) + 1];
+			char* __p = __digits + sizeof(__digits);
+			*--__p = '\0';
+			do
+				*--__p = "0123456789abcdef"[__val & 0xf];
+			while ((__val >>= 4) != 0);
+			_M_put("0x");
+			_M_put(__p);
+		}
+
+		// A JSON string body: quotes, backslashes and control characters escaped
+		void
+			_M_put_json(const char* __str) noexcept
+		{
+			for (; *__str != '\0'; ++__str)
+			{
+				const unsigned char __c = static_cast<unsigned char>(*__str);
+				if (__c == '"' || __c == '\\')
+				{
+					_M_put('\\');
+					_M_put(char(__c));
+				}
+				else if (__c < 0x20)
+				{
+					_M_put("\\u00");
+					_M_put("0123456789abcdef"[__c >> 4]);
+					_M_put("0123456789abcdef"[__c & 0xf]);
+				}
+				else
+					_M_put(char(__c));
+			}
+		}
+	};
+
+	// Extension: writes __st into [__first, __last) one frame at a time, with
+	// no allocation and no iostreams, so it can run where the heap is not
+	// usable. __text is the layout of operator<<; __json writes one line,
+	// {"frames":[{"index":0,"address":"0x...","description":"...",
+	// "file":"...","line":0},...]}. Output that does not fit is cut, and so
+	// are names longer than 511 characters. Returns the end of the output.
+	// Resolving a frame still calls _M_populate, which may allocate inside
+	// the library to demangle a name.
+	template<typename _Stacktrace>
+	char*
+		__format_stacktrace(char* __first, char* __last, const _Stacktrace & __st,
+			__stacktrace_layout __layout)
+	{
+		__stacktrace_output __out{ __first, __last };
+		const bool __json = __layout == __stacktrace_layout::__json;
+		char __desc_buf[512];
+		char __file_buf[512];
+		if (__json)
+			__out._M_put("{\"frames\":[");
+		for (size_t __i = 0; __i < __st.size(); ++__i)
+		{
+			stacktrace_entry::_Fixed_string __desc{ __desc_buf, sizeof(__desc_buf) };
+			stacktrace_entry::_Fixed_string __file{ __file_buf, sizeof(__file_buf) };
+			__desc_buf[0] = __file_buf[0] = '\0';
+			int __line = 0;
+			const bool __resolved
+				= __st[__i]._M_get_info_fixed(&__desc, &__file, &__line);
+			if (!__json)
+			{
+				__out._M_put_dec(__i, 4);
+				__out._M_put("# ");
+				if (__resolved)
+				{
+					__out._M_put_padded(__desc_buf, 4);
+					__out._M_put(" at ");
+					__out._M_put(__file_buf);
+					__out._M_put(':');
+					__out._M_put_dec(static_cast<unsigned>(__line));
+				}
+				__out._M_put('\n');
+				continue;
+			}
+			if (__i != 0)
+				__out._M_put(',');
+			__out._M_put("{\"index\":");
+			__out._M_put_dec(__i);
+			__out._M_put(",\"address\":\"");
+			__out._M_put_hex(__st[__i].native_handle());
+			__out._M_put('"');
+			if (__resolved)
+			{
+				__out._M_put(",\"description\":\"");
+				__out._M_put_json(__desc_buf);
+				__out._M_put("\",\"file\":\"");
+				__out._M_put_json(__file_buf);
+				__out._M_put("\",\"line\":");
+				__out._M_put_dec(static_cast<unsigned>(__line));
+			}
+			__out._M_put('}');
+		}
+		if (__json)
+			__out._M_put("]}\n");
+		return __out._M_cur;
+	}
+
+	template<typename _Allocator>
+	inline ostream&
+		operator<<(ostream & __os, const basic_stacktrace<_Allocator>&__st)
+	{
+		return std::__write_stacktrace(__os, __st);
+	}
+
+	template<size_t _Capacity>
+	inline ostream&
+		operator<<(ostream & __os, const __inplace_stacktrace<_Capacity>&__st)
+	{
+		return std::__write_stacktrace(__os, __st);
+	}
+
 	[[nodiscard]]
 	inline string
 		to_string(const stacktrace_entry & __f)
@@ -738,6 +1215,16 @@ namespace std _GLIBCXX_VISIBILITY(default)
 		return std::move(__os).str();
 	}
 
+	template<size_t _Capacity>
+	[[nodiscard]]
+	string
+		to_string(const __inplace_stacktrace<_Capacity>&__st)
+	{
+		std::ostringstream __os;
+		__os << __st;
+		return std::move(__os).str();
+	}
+
 	template<>
 	class formatter<stacktrace_entry>
 	{
@@ -818,10 +1305,56 @@ namespace std _GLIBCXX_VISIBILITY(default)
 		}
 	};
 
+	template<size_t _Capacity>
+	class formatter<__inplace_stacktrace<_Capacity>>
+	{
+	public:
+		constexpr typename basic_format_parse_context<char>::iterator
+			parse(basic_format_parse_context<char>& __pc)
+		{
+			const auto __first = __pc.begin();
+			if (__first == __pc.end() || *__first == '}')
+				return __first;
+			__throw_format_error("format error: invalid format-spec for "
+				"std::__inplace_stacktrace");
+		}
+
+		template<typename _Out>
+		typename basic_format_context<_Out, char>::iterator
+			format(const __inplace_stacktrace<_Capacity>& __x,
+				basic_format_context<_Out, char>& __fc) const
+		{
+			std::ostringstream __os;
+			__os << __x;
+			return __format::__write(__fc.out(), __os.view());
+		}
+	};
+
 	namespace pmr
 	{
 		using stacktrace
 			= basic_stacktrace<polymorphic_allocator<stacktrace_entry>>;
+
+		// Extension: a monotonic arena with inline storage and no upstream,
+		// so pmr::stacktrace::current(__skip, __max_depth, &__arena) never
+		// touches the global heap. Sized for __max_depth <= _Frames, including
+		// the growth steps above 128 frames and the final shrink-to-fit copy.
+		// If the arena runs out the capture fails and returns an empty trace.
+		template<size_t _Frames>
+		class __stacktrace_arena
+			: public monotonic_buffer_resource
+		{
+		public:
+			__stacktrace_arena() noexcept
+				: monotonic_buffer_resource(_M_buf, sizeof(_M_buf),
+					null_memory_resource())
+			{
+			}
+
+		private:
+			alignas(stacktrace_entry)
+				unsigned char _M_buf[4 * _Frames * sizeof(stacktrace_entry)];
+		};
 	}
 
 	// [stacktrace.basic.hash], hash support
@@ -838,6 +1371,21 @@ namespace std _GLIBCXX_VISIBILITY(default)
 		}
 	};
 
+	template<size_t _Capacity>
+	struct hash<__inplace_stacktrace<_Capacity>>
+	{
+		[[nodiscard]]
+		size_t
+			operator()(const __inplace_stacktrace<_Capacity>& __st) const noexcept
+		{
+			hash<stacktrace_entry> __h;
+			size_t __val = _Hash_impl::hash(__st.size());
+			for (const auto& __f : __st)
+				__val = _Hash_impl::__hash_combine(__h(__f), __val);
+			return __val;
+		}
+	};
+
 	template<typename _Allocator>
 	struct hash<basic_stacktrace<_Allocator>>
 	{